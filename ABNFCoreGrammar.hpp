@@ -32,12 +32,12 @@
 #include <boost/spirit/include/qi_repeat.hpp>
 #include <boost/spirit/include/qi_binary.hpp>
 #include <boost/fusion/include/vector.hpp>
-#include <boost/spirit/home/phoenix/core.hpp>
-#include <boost/spirit/home/phoenix/function.hpp>
-#include <boost/spirit/home/phoenix/operator.hpp>
-#include <boost/spirit/home/phoenix/object.hpp>
-#include <boost/spirit/home/phoenix/scope.hpp>
-#include <boost/spirit/home/phoenix/bind.hpp>
+#include <boost/spirit/include/phoenix_core.hpp>
+#include <boost/spirit/include/phoenix_function.hpp>
+#include <boost/spirit/include/phoenix_operator.hpp>
+#include <boost/spirit/include/phoenix_object.hpp>
+#include <boost/spirit/include/phoenix_scope.hpp>
+#include <boost/spirit/include/phoenix_bind.hpp>
 
 namespace boost { namespace spirit { namespace traits {
     template <>
@@ -0,0 +1,1243 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    Benchmarks.hpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Performance benchmarks for the parsers, the packet buffers,
+ *              the reliable channel and the file and bitmap transfers.
+ *              Results are reported through a callback taking a benchmark
+ *              name and a result string, the same way the regression tests
+ *              report theirs.
+**/
+
+#pragma once
+
+/* STL includes */
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <string>
+#include <sstream>
+#include <vector>
+
+/* Boost includes */
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+/* WebP2P includes */
+#include "BitmapTransfer.hpp"
+#include "FileTransfer.hpp"
+#include "PacketBuffer.hpp"
+#include "ReliableChannel.hpp"
+#include "SendScheduler.hpp"
+#include "SessionDescriptorGrammar.hpp"
+#include "SessionDescriptorParser.hpp"
+#include "SessionDescriptorStreamParser.hpp"
+#include "SessionDescriptorView.hpp"
+#include "SessionDescriptorViewGrammar.hpp"
+#include "SessionDescriptorWriter.hpp"
+
+class BenchmarkTimer {
+    boost::posix_time::ptime start;
+public:
+    BenchmarkTimer() : start(now()) {}
+
+    long long elapsedNanoseconds() const {
+        return (now() - start).total_nanoseconds();
+    }
+private:
+    static boost::posix_time::ptime now() {
+        return boost::posix_time::microsec_clock::universal_time();
+    }
+};
+
+struct GrammarBenchmarks {
+    /* The kind of SDP that ICEClient::getLocalCandidates produces. */
+    static std::string localCandidatesSDP() {
+        return
+            "v=0\n"
+            "o=- 3414953978 3414953978 IN IP4 localhost\n"
+            "s=ice\n"
+            "t=0 0\n"
+            "a=ice-ufrag:3f6a2b1c\n"
+            "a=ice-pwd:5c2d7e9f0a1b4c3d6e8f7a9b\n"
+            "m=audio 50016 RTP/AVP 0\n"
+            "c=IN IP4 218.186.177.16\n"
+            "a=candidate:H1 1 UDP 2130706431 192.168.1.100 50016 typ host\n"
+            "a=candidate:H2 1 UDP 2130706175 10.0.0.5 50016 typ host\n"
+            "a=candidate:S1 1 UDP 1694498815 218.186.177.16 50016 typ srflx\n"
+            "a=candidate:R1 1 UDP 16777215 216.146.46.55 49170 typ relay\n";
+    }
+
+    template<typename F> static void report(
+        const std::string& n,
+        long long totalNanoseconds,
+        unsigned iterations,
+        const std::string& unit,
+        F callback) {
+        std::stringstream result;
+        result << (totalNanoseconds / iterations) << " ns/" << unit;
+        callback("Benchmark: " + n, result.str());
+    }
+
+    template<typename F> static void runBenchmarks(F callback) {
+        runGrammarCacheBenchmarks(callback);
+        runViewBenchmarks(callback);
+        runCandidateBenchmarks(callback);
+        runWriterBenchmarks(callback);
+        runRejectBenchmarks(callback);
+        runLimitBenchmarks(callback);
+        runAttributeLookupBenchmarks(callback);
+        runPacketBufferBenchmarks(callback);
+    }
+
+    /* Parse cost of a typical remote configuration with and without the cost
+     * of building the grammar.
+    **/
+    template<typename F> static void runGrammarCacheBenchmarks(F callback) {
+        using namespace boost::spirit::qi;
+        enum { ITERATIONS = 200 };
+        const std::string s = localCandidatesSDP();
+
+        {
+            BenchmarkTimer t;
+            for(unsigned i = 0; i < ITERATIONS; i++) {
+                SessionDescriptorGrammar sdg;
+            }
+            report("SessionDescriptorGrammar construction",
+                t.elapsedNanoseconds(), ITERATIONS, "construction", callback);
+        }
+        {
+            BenchmarkTimer t;
+            for(unsigned i = 0; i < ITERATIONS; i++) {
+                SessionDescriptorGrammar sdg;
+                SessionDescriptorData data;
+                std::string::const_iterator f = s.begin();
+                std::string::const_iterator l = s.end();
+                parse(f, l, sdg, data);
+            }
+            report("SDP parse with grammar construction",
+                t.elapsedNanoseconds(), ITERATIONS, "parse", callback);
+        }
+        {
+            SessionDescriptorGrammar::instance();
+            BenchmarkTimer t;
+            for(unsigned i = 0; i < ITERATIONS; i++) {
+                SessionDescriptorData data;
+                std::string::const_iterator f = s.begin();
+                std::string::const_iterator l = s.end();
+                parse(f, l, SessionDescriptorGrammar::instance(), data);
+            }
+            report("SDP parse with cached grammar",
+                t.elapsedNanoseconds(), ITERATIONS, "parse", callback);
+        }
+    }
+
+    /* Zero-copy parsing compared to parsing into the owning structure, and
+     * the single-pass parser compared to the spirit grammar.
+    **/
+    template<typename F> static void runViewBenchmarks(F callback) {
+        enum { ITERATIONS = 1000 };
+        const std::string s = localCandidatesSDP();
+
+        {
+            SessionDescriptorView view;
+            BenchmarkTimer t;
+            for(unsigned i = 0; i < ITERATIONS; i++) {
+                view.time.clear();
+                view.sessionAttributes.clear();
+                view.mediaDescriptions.clear();
+                std::string::const_iterator f = s.begin();
+                std::string::const_iterator l = s.end();
+                boost::spirit::qi::parse(f, l,
+                    SessionDescriptorViewGrammar::instance(), view);
+            }
+            report("SDP view parse with spirit",
+                t.elapsedNanoseconds(), ITERATIONS, "parse", callback);
+        }
+        {
+            SessionDescriptorView view;
+            view.parse(s);
+            BenchmarkTimer t;
+            for(unsigned i = 0; i < ITERATIONS; i++) {
+                view.parse(s);
+            }
+            report("SDP view parse with SessionDescriptorParser",
+                t.elapsedNanoseconds(), ITERATIONS, "parse", callback);
+        }
+        {
+            SessionDescriptorStreamParser::Handler handler;
+            SessionDescriptorStreamParser parser(handler);
+            BenchmarkTimer t;
+            for(unsigned i = 0; i < ITERATIONS; i++) {
+                parser.reset();
+                for(size_t offset = 0; offset < s.size(); offset += 64)
+                    parser.feed(s.data() + offset,
+                        std::min<size_t>(64, s.size() - offset));
+                parser.finish();
+            }
+            report("SDP stream parse in 64 byte chunks",
+                t.elapsedNanoseconds(), ITERATIONS, "parse", callback);
+        }
+        {
+            BenchmarkTimer t;
+            for(unsigned i = 0; i < ITERATIONS; i++) {
+                SessionDescriptorView view;
+                SessionDescriptorData data;
+                view.parse(s);
+                view.materialize(data);
+            }
+            report("SDP view parse and materialize",
+                t.elapsedNanoseconds(), ITERATIONS, "parse", callback);
+        }
+    }
+
+    /* The candidate attribute parser compared to the stringstream extraction
+     * ICEClient used before. Only the parsing is measured, not the
+     * conversion to pj_ice_sess_cand.
+    **/
+    template<typename F> static void runCandidateBenchmarks(F callback) {
+        enum { ITERATIONS = 10000 };
+        const std::string s = "S1 1 UDP 1694498815 218.186.177.16 50016 "
+            "typ srflx raddr 192.168.1.100 rport 50016";
+        const StringView candidate(s.begin(), s.end());
+
+        {
+            BenchmarkTimer t;
+            for(unsigned i = 0; i < ITERATIONS; i++) {
+                std::stringstream ss(
+                    std::string(candidate.begin(), candidate.end()));
+                std::string foundation, transport, ipaddr, skip, type;
+                int comp_id, prio;
+                unsigned short port;
+                ss >> foundation >> comp_id >> transport >> prio
+                   >> ipaddr >> port >> skip >> type;
+            }
+            report("candidate parse with stringstream",
+                t.elapsedNanoseconds(), ITERATIONS, "candidate", callback);
+        }
+        {
+            CandidateView view;
+            BenchmarkTimer t;
+            for(unsigned i = 0; i < ITERATIONS; i++) {
+                SessionDescriptorParser::parseCandidate(
+                    candidate.begin(), candidate.end(), view);
+            }
+            report("candidate parse with SessionDescriptorParser",
+                t.elapsedNanoseconds(), ITERATIONS, "candidate", callback);
+        }
+    }
+
+    static void streamAttribute(std::ostream& ss, const Attribute& a) {
+        if(const PropertyAttribute* at = boost::get<PropertyAttribute>(&a))
+            ss << "a=" << *at << "\n";
+        else if(const ValuedAttribute* at = boost::get<ValuedAttribute>(&a))
+            ss << "a=" << boost::fusion::at_c<0>(*at) << ":"
+               << boost::fusion::at_c<1>(*at) << "\n";
+    }
+
+    /* Serializing the owning structure with the old stringstream code path
+     * compared to SessionDescriptorWriter on a reused string and on a
+     * stack buffer.
+    **/
+    template<typename F> static void runWriterBenchmarks(F callback) {
+        enum { ITERATIONS = 1000 };
+        const std::string s = localCandidatesSDP();
+        SessionDescriptorView view;
+        view.parse(s);
+        SessionDescriptorData data;
+        view.materialize(data);
+
+        {
+            BenchmarkTimer t;
+            for(unsigned i = 0; i < ITERATIONS; i++) {
+                std::stringstream ss;
+                ss << "v=" << data.protocolVersion << "\n"
+                   << "o=" << data.origin.username << " "
+                   << data.origin.sessionID << " "
+                   << data.origin.sessionVersion << " "
+                   << data.origin.netType << " "
+                   << data.origin.addressType << " "
+                   << data.origin.unicastAddress << "\n"
+                   << "s=" << data.sessionName << "\n";
+                for(size_t j = 0; j < data.time.size(); j++)
+                    ss << "t=" << data.time[j].startTime << " "
+                       << data.time[j].stopTime << "\n";
+                for(size_t j = 0; j < data.sessionAttributes.size(); j++)
+                    streamAttribute(ss, data.sessionAttributes[j]);
+                for(size_t j = 0; j < data.mediaDescriptions.size(); j++) {
+                    const MediaDescription& m = data.mediaDescriptions[j];
+                    ss << "m=" << m.media.mediaName << " " << m.media.port
+                       << " " << m.media.protocolName;
+                    for(size_t k = 0; k < m.media.formats.size(); k++)
+                        ss << " " << m.media.formats[k];
+                    ss << "\n";
+                    for(size_t k = 0; k < m.connectionData.size(); k++)
+                        ss << "c=" << m.connectionData[k].netType << " "
+                           << m.connectionData[k].addressType << " "
+                           << m.connectionData[k].connectionAddress << "\n";
+                    for(size_t k = 0; k < m.mediaAttributes.size(); k++)
+                        streamAttribute(ss, m.mediaAttributes[k]);
+                }
+                ss.str();
+            }
+            report("SDP serialize with stringstream",
+                t.elapsedNanoseconds(), ITERATIONS, "message", callback);
+        }
+        {
+            std::string out;
+            BenchmarkTimer t;
+            for(unsigned i = 0; i < ITERATIONS; i++) {
+                out.clear();
+                StringBuffer buffer(out);
+                SessionDescriptorWriter<StringBuffer>(buffer).write(data);
+            }
+            report("SDP serialize into reused string",
+                t.elapsedNanoseconds(), ITERATIONS, "message", callback);
+        }
+        {
+            BenchmarkTimer t;
+            for(unsigned i = 0; i < ITERATIONS; i++) {
+                FixedBuffer<1024> buffer;
+                SessionDescriptorWriter<FixedBuffer<1024> >(buffer).write(data);
+            }
+            report("SDP serialize into stack buffer",
+                t.elapsedNanoseconds(), ITERATIONS, "message", callback);
+        }
+    }
+
+    /* Cost of rejecting a message with an error in its last line, which is
+     * what a flood of malformed signaling data costs.
+    **/
+    template<typename F> static void runRejectBenchmarks(F callback) {
+        using namespace boost::spirit::qi;
+        enum { ITERATIONS = 1000 };
+        const std::string s = localCandidatesSDP() + "a=candidate\x01\n";
+
+        {
+            BenchmarkTimer t;
+            for(unsigned i = 0; i < ITERATIONS; i++) {
+                SessionDescriptorData data;
+                std::string::const_iterator f = s.begin();
+                std::string::const_iterator l = s.end();
+                parse(f, l, SessionDescriptorGrammar::instance(), data);
+            }
+            report("SDP reject with cached grammar",
+                t.elapsedNanoseconds(), ITERATIONS, "message", callback);
+        }
+        {
+            SessionDescriptorView view;
+            SessionDescriptorParser::Error error;
+            BenchmarkTimer t;
+            for(unsigned i = 0; i < ITERATIONS; i++) {
+                SessionDescriptorParser::parse(s, view, error);
+            }
+            report("SDP reject with SessionDescriptorParser",
+                t.elapsedNanoseconds(), ITERATIONS, "message", callback);
+        }
+    }
+
+    /* Pathological input with the default limits and with limits so large
+     * that they never apply.
+    **/
+    template<typename F> static void runLimitBenchmarks(F callback) {
+        enum { ITERATIONS = 20 };
+        std::string longValue = localCandidatesSDP()
+            + "a=x:" + std::string(1 << 20, 'x') + "\n";
+        std::string manyCandidates = localCandidatesSDP();
+        for(unsigned i = 0; i < 5000; i++)
+            manyCandidates +=
+                "a=candidate:H1 1 UDP 2130706431 192.168.1.100 50016 typ host\n";
+
+        SessionDescriptorParser::Limits unbounded;
+        unbounded.maxLineLength = unbounded.maxLines = unbounded.maxAttributes
+            = unbounded.maxMediaDescriptions = unbounded.maxCandidates
+            = static_cast<size_t>(-1) / 4;
+
+        runLimitBenchmark("1 MiB attribute value", longValue,
+            SessionDescriptorParser::Limits(), ITERATIONS, callback);
+        runLimitBenchmark("1 MiB attribute value, no limits", longValue,
+            unbounded, ITERATIONS, callback);
+        runLimitBenchmark("5000 candidates", manyCandidates,
+            SessionDescriptorParser::Limits(), ITERATIONS, callback);
+        runLimitBenchmark("5000 candidates, no limits", manyCandidates,
+            unbounded, ITERATIONS, callback);
+    }
+
+    template<typename F> static void runLimitBenchmark(
+        const std::string& n,
+        const std::string& s,
+        const SessionDescriptorParser::Limits& limits,
+        unsigned iterations,
+        F callback) {
+        SessionDescriptorStreamParser::Handler handler;
+        SessionDescriptorStreamParser parser(handler, limits);
+        BenchmarkTimer t;
+        for(unsigned i = 0; i < iterations; i++) {
+            parser.reset();
+            for(size_t offset = 0; offset < s.size(); offset += 1500) {
+                if(!parser.feed(s.data() + offset,
+                    std::min<size_t>(1500, s.size() - offset)))
+                    break;
+            }
+            parser.finish();
+        }
+        report("SDP stream parse of " + n,
+            t.elapsedNanoseconds(), iterations, "message", callback);
+    }
+
+    /* Finding the ICE attributes of a parsed description by comparing names
+     * against the section index built at parse time.
+    **/
+    template<typename F> static void runAttributeLookupBenchmarks(F callback) {
+        using boost::algorithm::equals;
+        enum { ITERATIONS = 100000 };
+        const std::string s = localCandidatesSDP();
+        SessionDescriptorView view;
+        view.parse(s);
+        size_t found = 0;
+
+        {
+            BenchmarkTimer t;
+            for(unsigned i = 0; i < ITERATIONS; i++) {
+                for(size_t j = 0; j < view.sessionAttributes.size(); j++) {
+                    if(equals(view.sessionAttributes[j].name, "ice-ufrag")
+                        || equals(view.sessionAttributes[j].name, "ice-pwd"))
+                        found++;
+                }
+                const std::vector<AttributeView>& media
+                    = view.mediaDescriptions[0].mediaAttributes;
+                for(size_t j = 0; j < media.size(); j++) {
+                    if(equals(media[j].name, "candidate"))
+                        found++;
+                }
+            }
+            report("attribute dispatch by name",
+                t.elapsedNanoseconds(), ITERATIONS, "description", callback);
+        }
+        {
+            BenchmarkTimer t;
+            for(unsigned i = 0; i < ITERATIONS; i++) {
+                if(view.findSessionAttribute(ATTRIBUTE_ICE_UFRAG))
+                    found++;
+                if(view.findSessionAttribute(ATTRIBUTE_ICE_PWD))
+                    found++;
+                const std::vector<AttributeView>& media
+                    = view.mediaDescriptions[0].mediaAttributes;
+                for(size_t j = 0; j < media.size(); j++) {
+                    if(media[j].id == ATTRIBUTE_CANDIDATE)
+                        found++;
+                }
+            }
+            report("attribute dispatch by id",
+                t.elapsedNanoseconds(), ITERATIONS, "description", callback);
+        }
+        /* keeps the loops from being optimised away */
+        if(found == 0)
+            callback("Benchmark: attribute dispatch", "no attributes found");
+    }
+
+    /* Delivering received packets to a consumer that holds on to the last
+     * few of them, as copies into strings and as slices of pooled buffers.
+    **/
+    template<typename F> static void runPacketBufferBenchmarks(F callback) {
+        enum { ITERATIONS = 100000, HELD = 64, PACKET_SIZE = 1200 };
+        const std::string packet(PACKET_SIZE, 'x');
+
+        {
+            std::vector<std::string> held(HELD);
+            BenchmarkTimer t;
+            for(unsigned i = 0; i < ITERATIONS; i++) {
+                std::string received(packet.data(), packet.size());
+                held[i % HELD] = std::string(received);
+            }
+            report("packet delivery as std::string",
+                t.elapsedNanoseconds(), ITERATIONS, "packet", callback);
+        }
+        {
+            PacketBufferPool pool;
+            std::vector<PacketSlice> held(HELD);
+            BenchmarkTimer t;
+            for(unsigned i = 0; i < ITERATIONS; i++)
+                held[i % HELD] = pool.copy(packet.data(), packet.size());
+            report("packet delivery as pooled slice",
+                t.elapsedNanoseconds(), ITERATIONS, "packet", callback);
+            held.clear();
+        }
+    }
+};
+
+/* Two channels connected by a simulated path with a fixed delay, a limited
+ * packet rate and random loss, on a virtual clock. The same seed gives the
+ * same losses, so runs can be compared.
+**/
+class SimulatedPath {
+public:
+    typedef ReliableChannel::Milliseconds Milliseconds;
+
+    class Endpoint :
+        public ReliableChannel::Link,
+        public ReliableChannel::Handler {
+        SimulatedPath& path;
+        Endpoint*      peer;
+        /* microseconds, when the packets sent so far have left */
+        unsigned long long busyUntil;
+
+        friend class SimulatedPath;
+    public:
+        ReliableChannel           channel;
+        std::vector<std::string>  messages;
+        std::vector<ReliableChannel::ChannelId> channels;
+        std::vector<Milliseconds> deliveredAt;
+        unsigned                  bufferedAmountLowEvents;
+
+        Endpoint(SimulatedPath& path,
+            const ReliableChannel::Configuration& configuration) :
+            path(path),
+            peer(NULL),
+            busyUntil(0),
+            channel(*this, *this, configuration),
+            bufferedAmountLowEvents(0) {}
+
+        void sendPacket(const char* data, size_t size) {
+            path.transmit(*this, data, size);
+        }
+
+        void messageReceived(ReliableChannel::ChannelId channel,
+            const PacketSlice& message, bool reliable) {
+            messages.push_back(message.toString());
+            channels.push_back(channel);
+            deliveredAt.push_back(path.now);
+        }
+
+        void bufferedAmountLow() {
+            bufferedAmountLowEvents++;
+        }
+    };
+
+private:
+    struct Arrival {
+        Endpoint*   to;
+        PacketSlice packet;
+    };
+
+    Milliseconds delay;
+    unsigned     packetsPerMillisecond;
+    unsigned     lossPerMille;
+    unsigned     seed;
+    std::multimap<Milliseconds, Arrival> inTransit;
+
+public:
+    Milliseconds       now;
+    unsigned long long packetsLost;
+    /* packets waiting for the link beyond which more are dropped, 0 for
+     * no limit
+    **/
+    size_t             queueLimit;
+    unsigned long long packetsDropped;
+    /* microseconds spent waiting for the link, over all packets */
+    unsigned long long totalQueueDelay;
+    unsigned long long maxQueueDelay;
+    unsigned long long packetsQueued;
+    Endpoint           a;
+    Endpoint           b;
+
+    SimulatedPath(
+        Milliseconds delay,
+        unsigned packetsPerMillisecond,
+        unsigned lossPerMille,
+        const ReliableChannel::Configuration& configuration
+            = ReliableChannel::Configuration()) :
+        delay(delay),
+        packetsPerMillisecond(packetsPerMillisecond),
+        lossPerMille(lossPerMille),
+        seed(12345),
+        now(0),
+        packetsLost(0),
+        queueLimit(0),
+        packetsDropped(0),
+        totalQueueDelay(0),
+        maxQueueDelay(0),
+        packetsQueued(0),
+        a(*this, configuration),
+        b(*this, configuration) {
+        a.peer = &b;
+        b.peer = &a;
+    }
+
+    void transmit(Endpoint& from, const char* data, size_t size) {
+        seed = seed * 1103515245 + 12345;
+        if((seed >> 16) % 1000 < lossPerMille) {
+            packetsLost++;
+            return;
+        }
+        unsigned long long waiting = from.busyUntil > now * 1000
+            ? from.busyUntil - now * 1000 : 0;
+        unsigned long long serviceTime = 1000 / packetsPerMillisecond;
+        if(queueLimit > 0 && waiting / serviceTime >= queueLimit) {
+            packetsDropped++;
+            return;
+        }
+        totalQueueDelay += waiting;
+        maxQueueDelay = std::max(maxQueueDelay, waiting);
+        packetsQueued++;
+        from.busyUntil = std::max(from.busyUntil, now * 1000) + serviceTime;
+        Arrival arrival;
+        arrival.to = from.peer;
+        arrival.packet = PacketBufferPool::shared().copy(data, size);
+        inTransit.insert(std::make_pair(
+            (from.busyUntil + 999) / 1000 + delay, arrival));
+    }
+
+    /* Delivers the packets and runs the timers due until the given time,
+     * or until nothing is left to do.
+    **/
+    void runUntil(Milliseconds until) {
+        for(;;) {
+            Milliseconds next = std::min(
+                a.channel.nextTimeout(), b.channel.nextTimeout());
+            if(!inTransit.empty())
+                next = std::min(next, inTransit.begin()->first);
+            if(next == ReliableChannel::NEVER || next > until)
+                break;
+            now = std::max(now, next);
+
+            while(!inTransit.empty() && inTransit.begin()->first <= now) {
+                Arrival arrival = inTransit.begin()->second;
+                inTransit.erase(inTransit.begin());
+                arrival.to->channel.packetReceived(arrival.packet, now);
+            }
+            if(a.channel.nextTimeout() <= now)
+                a.channel.timerExpired(now);
+            if(b.channel.nextTimeout() <= now)
+                b.channel.timerExpired(now);
+        }
+        if(until != ReliableChannel::NEVER)
+            now = std::max(now, until);
+    }
+
+    void run() {
+        runUntil(ReliableChannel::NEVER);
+    }
+};
+
+struct ChannelBenchmarks {
+    /* Messages sent from a to b at a steady rate over a 20 ms path, with
+     * more and more loss. Throughput and latency are in virtual time, the
+     * CPU time is real.
+    **/
+    template<typename F> static void runBenchmarks(F callback) {
+        const unsigned losses[] = { 0, 10, 50, 100 };
+        for(size_t i = 0; i < sizeof(losses) / sizeof(losses[0]); i++)
+            runLossBenchmark(losses[i], callback);
+        runCongestionBenchmark(CongestionController::LOSS_BASED, callback);
+        runCongestionBenchmark(CongestionController::LEDBAT, callback);
+        runLargeMessageBenchmark(callback);
+        runPriorityBenchmark(false, callback);
+        runPriorityBenchmark(true, callback);
+    }
+
+    /* Short text messages every 10 ms on one channel while 4 MiB of bulk
+     * data, all sent at once, goes out on another, over a path of one
+     * packet per millisecond. The latency of the text is what it waits
+     * behind the bulk data, in the scheduler and in flight.
+    **/
+    template<typename F> static void runPriorityBenchmark(
+        bool prioritised,
+        F callback) {
+        enum {
+            TEXT = 1, BULK = 2,
+            BULK_MESSAGES = 64, BULK_SIZE = 64 * 1024,
+            TEXT_MESSAGES = 200, INTERVAL = 10
+        };
+        const std::string bulk(BULK_SIZE, 'x');
+        SimulatedPath path(20, 1, 0);
+        path.queueLimit = 300;
+        if(prioritised) {
+            path.a.channel.setPriority(TEXT, SendScheduler::PRIORITY_HIGH);
+            path.a.channel.setPriority(BULK,
+                SendScheduler::PRIORITY_BACKGROUND);
+        }
+
+        BenchmarkTimer t;
+        for(unsigned i = 0; i < BULK_MESSAGES; i++)
+            path.a.channel.send(BULK, bulk.data(), bulk.size(), path.now);
+        std::vector<SimulatedPath::Milliseconds> sentAt;
+        for(unsigned i = 0; i < TEXT_MESSAGES; i++) {
+            path.runUntil(i * INTERVAL);
+            sentAt.push_back(path.now);
+            std::string text(100, static_cast<char>('a' + i % 26));
+            path.a.channel.send(TEXT, text.data(), text.size(), path.now);
+        }
+        path.run();
+        long long ns = t.elapsedNanoseconds();
+
+        SimulatedPath::Milliseconds total = 0, worst = 0, bulkDone = 0;
+        size_t texts = 0;
+        for(size_t i = 0; i < path.b.messages.size(); i++) {
+            if(path.b.channels[i] != TEXT) {
+                bulkDone = path.b.deliveredAt[i];
+                continue;
+            }
+            SimulatedPath::Milliseconds latency
+                = path.b.deliveredAt[i] - sentAt[texts++];
+            total += latency;
+            worst = std::max(worst, latency);
+        }
+        SendScheduler::ClassStatistics text
+            = path.a.channel.getChannelStatistics(TEXT);
+        SendScheduler::ClassStatistics data
+            = path.a.channel.getChannelStatistics(BULK);
+
+        std::stringstream name;
+        name << "Benchmark: text next to a bulk transfer, "
+             << (prioritised ? "text first" : "equal priority");
+        std::stringstream result;
+        result << texts << "/" << TEXT_MESSAGES << " texts, latency "
+               << (texts > 0 ? total / texts : 0) << " ms mean "
+               << worst << " ms max, scheduler delay "
+               << text.averageDelay() << " ms mean " << text.maxDelay
+               << " ms max, bulk " << data.averageDelay()
+               << " ms mean, bulk done after " << bulkDone << " ms, "
+               << ns / (BULK_MESSAGES + TEXT_MESSAGES) << " ns/message";
+        callback(name.str(), result.str());
+    }
+
+    /* 64 KiB messages, split into packets and put together again */
+    template<typename F> static void runLargeMessageBenchmark(F callback) {
+        enum { MESSAGES = 100, MESSAGE_SIZE = 64 * 1024 };
+        const std::string message(MESSAGE_SIZE, 'x');
+        SimulatedPath path(20, 10, 0);
+
+        BenchmarkTimer t;
+        for(unsigned i = 0; i < MESSAGES; i++)
+            path.a.channel.send(
+                message.data(), message.size(), true, path.now);
+        path.run();
+        long long ns = t.elapsedNanoseconds();
+
+        bool intact = path.b.messages.size() == MESSAGES;
+        for(size_t i = 0; intact && i < path.b.messages.size(); i++)
+            intact = path.b.messages[i] == message;
+        SimulatedPath::Milliseconds last = path.b.deliveredAt.empty()
+            ? 0 : path.b.deliveredAt.back();
+
+        std::stringstream result;
+        result << path.b.messages.size() << "/" << MESSAGES
+               << (intact ? " intact, " : " corrupted, ")
+               << (last > 0 ? 1000ULL * MESSAGES * MESSAGE_SIZE / 1024
+                    / last : 0)
+               << " KiB/s, "
+               << path.a.channel.getStatistics().fragmentsSent
+               << " fragments, "
+               << ns * 1000 / (1LL * MESSAGES * MESSAGE_SIZE)
+               << " ps/byte";
+        callback("Benchmark: reliable channel, 64 KiB messages", result.str());
+    }
+
+    /* A bulk transfer, everything sent at once, over a 20 ms path of one
+     * packet per millisecond with room for 300 ms of packets in the queue.
+     * The controller should fill the link without filling the queue.
+    **/
+    template<typename F> static void runCongestionBenchmark(
+        CongestionController::Mode mode,
+        F callback) {
+        enum { MESSAGES = 5000, MESSAGE_SIZE = 1000, QUEUE = 300 };
+        const std::string message(MESSAGE_SIZE, 'x');
+        ReliableChannel::Configuration configuration;
+        configuration.congestionControl = mode;
+        SimulatedPath path(20, 1, 0, configuration);
+        path.queueLimit = QUEUE;
+
+        BenchmarkTimer t;
+        for(unsigned i = 0; i < MESSAGES; i++)
+            path.a.channel.send(
+                message.data(), message.size(), true, path.now);
+        path.run();
+        long long ns = t.elapsedNanoseconds();
+
+        SimulatedPath::Milliseconds last = path.b.deliveredAt.empty()
+            ? 0 : path.b.deliveredAt.back();
+        CongestionController::State state
+            = path.a.channel.getCongestionState();
+
+        std::stringstream name;
+        name << "Benchmark: congestion control, " << state.name
+             << ", 1 packet/ms 20 ms";
+        std::stringstream result;
+        result << path.b.deliveredAt.size() << "/" << MESSAGES
+               << " delivered, "
+               << (last > 0 ? path.b.deliveredAt.size() * 1000 / last : 0)
+               << " msg/s, queueing " << (path.packetsQueued > 0
+                    ? path.totalQueueDelay / path.packetsQueued / 1000 : 0)
+               << " ms mean " << path.maxQueueDelay / 1000 << " ms max, "
+               << path.packetsDropped << " dropped, "
+               << state.congestionEvents << " congestion events, "
+               << ns / MESSAGES << " ns/message";
+        callback(name.str(), result.str());
+    }
+
+    template<typename F> static void runLossBenchmark(
+        unsigned lossPerMille,
+        F callback) {
+        enum { MESSAGES = 4000, MESSAGE_SIZE = 1000, PER_MILLISECOND = 4 };
+        const std::string message(MESSAGE_SIZE, 'x');
+        SimulatedPath path(20, 10, lossPerMille);
+
+        BenchmarkTimer t;
+        std::vector<SimulatedPath::Milliseconds> sentAt;
+        for(unsigned i = 0; i < MESSAGES; i++) {
+            if(i % PER_MILLISECOND == 0)
+                path.runUntil(i / PER_MILLISECOND);
+            sentAt.push_back(path.now);
+            path.a.channel.send(
+                message.data(), message.size(), true, path.now);
+        }
+        path.run();
+        long long ns = t.elapsedNanoseconds();
+
+        const std::vector<SimulatedPath::Milliseconds>& deliveredAt
+            = path.b.deliveredAt;
+        SimulatedPath::Milliseconds total = 0, worst = 0;
+        for(size_t i = 0; i < deliveredAt.size(); i++) {
+            total += deliveredAt[i] - sentAt[i];
+            worst = std::max(worst, deliveredAt[i] - sentAt[i]);
+        }
+        SimulatedPath::Milliseconds last
+            = deliveredAt.empty() ? 0 : deliveredAt.back();
+        ReliableChannel::Statistics statistics
+            = path.a.channel.getStatistics();
+
+        std::stringstream name;
+        name << "Benchmark: reliable channel, "
+             << lossPerMille / 10.0 << "% loss";
+        std::stringstream result;
+        result << deliveredAt.size() << "/" << MESSAGES << " delivered, "
+               << (last > 0 ? deliveredAt.size() * 1000 / last : 0)
+               << " msg/s, latency " << (deliveredAt.empty()
+                    ? 0 : total / deliveredAt.size())
+               << " ms mean " << worst << " ms max, "
+               << statistics.retransmissions << " retransmissions, "
+               << ns / MESSAGES << " ns/message";
+        callback(name.str(), result.str());
+    }
+};
+
+/* A file held in memory. */
+class MemoryFileSource : public FileSource {
+    std::string content;
+public:
+    MemoryFileSource(const std::string& content) : content(content) {}
+
+    Offset size() const {
+        return content.size();
+    }
+    size_t read(Offset offset, char* data, size_t size) {
+        if(offset >= content.size())
+            return 0;
+        size = std::min<size_t>(size, content.size() - offset);
+        std::memcpy(data, content.data() + offset, size);
+        return size;
+    }
+};
+
+class MemoryFileSink : public FileSink {
+public:
+    std::string content;
+
+    MemoryFileSink(const std::string& content = "") : content(content) {}
+
+    Offset size() const {
+        return content.size();
+    }
+    bool write(Offset offset, const char* data, size_t size) {
+        if(content.size() < offset + size)
+            content.resize(static_cast<size_t>(offset + size));
+        std::memcpy(&content[static_cast<size_t>(offset)], data, size);
+        return true;
+    }
+};
+
+/* A file of any size without the disk, for measuring the engine alone. */
+class GeneratedFileSource : public FileSource {
+    Offset length;
+public:
+    GeneratedFileSource(Offset length) : length(length) {}
+
+    Offset size() const {
+        return length;
+    }
+    size_t read(Offset offset, char* data, size_t size) {
+        size = static_cast<size_t>(std::min<Offset>(size, length - offset));
+        for(size_t i = 0; i < size; i++)
+            data[i] = static_cast<char>((offset + i) * 31);
+        return size;
+    }
+};
+
+class DiscardingFileSink : public FileSink {
+public:
+    Offset size() const {
+        return 0;
+    }
+    bool write(Offset offset, const char* data, size_t size) {
+        return true;
+    }
+};
+
+/* Two file transfer engines passing their messages to each other through
+ * a queue, the way the reliable channel would, without the network.
+**/
+class FileTransferLoopback {
+public:
+    class Endpoint :
+        public FileTransfer::Link,
+        public FileTransfer::Handler {
+        FileTransferLoopback& loopback;
+        Endpoint*             peer;
+
+        friend class FileTransferLoopback;
+    public:
+        FileTransfer                 transfer;
+        /* handed to the offers by name, else the next offer gets
+         * nextSink, none refuses it
+        **/
+        std::map<std::string, boost::shared_ptr<FileSink> > sinks;
+        boost::shared_ptr<FileSink>  nextSink;
+        std::vector<FileTransfer::Id> sent;
+        std::vector<FileTransfer::Id> received;
+        std::vector<FileTransfer::Id> failed;
+
+        Endpoint(FileTransferLoopback& loopback,
+            const FileTransfer::Configuration& configuration) :
+            loopback(loopback),
+            peer(NULL),
+            transfer(*this, *this, configuration) {}
+
+        bool sendMessage(const std::string& message) {
+            return loopback.enqueue(*peer, message);
+        }
+        boost::shared_ptr<FileSink> fileOffered(FileTransfer::Id id,
+            const std::string& name, FileTransfer::Offset size) {
+            if(sinks.count(name))
+                return sinks[name];
+            return nextSink;
+        }
+        void fileReceived(FileTransfer::Id id) {
+            received.push_back(id);
+        }
+        void fileSent(FileTransfer::Id id) {
+            sent.push_back(id);
+        }
+        void fileFailed(FileTransfer::Id id, bool sending,
+            const std::string& reason) {
+            failed.push_back(id);
+        }
+    };
+
+private:
+    std::deque<std::pair<Endpoint*, std::string> > queue;
+
+public:
+    /* messages queued before the link refuses more */
+    size_t             queueLimit;
+    /* the message from a to b to damage, counting from 0, or -1 */
+    long               corruptMessage;
+    unsigned long long messagesFromA;
+    Endpoint           a;
+    Endpoint           b;
+
+    FileTransferLoopback(const FileTransfer::Configuration& configuration
+        = FileTransfer::Configuration()) :
+        queueLimit(64),
+        corruptMessage(-1),
+        messagesFromA(0),
+        a(*this, configuration),
+        b(*this, configuration) {
+        a.peer = &b;
+        b.peer = &a;
+    }
+
+    bool enqueue(Endpoint& to, const std::string& message) {
+        if(queue.size() >= queueLimit)
+            return false;
+        queue.push_back(std::make_pair(&to, message));
+        if(&to == &b && messagesFromA++ == static_cast<unsigned long long>(
+            corruptMessage))
+            queue.back().second[message.size() - 1] ^= 1;
+        return true;
+    }
+
+    void run() {
+        while(!queue.empty()) {
+            std::pair<Endpoint*, std::string> next = queue.front();
+            queue.pop_front();
+            next.first->transfer.messageReceived(PacketBufferPool::shared()
+                .copy(next.second.data(), next.second.size()));
+            a.transfer.pump();
+            b.transfer.pump();
+        }
+    }
+};
+
+struct FileTransferBenchmarks {
+    template<typename F> static void runBenchmarks(F callback) {
+        runEngineBenchmark(callback);
+        runDiskBenchmark(callback);
+    }
+
+    /* The chunking and checksums of a 2 GiB file, without the disk. */
+    template<typename F> static void runEngineBenchmark(F callback) {
+        const FileTransfer::Offset size = 2048ULL * 1024 * 1024;
+        FileTransferLoopback loopback;
+        loopback.b.nextSink.reset(new DiscardingFileSink());
+
+        BenchmarkTimer t;
+        loopback.a.transfer.sendFile("generated", boost::shared_ptr<
+            FileSource>(new GeneratedFileSource(size)));
+        loopback.run();
+        report("Benchmark: file transfer, 2 GiB generated", loopback, size,
+            t.elapsedNanoseconds(), callback);
+    }
+
+    /* A 1 GiB file copied from disk to disk, the way a ConnectionPeer
+     * receives files.
+    **/
+    template<typename F> static void runDiskBenchmark(F callback) {
+        const char* source = "FileTransferBenchmark.source";
+        const char* copy = "FileTransferBenchmark.copy";
+        const FileTransfer::Offset size = 1024ULL * 1024 * 1024;
+        {
+            std::ofstream file(source, std::ios::out | std::ios::binary);
+            std::vector<char> block(1024 * 1024);
+            GeneratedFileSource generated(size);
+            for(FileTransfer::Offset o = 0; o < size; o += block.size()) {
+                generated.read(o, &block[0], block.size());
+                file.write(&block[0], block.size());
+            }
+        }
+        std::remove(copy);
+
+        FileTransferLoopback loopback;
+        {
+            boost::shared_ptr<FileReader> reader(new FileReader(source));
+            loopback.b.nextSink.reset(new SparseFileWriter(copy));
+
+            BenchmarkTimer t;
+            loopback.a.transfer.sendFile("source", reader);
+            loopback.run();
+            loopback.b.nextSink.reset();
+            report("Benchmark: file transfer, 1 GiB disk to disk", loopback,
+                size, t.elapsedNanoseconds(), callback);
+        }
+        std::remove(source);
+        std::remove(copy);
+    }
+
+    template<typename F> static void report(const std::string& name,
+        FileTransferLoopback& loopback, FileTransfer::Offset size,
+        long long ns, F callback) {
+        FileTransfer::Statistics statistics
+            = loopback.b.transfer.getStatistics();
+        std::stringstream result;
+        result << (statistics.bytesReceived == size
+                ? "complete, " : "INCOMPLETE, ")
+               << (ns > 0 ? size * 1000 / ns : 0) << " MB/s, "
+               << statistics.chunksReceived << " chunks";
+        callback(name, result.str());
+    }
+};
+
+/* Two bitmap transfers passing their messages to each other through a
+ * queue, like FileTransferLoopback.
+**/
+class BitmapLoopback {
+public:
+    class Endpoint :
+        public BitmapTransfer::Link,
+        public BitmapTransfer::Handler {
+        BitmapLoopback& loopback;
+        Endpoint*       peer;
+
+        friend class BitmapLoopback;
+    public:
+        BitmapTransfer      transfer;
+        std::vector<Bitmap> received;
+
+        Endpoint(BitmapLoopback& loopback,
+            const BitmapTransfer::Configuration& configuration) :
+            loopback(loopback),
+            peer(NULL),
+            transfer(*this, *this, configuration) {}
+
+        bool sendMessage(const std::string& message) {
+            loopback.largestMessage = std::max(loopback.largestMessage,
+                message.size());
+            if(!loopback.losing)
+                loopback.queue.push_back(std::make_pair(peer, message));
+            return true;
+        }
+        void bitmapReceived(const Bitmap& bitmap) {
+            received.push_back(bitmap);
+        }
+    };
+
+private:
+    std::deque<std::pair<Endpoint*, std::string> > queue;
+
+public:
+    Endpoint a;
+    Endpoint b;
+    BitmapTransfer::Milliseconds now;
+    /* messages sent while set are lost */
+    bool   losing;
+    size_t largestMessage;
+
+    BitmapLoopback(const BitmapTransfer::Configuration& configuration
+        = BitmapTransfer::Configuration()) :
+        a(*this, configuration),
+        b(*this, configuration),
+        now(0),
+        losing(false),
+        largestMessage(0) {
+        a.peer = &b;
+        b.peer = &a;
+    }
+
+    void run() {
+        while(!queue.empty()) {
+            std::pair<Endpoint*, std::string> next = queue.front();
+            queue.pop_front();
+            next.first->transfer.messageReceived(PacketBufferPool::shared()
+                .copy(next.second.data(), next.second.size()), now);
+        }
+    }
+};
+
+/* Frames of a desktop with a window of text on it. */
+class SyntheticScreen {
+public:
+    enum Scenario {
+        /* a character is added to the text every frame */
+        TYPING,
+        /* the window moves a few pixels every frame */
+        DRAGGING,
+        /* the text scrolls up a few pixels every frame */
+        SCROLLING
+    };
+
+    static Bitmap frame(unsigned width, unsigned height,
+        Scenario scenario, unsigned number) {
+        Bitmap bitmap(width, height, 0xff804020);
+        fill(bitmap, 0, height - 40, width, 40, 0xff202020);
+
+        unsigned left = scenario == DRAGGING ? 100 + 6 * number : 100;
+        unsigned top = 100;
+        unsigned windowWidth = std::min(800u, width / 2);
+        unsigned windowHeight = std::min(600u, height / 2);
+        fill(bitmap, left, top, windowWidth, 30, 0xffc06030);
+        fill(bitmap, left, top + 30, windowWidth, windowHeight - 30,
+            0xffffffff);
+
+        /* lines of 8 by 16 pixel characters */
+        unsigned scroll = scenario == SCROLLING ? 4 * number : 0;
+        unsigned columns = (windowWidth - 16) / 8;
+        unsigned characters = scenario == TYPING
+            ? 20 * columns + number : 30 * columns;
+        for(unsigned y = 0; y + 16 < windowHeight - 40; y++) {
+            unsigned line = (y + scroll) / 16;
+            unsigned row = (y + scroll) % 16;
+            for(unsigned column = 0; column < columns; column++) {
+                if(line * columns + column >= characters || row >= 12)
+                    continue;
+                boost::uint64_t glyph = (line * 7919 + column * 104729)
+                    * 0x9e3779b97f4a7c15ULL;
+                for(unsigned x = 0; x < 8; x++)
+                    if(glyph >> ((row * 8 + x) % 64) & 1)
+                        bitmap.at(left + 8 + column * 8 + x,
+                            top + 38 + y) = 0xff000000;
+            }
+        }
+        return bitmap;
+    }
+
+private:
+    static void fill(Bitmap& bitmap, unsigned left, unsigned top,
+        unsigned width, unsigned height, Bitmap::Pixel pixel) {
+        for(unsigned y = top; y < std::min(top + height, bitmap.height); y++)
+            for(unsigned x = left;
+                x < std::min(left + width, bitmap.width); x++)
+                bitmap.at(x, y) = pixel;
+    }
+};
+
+struct BitmapBenchmarks {
+    template<typename F> static void runBenchmarks(F callback) {
+        runBenchmark("typing", SyntheticScreen::TYPING, callback);
+        runBenchmark("dragging a window", SyntheticScreen::DRAGGING,
+            callback);
+        runBenchmark("scrolling", SyntheticScreen::SCROLLING, callback);
+    }
+
+    /* Bytes on the wire and encoding time per frame, of 1920 by 1080
+     * frames acknowledged as soon as they are decoded.
+    **/
+    template<typename F> static void runBenchmark(const std::string& name,
+        SyntheticScreen::Scenario scenario, F callback) {
+        const unsigned frames = 60;
+        BitmapEncoder encoder;
+        BitmapDecoder decoder;
+        size_t keyFrameBytes = 0;
+        unsigned long long deltaBytes = 0;
+        long long encodeNanoseconds = 0;
+        bool intact = true;
+
+        for(unsigned i = 0; i < frames; i++) {
+            Bitmap bitmap = SyntheticScreen::frame(1920, 1080, scenario, i);
+            BenchmarkTimer t;
+            std::string message = encoder.encode(bitmap);
+            long long ns = t.elapsedNanoseconds();
+
+            Bitmap decoded;
+            FrameNumber number;
+            intact = intact && decoder.decode(message.data(), message.size(),
+                decoded, number) && decoded == bitmap;
+            encoder.acknowledged(number);
+
+            if(i == 0) {
+                keyFrameBytes = message.size();
+            } else {
+                deltaBytes += message.size();
+                encodeNanoseconds += ns;
+            }
+        }
+
+        std::stringstream result;
+        unsigned long long perFrame = deltaBytes / (frames - 1);
+        result << (intact ? "" : "DAMAGED, ")
+               << perFrame << " bytes/frame ("
+               << perFrame * 10000 / (1920 * 1080 * 4) / 100.0
+               << "% of raw), "
+               << encodeNanoseconds / (frames - 1) / 1000
+               << " us encoding/frame, first frame "
+               << keyFrameBytes << " bytes";
+        callback("Benchmark: bitmap transfer, " + name, result.str());
+    }
+};
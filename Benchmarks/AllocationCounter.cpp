@@ -0,0 +1,102 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    AllocationCounter.cpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Replacement allocation functions that count the heap
+ *              allocations. They live in a translation unit of their own,
+ *              so the compiler never inlines them into their callers and
+ *              takes the free() of a delete for a mismatch with new.
+**/
+
+/* STL includes */
+#include <cstdlib>
+#include <new>
+
+/* WebP2P includes */
+#include "AllocationCounter.hpp"
+
+#if __cplusplus < 201103L
+    #define ALLOCATION_THROWS throw(std::bad_alloc)
+    #define ALLOCATION_NOTHROW throw()
+#else
+    #define ALLOCATION_THROWS
+    #define ALLOCATION_NOTHROW noexcept
+#endif
+
+static unsigned long long allocations = 0;
+
+unsigned long long allocationCount() {
+    return allocations;
+}
+
+static void* allocate(std::size_t size) {
+    allocations++;
+    return std::malloc(size ? size : 1);
+}
+
+/* The whole set is replaced, so every form of new is counted and every
+ * form of delete frees what malloc gave. The aligned forms of C++17 are
+ * left to the library, which pairs them with each other.
+**/
+void* operator new(std::size_t size) ALLOCATION_THROWS {
+    if(void* p = allocate(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) ALLOCATION_THROWS {
+    if(void* p = allocate(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&)
+    ALLOCATION_NOTHROW {
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&)
+    ALLOCATION_NOTHROW {
+    return allocate(size);
+}
+
+void operator delete(void* p) ALLOCATION_NOTHROW {
+    std::free(p);
+}
+
+void operator delete[](void* p) ALLOCATION_NOTHROW {
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) ALLOCATION_NOTHROW {
+    std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) ALLOCATION_NOTHROW {
+    std::free(p);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void* p, std::size_t) ALLOCATION_NOTHROW {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) ALLOCATION_NOTHROW {
+    std::free(p);
+}
+#endif
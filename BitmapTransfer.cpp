@@ -0,0 +1,621 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    BitmapTransfer.cpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Implementation of the bitmap transfer.
+**/
+
+/* STL includes */
+#include <algorithm>
+#include <cstring>
+
+/* WebP2P includes */
+#include "BitmapTransfer.hpp"
+
+/* Message layout, all numbers in network byte order:
+ *
+ *   frame:            type (1)  number (4)  base (4)  width (4)  height (4)
+ *                     tile size (2)  tile count (4)  tiles
+ *   tile:             index (4)  length (4)  runs
+ *   frame part:       type (1)  number (4)  length (4)  offset (4)  bytes
+ *   acknowledgement:  type (1)  number (4)
+ *
+ * The base is the frame the tiles that are not in the message are taken
+ * from, or NO_BASE for a frame that is sent whole. Tiles are numbered row
+ * by row. The pixels of a tile, row by row as well, are stored as runs: a
+ * variable length count, shifted left by one, then a pixel that repeats
+ * count times if the lowest bit is clear, or count different pixels if it
+ * is set.
+ *
+ * A frame longer than the link takes is sent in parts instead, in order,
+ * each with the length of the whole frame and where in it the bytes go.
+**/
+enum MessageType {
+    MESSAGE_FRAME           = 1,
+    MESSAGE_ACKNOWLEDGEMENT = 2,
+    MESSAGE_FRAME_PART      = 3
+};
+
+enum {
+    FRAME_HEADER_SIZE      = 23,
+    TILE_HEADER_SIZE       = 8,
+    /* a single run of a single pixel */
+    MIN_TILE_SIZE          = 5,
+    FRAME_PART_HEADER_SIZE = 13
+};
+
+static const FrameNumber NO_BASE = 0xffffffff;
+
+/* the longest frame of that many pixels: a tile for every pixel */
+static unsigned long long maxFrameSize(size_t maxPixels) {
+    return FRAME_HEADER_SIZE + static_cast<unsigned long long>(maxPixels)
+        * (TILE_HEADER_SIZE + MIN_TILE_SIZE);
+}
+
+static void write16(std::string& s, boost::uint16_t value) {
+    s += static_cast<char>(value >> 8);
+    s += static_cast<char>(value);
+}
+
+static void write32(std::string& s, boost::uint32_t value) {
+    for(int shift = 24; shift >= 0; shift -= 8)
+        s += static_cast<char>(value >> shift);
+}
+
+static boost::uint16_t read16(const char* p) {
+    return static_cast<boost::uint16_t>(
+        (static_cast<unsigned char>(p[0]) << 8)
+        | static_cast<unsigned char>(p[1]));
+}
+
+static boost::uint32_t read32(const char* p) {
+    boost::uint32_t value = 0;
+    for(int i = 0; i < 4; i++)
+        value = (value << 8) | static_cast<unsigned char>(p[i]);
+    return value;
+}
+
+static void writeCount(std::string& s, boost::uint32_t value) {
+    while(value >= 0x80) {
+        s += static_cast<char>(0x80 | (value & 0x7f));
+        value >>= 7;
+    }
+    s += static_cast<char>(value);
+}
+
+static bool readCount(const char*& p, const char* end,
+    boost::uint32_t& value) {
+    value = 0;
+    for(int shift = 0; p != end && shift < 32; shift += 7) {
+        unsigned char c = static_cast<unsigned char>(*p++);
+        value |= static_cast<boost::uint32_t>(c & 0x7f) << shift;
+        if(!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static void writePixel(std::string& s, Bitmap::Pixel pixel) {
+    s.append(reinterpret_cast<const char*>(&pixel), sizeof(pixel));
+}
+
+/* A hash of the pixels of a tile. Eight lanes, each an FNV-1a over every
+ * eighth pixel of a row, keep the loop free of dependencies from one pixel
+ * to the next, so the compiler can turn it into vector instructions. A
+ * change of a single pixel always changes the hash.
+**/
+static boost::uint64_t tileHash(const Bitmap& bitmap,
+    unsigned left, unsigned top, unsigned width, unsigned height) {
+    enum { LANES = 8 };
+    boost::uint32_t lanes[LANES];
+    for(unsigned l = 0; l < LANES; l++)
+        lanes[l] = 2166136261u + l;
+
+    for(unsigned y = top; y < top + height; y++) {
+        const Bitmap::Pixel* row = &bitmap.pixels[y * bitmap.width + left];
+        unsigned x = 0;
+        for(; x + LANES <= width; x += LANES)
+            for(unsigned l = 0; l < LANES; l++)
+                lanes[l] = (lanes[l] ^ row[x + l]) * 16777619u;
+        for(; x < width; x++)
+            lanes[0] = (lanes[0] ^ row[x]) * 16777619u;
+    }
+
+    boost::uint64_t hash = 14695981039346656037ULL;
+    for(unsigned l = 0; l < LANES; l++)
+        hash = (hash ^ lanes[l]) * 1099511628211ULL;
+    return hash;
+}
+
+/* the tiles of a bitmap, row by row */
+struct TileGrid {
+    unsigned tileSize;
+    unsigned columns;
+    unsigned rows;
+
+    TileGrid(unsigned width, unsigned height, unsigned tileSize) :
+        tileSize(tileSize),
+        columns((width + tileSize - 1) / tileSize),
+        rows((height + tileSize - 1) / tileSize) {}
+
+    unsigned count() const {
+        return columns * rows;
+    }
+    void bounds(const Bitmap& bitmap, unsigned index, unsigned& left,
+        unsigned& top, unsigned& width, unsigned& height) const {
+        left = index % columns * tileSize;
+        top = index / columns * tileSize;
+        width = std::min(tileSize, bitmap.width - left);
+        height = std::min(tileSize, bitmap.height - top);
+    }
+};
+
+static void encodeTile(std::string& s, const Bitmap& bitmap,
+    unsigned left, unsigned top, unsigned width, unsigned height) {
+    std::vector<Bitmap::Pixel> pixels;
+    pixels.reserve(width * height);
+    for(unsigned y = top; y < top + height; y++) {
+        const Bitmap::Pixel* row = &bitmap.pixels[y * bitmap.width + left];
+        pixels.insert(pixels.end(), row, row + width);
+    }
+
+    size_t i = 0;
+    while(i < pixels.size()) {
+        size_t run = 1;
+        while(i + run < pixels.size() && pixels[i + run] == pixels[i])
+            run++;
+        if(run > 1) {
+            writeCount(s, static_cast<boost::uint32_t>(run << 1));
+            writePixel(s, pixels[i]);
+            i += run;
+            continue;
+        }
+
+        /* different pixels up to the next run */
+        size_t end = i + 1;
+        while(end < pixels.size()
+            && !(end + 1 < pixels.size() && pixels[end] == pixels[end + 1]))
+            end++;
+        writeCount(s, static_cast<boost::uint32_t>(((end - i) << 1) | 1));
+        s.append(reinterpret_cast<const char*>(&pixels[i]),
+            (end - i) * sizeof(Bitmap::Pixel));
+        i = end;
+    }
+}
+
+static bool decodeTile(const char* p, const char* end, Bitmap& bitmap,
+    unsigned left, unsigned top, unsigned width, unsigned height) {
+    size_t total = static_cast<size_t>(width) * height;
+    size_t done = 0;
+    while(p != end) {
+        boost::uint32_t count;
+        if(!readCount(p, end, count))
+            return false;
+        bool literal = count & 1;
+        count >>= 1;
+        size_t bytes = (literal ? count : 1) * sizeof(Bitmap::Pixel);
+        if(count > total - done || static_cast<size_t>(end - p) < bytes)
+            return false;
+
+        for(boost::uint32_t k = 0; k < count; k++, done++) {
+            Bitmap::Pixel pixel;
+            std::memcpy(&pixel, p + (literal ? k : 0) * sizeof(pixel),
+                sizeof(pixel));
+            bitmap.at(left + static_cast<unsigned>(done % width),
+                top + static_cast<unsigned>(done / width)) = pixel;
+        }
+        p += bytes;
+    }
+    return done == total;
+}
+
+Bitmap::Bitmap() :
+    width(0),
+    height(0) {
+}
+
+Bitmap::Bitmap(unsigned width, unsigned height, Pixel fill) :
+    width(width),
+    height(height),
+    pixels(static_cast<size_t>(width) * height, fill) {
+}
+
+Bitmap::Pixel& Bitmap::at(unsigned x, unsigned y) {
+    return pixels[static_cast<size_t>(y) * width + x];
+}
+
+const Bitmap::Pixel& Bitmap::at(unsigned x, unsigned y) const {
+    return pixels[static_cast<size_t>(y) * width + x];
+}
+
+bool Bitmap::operator==(const Bitmap& other) const {
+    return width == other.width && height == other.height
+        && pixels == other.pixels;
+}
+
+BitmapEncoder::Statistics::Statistics() :
+    framesEncoded(0),
+    keyFrames(0),
+    tilesSent(0),
+    tilesUnchanged(0),
+    bytesEncoded(0),
+    rawBytes(0) {
+}
+
+BitmapEncoder::BitmapEncoder(unsigned tileSize) :
+    tileSize(std::max(1u, std::min(tileSize, 0xffffu))),
+    nextNumber(0),
+    hasReference(false) {
+}
+
+std::string BitmapEncoder::encode(const Bitmap& bitmap) {
+    Frame frame;
+    frame.number = nextNumber++;
+    frame.width = bitmap.width;
+    frame.height = bitmap.height;
+    TileGrid grid(bitmap.width, bitmap.height, tileSize);
+    frame.hashes.resize(grid.count());
+
+    bool key = !hasReference || reference.width != bitmap.width
+        || reference.height != bitmap.height;
+    /* the decoder drops the frames before it, so deltas wait for this
+     * one to be acknowledged, see isKeyFrameInFlight()
+    **/
+    if(key) {
+        hasReference = false;
+        sent.clear();
+    }
+
+    std::string message;
+    message += static_cast<char>(MESSAGE_FRAME);
+    write32(message, frame.number);
+    write32(message, key ? NO_BASE : reference.number);
+    write32(message, bitmap.width);
+    write32(message, bitmap.height);
+    write16(message, static_cast<boost::uint16_t>(tileSize));
+    size_t countAt = message.size();
+    write32(message, 0);
+
+    boost::uint32_t count = 0;
+    for(unsigned index = 0; index < grid.count(); index++) {
+        unsigned left, top, width, height;
+        grid.bounds(bitmap, index, left, top, width, height);
+        frame.hashes[index] = tileHash(bitmap, left, top, width, height);
+        if(!key && frame.hashes[index] == reference.hashes[index]) {
+            statistics.tilesUnchanged++;
+            continue;
+        }
+
+        write32(message, index);
+        size_t lengthAt = message.size();
+        write32(message, 0);
+        encodeTile(message, bitmap, left, top, width, height);
+        std::string length;
+        write32(length, static_cast<boost::uint32_t>(
+            message.size() - lengthAt - 4));
+        message.replace(lengthAt, 4, length);
+        count++;
+    }
+    std::string tiles;
+    write32(tiles, count);
+    message.replace(countAt, 4, tiles);
+
+    statistics.framesEncoded++;
+    statistics.keyFrames += key;
+    statistics.tilesSent += count;
+    statistics.bytesEncoded += message.size();
+    statistics.rawBytes += bitmap.pixels.size() * sizeof(Bitmap::Pixel);
+    sent.push_back(frame);
+    return message;
+}
+
+void BitmapEncoder::reset() {
+    hasReference = false;
+    sent.clear();
+}
+
+void BitmapEncoder::acknowledged(FrameNumber number) {
+    for(size_t i = 0; i < sent.size(); i++) {
+        if(sent[i].number == number) {
+            reference = sent[i];
+            hasReference = true;
+            sent.erase(sent.begin(), sent.begin() + i + 1);
+            return;
+        }
+    }
+}
+
+size_t BitmapEncoder::getFramesInFlight() const {
+    return sent.size();
+}
+
+bool BitmapEncoder::isKeyFrameInFlight() const {
+    return !hasReference && !sent.empty();
+}
+
+BitmapEncoder::Statistics BitmapEncoder::getStatistics() const {
+    return statistics;
+}
+
+BitmapDecoder::BitmapDecoder(size_t maxPixels) :
+    maxPixels(maxPixels) {
+}
+
+bool BitmapDecoder::decode(const char* data, size_t size,
+    Bitmap& bitmap, FrameNumber& number) {
+    if(size < FRAME_HEADER_SIZE || data[0] != MESSAGE_FRAME)
+        return false;
+    FrameNumber frame = read32(data + 1);
+    FrameNumber base = read32(data + 5);
+    unsigned width = read32(data + 9);
+    unsigned height = read32(data + 13);
+    unsigned tileSize = read16(data + 17);
+    boost::uint32_t count = read32(data + 19);
+    if(!tileSize || static_cast<unsigned long long>(width) * height
+        > maxPixels)
+        return false;
+
+    /* Checked before anything is allocated: a frame sent whole has every
+     * tile, and no frame has more tiles than its bytes can hold.
+    **/
+    TileGrid grid(width, height, tileSize);
+    if(base == NO_BASE ? count != grid.count() : count > grid.count())
+        return false;
+    if(count > (size - FRAME_HEADER_SIZE)
+        / (TILE_HEADER_SIZE + MIN_TILE_SIZE))
+        return false;
+
+    Bitmap result;
+    if(base == NO_BASE) {
+        result = Bitmap(width, height);
+    } else {
+        std::map<FrameNumber, Bitmap>::iterator i = frames.find(base);
+        if(i == frames.end() || i->second.width != width
+            || i->second.height != height)
+            return false;
+        result = i->second;
+    }
+
+    const char* p = data + FRAME_HEADER_SIZE;
+    const char* end = data + size;
+    unsigned next = 0;
+    for(boost::uint32_t t = 0; t < count; t++) {
+        if(end - p < TILE_HEADER_SIZE)
+            return false;
+        unsigned index = read32(p);
+        size_t length = read32(p + 4);
+        p += TILE_HEADER_SIZE;
+        /* in order and each once, so a whole frame leaves no tile out */
+        if(index < next || index >= grid.count()
+            || static_cast<size_t>(end - p) < length)
+            return false;
+        next = index + 1;
+
+        unsigned left, top, tileWidth, tileHeight;
+        grid.bounds(result, index, left, top, tileWidth, tileHeight);
+        if(!decodeTile(p, p + length, result, left, top, tileWidth,
+            tileHeight))
+            return false;
+        p += length;
+    }
+
+    /* the encoder makes no more deltas from frames before the base */
+    frames.erase(frames.begin(),
+        base == NO_BASE ? frames.end() : frames.lower_bound(base));
+    frames[frame] = result;
+    bitmap.width = result.width;
+    bitmap.height = result.height;
+    bitmap.pixels.swap(result.pixels);
+    number = frame;
+    return true;
+}
+
+size_t BitmapDecoder::getFramesKept() const {
+    return frames.size();
+}
+
+BitmapTransfer::Configuration::Configuration() :
+    tileSize(64),
+    maxFramesInFlight(2),
+    maxPixels(BitmapDecoder::DEFAULT_MAX_PIXELS),
+    maxMessageSize(4 * 1024 * 1024),
+    acknowledgementTimeout(3000) {
+}
+
+BitmapTransfer::Statistics::Statistics() :
+    framesSent(0),
+    framesReceived(0),
+    framesReplaced(0),
+    framesDiscarded(0),
+    timeouts(0) {
+}
+
+BitmapTransfer::BitmapTransfer(
+    Link& link,
+    Handler& handler,
+    const Configuration& configuration) :
+    link(link),
+    handler(handler),
+    configuration(configuration),
+    encoder(configuration.tileSize),
+    decoder(configuration.maxPixels),
+    hasPending(false),
+    lastProgress(0),
+    assembling(false),
+    assemblyNumber(0),
+    assemblyLength(0),
+    hasPendingAcknowledgement(false),
+    pendingAcknowledgement(0) {
+    /* room for the header of a part and some of the frame */
+    this->configuration.maxMessageSize = std::max<size_t>(
+        configuration.maxMessageSize, FRAME_PART_HEADER_SIZE + 1);
+}
+
+bool BitmapTransfer::sendBitmap(const Bitmap& bitmap, Milliseconds now) {
+    if(bitmap.pixels.size() > configuration.maxPixels)
+        return false;
+    if(hasPending)
+        statistics.framesReplaced++;
+    pending = bitmap;
+    hasPending = true;
+    pump(now);
+    return true;
+}
+
+void BitmapTransfer::pump(Milliseconds now) {
+    if(hasPendingAcknowledgement) {
+        std::string message;
+        message += static_cast<char>(MESSAGE_ACKNOWLEDGEMENT);
+        write32(message, pendingAcknowledgement);
+        if(link.sendMessage(message))
+            hasPendingAcknowledgement = false;
+    }
+
+    /* A frame the peer could not decode is never acknowledged, and
+     * neither are the deltas from it. A key frame starts over.
+    **/
+    if(outgoing.empty() && encoder.getFramesInFlight() > 0
+        && now >= lastProgress + configuration.acknowledgementTimeout) {
+        encoder.reset();
+        statistics.timeouts++;
+    }
+
+    /* encoded once, the parts the link refuses are sent again as they are */
+    if(outgoing.empty() && hasPending && !encoder.isKeyFrameInFlight()
+        && encoder.getFramesInFlight() < configuration.maxFramesInFlight) {
+        queueFrame(encoder.encode(pending));
+        hasPending = false;
+        pending = Bitmap();
+    }
+
+    while(!outgoing.empty()) {
+        if(!link.sendMessage(outgoing.front()))
+            return;
+        outgoing.pop_front();
+        if(outgoing.empty()) {
+            statistics.framesSent++;
+            lastProgress = now;
+        }
+    }
+}
+
+void BitmapTransfer::queueFrame(const std::string& message) {
+    if(message.size() <= configuration.maxMessageSize) {
+        outgoing.push_back(message);
+        return;
+    }
+
+    size_t partSize = configuration.maxMessageSize - FRAME_PART_HEADER_SIZE;
+    for(size_t offset = 0; offset < message.size(); offset += partSize) {
+        std::string part;
+        part += static_cast<char>(MESSAGE_FRAME_PART);
+        part.append(message, 1, 4);
+        write32(part, static_cast<boost::uint32_t>(message.size()));
+        write32(part, static_cast<boost::uint32_t>(offset));
+        part.append(message, offset, partSize);
+        outgoing.push_back(part);
+    }
+}
+
+void BitmapTransfer::messageReceived(const PacketSlice& message,
+    Milliseconds now) {
+    if(message.empty())
+        return;
+    switch(message.data()[0]) {
+    case MESSAGE_FRAME:
+        frameReceived(message.data(), message.size(), now);
+        break;
+    case MESSAGE_FRAME_PART:
+        partReceived(message, now);
+        break;
+    case MESSAGE_ACKNOWLEDGEMENT:
+        if(message.size() >= 5) {
+            encoder.acknowledged(read32(message.data() + 1));
+            lastProgress = now;
+            pump(now);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void BitmapTransfer::partReceived(const PacketSlice& message,
+    Milliseconds now) {
+    if(message.size() <= FRAME_PART_HEADER_SIZE)
+        return;
+    FrameNumber number = read32(message.data() + 1);
+    size_t length = read32(message.data() + 5);
+    size_t offset = read32(message.data() + 9);
+    size_t size = message.size() - FRAME_PART_HEADER_SIZE;
+
+    if(offset == 0) {
+        if(assembling)
+            statistics.framesDiscarded++;
+        assembling = length <= maxFrameSize(configuration.maxPixels);
+        assemblyNumber = number;
+        assemblyLength = length;
+        std::string().swap(assembly);
+        if(!assembling) {
+            statistics.framesDiscarded++;
+            return;
+        }
+    }
+
+    /* The parts come in order, so one that does not fit where the frame
+     * ends now is of a frame that is lost already. Memory is taken as the
+     * bytes arrive, not for the length a first part claims.
+    **/
+    if(!assembling || number != assemblyNumber || length != assemblyLength
+        || offset != assembly.size() || size > length - offset) {
+        if(assembling)
+            statistics.framesDiscarded++;
+        assembling = false;
+        std::string().swap(assembly);
+        return;
+    }
+    assembly.append(message.data() + FRAME_PART_HEADER_SIZE, size);
+    if(assembly.size() < assemblyLength)
+        return;
+
+    std::string frame;
+    frame.swap(assembly);
+    assembling = false;
+    frameReceived(frame.data(), frame.size(), now);
+}
+
+void BitmapTransfer::frameReceived(const char* data, size_t size,
+    Milliseconds now) {
+    Bitmap bitmap;
+    FrameNumber number;
+    if(!decoder.decode(data, size, bitmap, number)) {
+        statistics.framesDiscarded++;
+        return;
+    }
+    statistics.framesReceived++;
+    hasPendingAcknowledgement = true;
+    pendingAcknowledgement = number;
+    pump(now);
+    handler.bitmapReceived(bitmap);
+}
+
+BitmapTransfer::Statistics BitmapTransfer::getStatistics() const {
+    Statistics result = statistics;
+    result.encoder = encoder.getStatistics();
+    return result;
+}
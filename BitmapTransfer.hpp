@@ -0,0 +1,229 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    BitmapTransfer.hpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Definition of the bitmap transfer. Bitmaps are cut into
+ *              tiles, and only the tiles that differ from the last bitmap
+ *              the peer acknowledged are sent, run length encoded. Meant
+ *              for screen-like pictures sent over and over, of which most
+ *              stays the same from one to the next.
+**/
+
+#pragma once
+
+/* STL includes */
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+/* Boost includes */
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+/* WebP2P includes */
+#include "PacketBuffer.hpp"
+
+/* A picture of 32 bit pixels, row by row, in the byte order of the
+ * ImageData of a canvas.
+**/
+struct Bitmap {
+    typedef boost::uint32_t Pixel;
+
+    unsigned           width;
+    unsigned           height;
+    std::vector<Pixel> pixels;
+
+    Bitmap();
+    Bitmap(unsigned width, unsigned height, Pixel fill = 0);
+
+    Pixel& at(unsigned x, unsigned y);
+    const Pixel& at(unsigned x, unsigned y) const;
+    bool operator==(const Bitmap& other) const;
+};
+
+typedef boost::uint32_t FrameNumber;
+
+class BitmapEncoder : boost::noncopyable {
+public:
+    struct Statistics {
+        unsigned long long framesEncoded;
+        /* frames sent whole, the first and the ones that changed size */
+        unsigned long long keyFrames;
+        unsigned long long tilesSent;
+        unsigned long long tilesUnchanged;
+        /* of the messages, and of the pixels of the frames */
+        unsigned long long bytesEncoded;
+        unsigned long long rawBytes;
+
+        Statistics();
+    };
+
+private:
+    /* a frame the way the decoder has it, by the hashes of its tiles */
+    struct Frame {
+        FrameNumber                  number;
+        unsigned                     width;
+        unsigned                     height;
+        std::vector<boost::uint64_t> hashes;
+    };
+
+    unsigned          tileSize;
+    Statistics        statistics;
+    FrameNumber       nextNumber;
+    bool              hasReference;
+    Frame             reference;
+    /* sent after the reference and not acknowledged yet, oldest first */
+    std::deque<Frame> sent;
+
+public:
+    BitmapEncoder(unsigned tileSize = 64);
+
+    /* The message for the bitmap, a delta from the last acknowledged one.
+     * The frame counts as sent from now on.
+    **/
+    std::string encode(const Bitmap& bitmap);
+    /* gives up on the frames in flight, the next one is sent whole */
+    void reset();
+    /* the decoder has the frame, deltas are made from it from now on */
+    void acknowledged(FrameNumber number);
+
+    size_t getFramesInFlight() const;
+    /* Frames after a key frame can only be deltas from it, so they wait
+     * for it to be acknowledged rather than be sent whole as well.
+    **/
+    bool isKeyFrameInFlight() const;
+    Statistics getStatistics() const;
+};
+
+class BitmapDecoder : boost::noncopyable {
+    size_t                        maxPixels;
+    /* the decoded frames a delta may still refer to */
+    std::map<FrameNumber, Bitmap> frames;
+
+public:
+    /* a 4K screen, frames of more pixels are refused */
+    enum { DEFAULT_MAX_PIXELS = 3840 * 2160 };
+
+    BitmapDecoder(size_t maxPixels = DEFAULT_MAX_PIXELS);
+
+    /* false if the message is damaged or refers to a frame that is not
+     * here, the bitmap is left alone then
+    **/
+    bool decode(const char* data, size_t size,
+        Bitmap& bitmap, FrameNumber& number);
+
+    size_t getFramesKept() const;
+};
+
+/* Sends bitmaps to a peer and receives them from it. The newest bitmap
+ * replaces one that waits for the frames in flight to be acknowledged,
+ * so a slow peer gets fewer frames rather than older ones. Like the
+ * reliable channel, it reads no clock itself.
+**/
+class BitmapTransfer : boost::noncopyable {
+public:
+    typedef unsigned long long Milliseconds;
+
+    class Link {
+    public:
+        virtual ~Link() {}
+        /* false if the message was not taken, pump() tries again later */
+        virtual bool sendMessage(const std::string& message) = 0;
+    };
+
+    class Handler {
+    public:
+        virtual ~Handler() {}
+        virtual void bitmapReceived(const Bitmap& bitmap) = 0;
+    };
+
+    struct Configuration {
+        unsigned tileSize;
+        /* frames sent and not acknowledged yet */
+        unsigned maxFramesInFlight;
+        /* largest bitmap sent or received */
+        size_t   maxPixels;
+        /* the largest message the link takes, longer frames go in parts */
+        size_t   maxMessageSize;
+        /* frames in flight this long without an acknowledgement are given
+         * up on, and a key frame follows
+        **/
+        Milliseconds acknowledgementTimeout;
+
+        Configuration();
+    };
+
+    struct Statistics {
+        unsigned long long framesSent;
+        unsigned long long framesReceived;
+        /* bitmaps a newer one replaced before they were sent */
+        unsigned long long framesReplaced;
+        /* frames that could not be decoded */
+        unsigned long long framesDiscarded;
+        /* times the frames in flight were given up on */
+        unsigned long long timeouts;
+        BitmapEncoder::Statistics encoder;
+
+        Statistics();
+    };
+
+private:
+    Link&          link;
+    Handler&       handler;
+    Configuration  configuration;
+    Statistics     statistics;
+    BitmapEncoder  encoder;
+    BitmapDecoder  decoder;
+    bool           hasPending;
+    Bitmap         pending;
+    /* the parts of the frame being sent that the link has not taken */
+    std::deque<std::string> outgoing;
+    /* when a frame was last sent or acknowledged */
+    Milliseconds   lastProgress;
+    /* the frame arriving in parts */
+    bool           assembling;
+    FrameNumber    assemblyNumber;
+    size_t         assemblyLength;
+    std::string    assembly;
+    /* the acknowledgement the link refused, a later one covers it */
+    bool           hasPendingAcknowledgement;
+    FrameNumber    pendingAcknowledgement;
+
+public:
+    BitmapTransfer(
+        Link& link,
+        Handler& handler,
+        const Configuration& configuration = Configuration());
+
+    /* false if the bitmap has more than maxPixels */
+    bool sendBitmap(const Bitmap& bitmap, Milliseconds now);
+    void messageReceived(const PacketSlice& message, Milliseconds now);
+
+    /* Sends what waits, and gives up on frames past their timeout. Call
+     * it when the link takes messages again after refusing one.
+    **/
+    void pump(Milliseconds now);
+
+    Statistics getStatistics() const;
+
+private:
+    void queueFrame(const std::string& message);
+    void partReceived(const PacketSlice& message, Milliseconds now);
+    void frameReceived(const char* data, size_t size, Milliseconds now);
+};
@@ -0,0 +1,236 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    CongestionController.cpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Implementation of the congestion controllers of the reliable
+ *              channel.
+**/
+
+/* STL includes */
+#include <algorithm>
+#include <limits>
+
+/* WebP2P includes */
+#include "CongestionController.hpp"
+
+/* the RTT of an acknowledgement without a sample, ReliableChannel::NEVER */
+static const CongestionController::Milliseconds NO_SAMPLE
+    = static_cast<CongestionController::Milliseconds>(-1);
+
+CongestionController::State::State() :
+    name(""),
+    congestionWindow(0),
+    slowStartThreshold(0),
+    minimumRTT(0),
+    latestRTT(0),
+    targetDelay(0),
+    queueingDelay(0),
+    congestionEvents(0),
+    timeouts(0) {
+}
+
+boost::shared_ptr<CongestionController> CongestionController::create(
+    Mode mode, size_t maxPacketSize) {
+    switch(mode) {
+    case LEDBAT:
+        return boost::shared_ptr<CongestionController>(
+            new LedbatController(maxPacketSize));
+    case LOSS_BASED:
+    default:
+        return boost::shared_ptr<CongestionController>(
+            new LossBasedController(maxPacketSize));
+    }
+}
+
+/* initial window of RFC 6928 */
+enum { LOSS_BASED_INITIAL_WINDOW = 10 };
+
+LossBasedController::LossBasedController(size_t maxPacketSize) :
+    maxPacketSize(maxPacketSize),
+    congestionWindow(LOSS_BASED_INITIAL_WINDOW * maxPacketSize),
+    slowStartThreshold(std::numeric_limits<size_t>::max()),
+    minimumRTT(NO_SAMPLE),
+    latestRTT(0),
+    congestionEvents(0),
+    timeouts(0) {
+}
+
+void LossBasedController::acknowledged(
+    size_t bytes, size_t bytesInFlight, Milliseconds rtt, Milliseconds now) {
+    if(rtt != NO_SAMPLE) {
+        latestRTT = rtt;
+        minimumRTT = std::min(minimumRTT, rtt);
+
+        /* Leave slow start once the RTT grows, the queue is filling up and
+         * there is no need to wait for it to overflow. This is the delay
+         * increase test of HyStart.
+        **/
+        Milliseconds threshold
+            = std::max<Milliseconds>(4, std::min<Milliseconds>(16,
+                minimumRTT / 8));
+        if(congestionWindow < slowStartThreshold
+            && rtt >= minimumRTT + threshold)
+            slowStartThreshold = congestionWindow;
+    }
+
+    /* a window that is not used does not say anything about the path */
+    if(2 * bytesInFlight < congestionWindow)
+        return;
+
+    if(congestionWindow < slowStartThreshold)
+        congestionWindow += std::min(bytes, 2 * maxPacketSize);
+    else
+        congestionWindow += std::max<size_t>(1,
+            maxPacketSize * bytes / congestionWindow);
+}
+
+void LossBasedController::congestionEvent() {
+    congestionEvents++;
+    slowStartThreshold = std::max(congestionWindow / 2, 2 * maxPacketSize);
+    congestionWindow = slowStartThreshold;
+}
+
+void LossBasedController::timeout() {
+    timeouts++;
+    slowStartThreshold = std::max(congestionWindow / 2, 2 * maxPacketSize);
+    congestionWindow = maxPacketSize;
+}
+
+size_t LossBasedController::getCongestionWindow() const {
+    return congestionWindow;
+}
+
+CongestionController::State LossBasedController::getState() const {
+    State state;
+    state.name = "loss based";
+    state.congestionWindow = congestionWindow;
+    state.slowStartThreshold = slowStartThreshold;
+    state.minimumRTT = minimumRTT == NO_SAMPLE ? 0 : minimumRTT;
+    state.latestRTT = latestRTT;
+    state.congestionEvents = congestionEvents;
+    state.timeouts = timeouts;
+    return state;
+}
+
+/* constants of RFC 6817, the windows in packets */
+enum {
+    LEDBAT_INITIAL_WINDOW   = 2,
+    LEDBAT_MINIMUM_WINDOW   = 2,
+    LEDBAT_ALLOWED_INCREASE = 1,
+    LEDBAT_BASE_HISTORY     = 10,
+    LEDBAT_CURRENT_FILTER   = 4,
+    LEDBAT_MINUTE           = 60000
+};
+
+LedbatController::LedbatController(
+    size_t maxPacketSize, Milliseconds targetDelay) :
+    maxPacketSize(maxPacketSize),
+    targetDelay(targetDelay),
+    congestionWindow(LEDBAT_INITIAL_WINDOW * maxPacketSize),
+    slowStart(true),
+    minuteStart(0),
+    latestRTT(0),
+    congestionEvents(0),
+    timeouts(0) {
+}
+
+LedbatController::Milliseconds LedbatController::baseDelay() const {
+    return baseHistory.empty() ? 0
+        : *std::min_element(baseHistory.begin(), baseHistory.end());
+}
+
+LedbatController::Milliseconds LedbatController::currentDelay() const {
+    return currentHistory.empty() ? 0
+        : *std::min_element(currentHistory.begin(), currentHistory.end());
+}
+
+void LedbatController::acknowledged(
+    size_t bytes, size_t bytesInFlight, Milliseconds rtt, Milliseconds now) {
+    /* RFC 6817 measures the one way delay with timestamps in the packets.
+     * The RTT is used instead, which counts a queue on the way back as well
+     * and so errs on the side of yielding.
+    **/
+    if(rtt != NO_SAMPLE) {
+        latestRTT = rtt;
+        if(baseHistory.empty() || now - minuteStart >= LEDBAT_MINUTE) {
+            baseHistory.push_back(rtt);
+            if(baseHistory.size() > LEDBAT_BASE_HISTORY)
+                baseHistory.pop_front();
+            minuteStart = now;
+        } else {
+            baseHistory.back() = std::min(baseHistory.back(), rtt);
+        }
+        currentHistory.push_back(rtt);
+        if(currentHistory.size() > LEDBAT_CURRENT_FILTER)
+            currentHistory.pop_front();
+    }
+
+    Milliseconds queueingDelay = currentDelay() - baseDelay();
+    size_t maximum = bytesInFlight + LEDBAT_ALLOWED_INCREASE * maxPacketSize;
+
+    /* Growing by at most a packet per RTT takes minutes to fill a fast
+     * path, so the window grows as in slow start until the queue gets
+     * close to the target, like LEDBAT++ does.
+    **/
+    if(slowStart && 4 * queueingDelay >= 3 * targetDelay)
+        slowStart = false;
+    if(slowStart) {
+        if(2 * bytesInFlight >= congestionWindow)
+            congestionWindow += bytes;
+        return;
+    }
+
+    double offTarget
+        = (static_cast<double>(targetDelay) - queueingDelay) / targetDelay;
+    double window = congestionWindow + offTarget * bytes * maxPacketSize
+        / congestionWindow;
+    window = std::min(window, static_cast<double>(maximum));
+    window = std::max(window,
+        static_cast<double>(LEDBAT_MINIMUM_WINDOW * maxPacketSize));
+    congestionWindow = static_cast<size_t>(window);
+}
+
+void LedbatController::congestionEvent() {
+    congestionEvents++;
+    slowStart = false;
+    congestionWindow = std::max(congestionWindow / 2,
+        static_cast<size_t>(LEDBAT_MINIMUM_WINDOW) * maxPacketSize);
+}
+
+void LedbatController::timeout() {
+    timeouts++;
+    slowStart = false;
+    congestionWindow = maxPacketSize;
+}
+
+size_t LedbatController::getCongestionWindow() const {
+    return congestionWindow;
+}
+
+CongestionController::State LedbatController::getState() const {
+    State state;
+    state.name = "LEDBAT";
+    state.congestionWindow = congestionWindow;
+    state.minimumRTT = baseDelay();
+    state.latestRTT = latestRTT;
+    state.targetDelay = targetDelay;
+    state.queueingDelay = currentDelay() - baseDelay();
+    state.congestionEvents = congestionEvents;
+    state.timeouts = timeouts;
+    return state;
+}
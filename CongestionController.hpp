@@ -0,0 +1,136 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    CongestionController.hpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Definition of the congestion controllers of the reliable
+ *              channel. A controller decides how many bytes may be in flight
+ *              from the acknowledgements, round trip times and losses the
+ *              channel reports to it.
+**/
+
+#pragma once
+
+/* STL includes */
+#include <cstddef>
+#include <deque>
+
+/* Boost includes */
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+class CongestionController : boost::noncopyable {
+public:
+    typedef unsigned long long Milliseconds;
+
+    enum Mode {
+        /* Reno with an RTT based exit from slow start, for interactive
+         * traffic that competes fairly with TCP
+        **/
+        LOSS_BASED,
+        /* LEDBAT, RFC 6817: backs off as soon as it causes queueing, for
+         * bulk transfers that should not get in the way of anything else
+        **/
+        LEDBAT
+    };
+
+    /* what the controller is doing, for inspection */
+    struct State {
+        const char*        name;
+        size_t             congestionWindow;
+        /* LOSS_BASED only, slow start ends here */
+        size_t             slowStartThreshold;
+        Milliseconds       minimumRTT;
+        Milliseconds       latestRTT;
+        /* LEDBAT only, the delay it tries to keep the queue at */
+        Milliseconds       targetDelay;
+        Milliseconds       queueingDelay;
+        unsigned long long congestionEvents;
+        unsigned long long timeouts;
+
+        State();
+    };
+
+    virtual ~CongestionController() {}
+
+    /* Bytes that were newly acknowledged, with the bytes that were in
+     * flight before. The RTT is ReliableChannel::NEVER if the
+     * acknowledgement gave no sample.
+    **/
+    virtual void acknowledged(size_t bytes, size_t bytesInFlight,
+        Milliseconds rtt, Milliseconds now) = 0;
+    /* once for every loss episode, not for every packet lost */
+    virtual void congestionEvent() = 0;
+    virtual void timeout() = 0;
+
+    virtual size_t getCongestionWindow() const = 0;
+    virtual State getState() const = 0;
+
+    static boost::shared_ptr<CongestionController> create(
+        Mode mode, size_t maxPacketSize);
+};
+
+class LossBasedController : public CongestionController {
+    size_t       maxPacketSize;
+    size_t       congestionWindow;
+    size_t       slowStartThreshold;
+    Milliseconds minimumRTT;
+    Milliseconds latestRTT;
+    unsigned long long congestionEvents;
+    unsigned long long timeouts;
+
+public:
+    LossBasedController(size_t maxPacketSize);
+
+    void acknowledged(size_t bytes, size_t bytesInFlight,
+        Milliseconds rtt, Milliseconds now);
+    void congestionEvent();
+    void timeout();
+
+    size_t getCongestionWindow() const;
+    State getState() const;
+};
+
+class LedbatController : public CongestionController {
+    size_t       maxPacketSize;
+    Milliseconds targetDelay;
+    size_t       congestionWindow;
+    /* until the first loss or the queue nears the target */
+    bool         slowStart;
+    /* minimum RTT of each minute, the oldest first, and the latest RTTs */
+    std::deque<Milliseconds> baseHistory;
+    std::deque<Milliseconds> currentHistory;
+    Milliseconds minuteStart;
+    Milliseconds latestRTT;
+    unsigned long long congestionEvents;
+    unsigned long long timeouts;
+
+    Milliseconds baseDelay() const;
+    Milliseconds currentDelay() const;
+
+public:
+    /* RFC 6817 allows a target of at most 100 ms, LEDBAT++ uses 60 */
+    LedbatController(size_t maxPacketSize, Milliseconds targetDelay = 60);
+
+    void acknowledged(size_t bytes, size_t bytesInFlight,
+        Milliseconds rtt, Milliseconds now);
+    void congestionEvent();
+    void timeout();
+
+    size_t getCongestionWindow() const;
+    State getState() const;
+};
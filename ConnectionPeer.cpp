@@ -21,6 +21,13 @@
  *              ConnectionPeer object.
 **/
 
+/* STL includes */
+#include <cstdlib>
+#include <cstring>
+
+/* System includes */
+#include <sys/stat.h>
+
 /* Boost includes */
 #include <boost/make_shared.hpp>
 
@@ -29,20 +36,121 @@
 
 /* WebP2P includes */
 #include "ConnectionPeer.hpp"
+#include "FileDialog.hpp"
+
+/* Each kind of message has a channel of its own, so a lost packet of a
+ * file does not hold up the text and the bitmaps, and neither does the
+ * backlog of a file: text goes first, then bitmaps, files get the rest.
+**/
+enum Channel {
+    CHANNEL_TEXT            = 0,
+    CHANNEL_TEXT_UNRELIABLE = 1,
+    CHANNEL_FILE            = 2,
+    CHANNEL_BITMAP          = 3
+};
+
+/* the downloads of the user rather than a directory others write to */
+static std::string defaultDownloadDirectory() {
+#ifdef WIN32
+    const char* home = std::getenv("USERPROFILE");
+#else
+    const char* home = std::getenv("HOME");
+#endif
+    if(!home || !*home)
+        return ".";
+    std::string downloads = std::string(home) + "/Downloads";
+    struct stat s;
+    if(stat(downloads.c_str(), &s) == 0 && (s.st_mode & S_IFDIR))
+        return downloads;
+    return home;
+}
+
+/* the last component of a name the peer chose, so it stays in the
+ * download directory
+**/
+static std::string safeFileName(const std::string& name) {
+    std::string::size_type slash = name.find_last_of("/\\");
+    std::string base = slash == std::string::npos
+        ? name : name.substr(slash + 1);
+    if(base.empty() || base == "." || base == "..")
+        return "download";
+    return base;
+}
+
+/* the pixels of bitmaps cross over to the page as base64 */
+static const char base64Digits[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static std::string encodeBase64(const unsigned char* bytes, size_t size) {
+    std::string result;
+    result.reserve((size + 2) / 3 * 4);
+    for(size_t i = 0; i < size; i += 3) {
+        unsigned long group = static_cast<unsigned long>(bytes[i]) << 16;
+        if(i + 1 < size)
+            group |= static_cast<unsigned long>(bytes[i + 1]) << 8;
+        if(i + 2 < size)
+            group |= bytes[i + 2];
+        result += base64Digits[group >> 18 & 0x3f];
+        result += base64Digits[group >> 12 & 0x3f];
+        result += i + 1 < size ? base64Digits[group >> 6 & 0x3f] : '=';
+        result += i + 2 < size ? base64Digits[group & 0x3f] : '=';
+    }
+    return result;
+}
+
+/* exactly size bytes from text of (size + 2) / 3 * 4 digits */
+static bool decodeBase64(const std::string& text, unsigned char* bytes,
+    size_t size) {
+    signed char values[256];
+    std::memset(values, -1, sizeof(values));
+    for(int i = 0; i < 64; i++)
+        values[static_cast<unsigned char>(base64Digits[i])]
+            = static_cast<signed char>(i);
+
+    for(size_t i = 0, o = 0; o < size; i += 4) {
+        unsigned long group = 0;
+        for(size_t k = 0; k < 4; k++) {
+            char digit = text[i + k];
+            signed char value = values[static_cast<unsigned char>(digit)];
+            /* padding only where there are no bytes left */
+            if(value < 0 && !(digit == '=' && o + k > size))
+                return false;
+            group = group << 6 | (value < 0 ? 0 : value);
+        }
+        for(int shift = 16; shift >= 0 && o < size; shift -= 8)
+            bytes[o++] = static_cast<unsigned char>(group >> shift);
+    }
+    return true;
+}
 
 ConnectionPeer::ConnectionPeer(const std::string& serverConfiguration) :
+    fileTransfer(*this, *this),
+    downloadDirectory(defaultDownloadDirectory()),
+    bitmapLink(*this),
+    bitmapTransfer(bitmapLink, *this),
     iceClient(serverConfiguration) {
     this->serverConfiguration = std::string(serverConfiguration);
     
     registerMethod("sendText",
     	FB::make_method(this, &ConnectionPeer::sendText));
     registerEvent("ontext");
+    registerProperty("bufferedAmount",
+    	FB::make_property(this, &ConnectionPeer::getBufferedAmount));
+    registerProperty("bufferedAmountLowThreshold",
+    	FB::make_property(this,
+    	    &ConnectionPeer::getBufferedAmountLowThreshold,
+    	    &ConnectionPeer::setBufferedAmountLowThreshold));
+    registerEvent("onbufferedamountlow");
     registerMethod("sendBitmap",
     	FB::make_method(this, &ConnectionPeer::sendBitmap));
     registerEvent("onbitmap");
     registerMethod("sendFile",
     	FB::make_method(this, &ConnectionPeer::sendFile));
     registerEvent("onfile");
+    registerProperty("downloadDirectory",
+    	FB::make_property(this, &ConnectionPeer::getDownloadDirectory));
+    registerMethod("chooseDownloadDirectory",
+    	FB::make_method(this, &ConnectionPeer::chooseDownloadDirectory));
     registerMethod("addStream",
 		FB::make_method(this, &ConnectionPeer::addStream));
     registerMethod("removeStream",
@@ -65,23 +173,98 @@ ConnectionPeer::ConnectionPeer(const std::string& serverConfiguration) :
     registerEvent("onerror");
     registerEvent("ondisconnect");
 
+    iceClient.setChannelDelivery(
+        CHANNEL_TEXT_UNRELIABLE, ReliableChannel::UNRELIABLE);
+    iceClient.setChannelPriority(CHANNEL_TEXT, SendScheduler::PRIORITY_HIGH);
+    iceClient.setChannelPriority(CHANNEL_BITMAP,
+        SendScheduler::PRIORITY_NORMAL);
+    iceClient.setChannelPriority(CHANNEL_FILE,
+        SendScheduler::PRIORITY_BACKGROUND);
     iceClient.setCallbacks(this);
 }
 ConnectionPeer::~ConnectionPeer() {
+    /* iceClient is destroyed before the other members, see the header */
 }
 
 // if second arg is true, then use unreliable low-latency transport (UDP-like),
 // otherwise guarantee delivery (TCP-like)
-void ConnectionPeer::sendText(
+bool ConnectionPeer::sendText(
 	const std::string& text,
 	const /*optional*/ bool unimportant) {
-    iceClient.sendMessage(text);
+    return iceClient.sendMessage(
+        unimportant ? CHANNEL_TEXT_UNRELIABLE : CHANNEL_TEXT, text);
+}
+unsigned long ConnectionPeer::getBufferedAmount() {
+    return static_cast<unsigned long>(iceClient.getBufferedAmount());
+}
+unsigned long ConnectionPeer::getBufferedAmountLowThreshold() {
+    return static_cast<unsigned long>(
+        iceClient.getBufferedAmountLowThreshold());
+}
+void ConnectionPeer::setBufferedAmountLowThreshold(unsigned long bytes) {
+    iceClient.setBufferedAmountLowThreshold(bytes);
 }
 void ConnectionPeer::sendBitmap(
-	const FB::JSAPIPtr& /*HTMLImageElement*/ image) {
+    unsigned width, unsigned height, const std::string& data) {
+    /* checked before anything the size of the bitmap is allocated */
+    size_t maxPixels = BitmapDecoder::DEFAULT_MAX_PIXELS;
+    if(width && height > maxPixels / width) {
+        FireEvent("onerror", FB::variant_list_of(
+            std::string("the bitmap is too large")));
+        return;
+    }
+    size_t pixels = static_cast<size_t>(width) * height;
+    if(data.size() != (pixels * sizeof(Bitmap::Pixel) + 2) / 3 * 4) {
+        FireEvent("onerror", FB::variant_list_of(
+            std::string("the bitmap is not ImageData")));
+        return;
+    }
+
+    /* the bytes of a pixel stay in the order ImageData has them */
+    Bitmap bitmap(width, height);
+    if(!decodeBase64(data, reinterpret_cast<unsigned char*>(
+        bitmap.pixels.empty() ? NULL : &bitmap.pixels[0]),
+        pixels * sizeof(Bitmap::Pixel))) {
+        FireEvent("onerror", FB::variant_list_of(
+            std::string("the bitmap is not ImageData")));
+        return;
+    }
+
+    boost::mutex::scoped_lock lock(bitmapMutex);
+    if(!bitmapTransfer.sendBitmap(bitmap, ICEClient::currentTime())) {
+        FireEvent("onerror", FB::variant_list_of(
+            std::string("the bitmap is too large")));
+    }
+}
+bool ConnectionPeer::sendFile() {
+    /* the user names the file, a page could name any */
+    std::string path;
+    if(!FileDialog::chooseFile(path))
+        return false;
+    boost::shared_ptr<FileReader> reader(new FileReader(path));
+    if(!reader->isOpen()) {
+        FireEvent("onerror", FB::variant_list_of(
+            std::string("the file could not be read: ") + path));
+        return true;
+    }
+
+    boost::mutex::scoped_lock lock(fileMutex);
+    FileTransfer::Id id = fileTransfer.sendFile(safeFileName(path), reader);
+    filesSending[id] = path;
+    return true;
 }
-void ConnectionPeer::sendFile(
-	const FB::JSAPIPtr& /*File*/ file) {
+std::string ConnectionPeer::getDownloadDirectory() {
+    boost::mutex::scoped_lock lock(fileMutex);
+    return downloadDirectory;
+}
+bool ConnectionPeer::chooseDownloadDirectory() {
+    /* without the mutex, the dialog waits for the user */
+    std::string directory;
+    if(!FileDialog::chooseDirectory(directory))
+        return false;
+    boost::mutex::scoped_lock lock(fileMutex);
+    downloadDirectory = directory;
+    return true;
 }
 void ConnectionPeer::addStream(
 	const FB::JSAPIPtr& /*Stream*/ stream) {
@@ -104,10 +287,102 @@ void ConnectionPeer::setLocalCandidates(
     	"", FB::variant_list_of(localConfiguration));
 }
 void ConnectionPeer::negotiationComplete() {
+    /* files and bitmaps sent before the connection was up */
+    {
+        boost::mutex::scoped_lock lock(fileMutex);
+        fileTransfer.pump();
+    }
+    {
+        boost::mutex::scoped_lock lock(bitmapMutex);
+        bitmapTransfer.pump(ICEClient::currentTime());
+    }
     FireEvent("onconnect", FB::variant_list_of(true));
 }
-void ConnectionPeer::dataReceived(const std::string& text) {
-    FireEvent("ontext", FB::variant_list_of(text));
+void ConnectionPeer::dataReceived(
+    ReliableChannel::ChannelId channel, const PacketSlice& message) {
+    switch(channel) {
+    case CHANNEL_TEXT:
+    case CHANNEL_TEXT_UNRELIABLE:
+        FireEvent("ontext", FB::variant_list_of(message.toString()));
+        break;
+    case CHANNEL_FILE: {
+        boost::mutex::scoped_lock lock(fileMutex);
+        fileTransfer.messageReceived(message);
+        /* acknowledgements open the pipelines */
+        fileTransfer.pump();
+        break;
+    }
+    case CHANNEL_BITMAP: {
+        boost::mutex::scoped_lock lock(bitmapMutex);
+        bitmapTransfer.messageReceived(message,
+            ICEClient::currentTime());
+        break;
+    }
+    default:
+        break;
+    }
+}
+void ConnectionPeer::bufferedAmountLow() {
+    {
+        boost::mutex::scoped_lock lock(fileMutex);
+        fileTransfer.pump();
+    }
+    {
+        boost::mutex::scoped_lock lock(bitmapMutex);
+        bitmapTransfer.pump(ICEClient::currentTime());
+    }
+    FireEvent("onbufferedamountlow", FB::variant_list_of(true));
+}
+
+/* FileTransfer::Link and Handler, called with fileMutex held */
+bool ConnectionPeer::sendMessage(const std::string& message) {
+    return iceClient.sendMessage(CHANNEL_FILE, message);
+}
+boost::shared_ptr<FileSink> ConnectionPeer::fileOffered(
+    FileTransfer::Id id, const std::string& name, FileTransfer::Offset size) {
+    std::string path = downloadDirectory + "/" + safeFileName(name);
+    boost::shared_ptr<SparseFileWriter> writer(new SparseFileWriter(path));
+    if(!writer->isOpen()) {
+        FireEvent("onerror", FB::variant_list_of(
+            std::string("the file could not be written: ") + path));
+        return boost::shared_ptr<FileSink>();
+    }
+    filesReceiving[id] = path;
+    writers[id] = writer;
+    return writer;
+}
+void ConnectionPeer::fileReceived(FileTransfer::Id id) {
+    /* another name when the one asked for was taken */
+    FireEvent("onfile", FB::variant_list_of(writers[id]->getPath()));
+    filesReceiving.erase(id);
+    writers.erase(id);
+}
+void ConnectionPeer::fileSent(FileTransfer::Id id) {
+    filesSending.erase(id);
+}
+/* BitmapTransfer::Link and Handler, called with bitmapMutex held */
+bool ConnectionPeer::BitmapLink::sendMessage(const std::string& message) {
+    return peer.iceClient.sendMessage(CHANNEL_BITMAP, message);
+}
+void ConnectionPeer::bitmapReceived(const Bitmap& bitmap) {
+    std::string data = encodeBase64(
+        reinterpret_cast<const unsigned char*>(
+            bitmap.pixels.empty() ? NULL : &bitmap.pixels[0]),
+        bitmap.pixels.size() * sizeof(Bitmap::Pixel));
+    FireEvent("onbitmap",
+        FB::variant_list_of(bitmap.width)(bitmap.height)(data));
+}
+void ConnectionPeer::fileFailed(
+    FileTransfer::Id id, bool sending, const std::string& reason) {
+    std::map<FileTransfer::Id, std::string>& files
+        = sending ? filesSending : filesReceiving;
+    FireEvent("onerror", FB::variant_list_of(files[id] + ": " + reason));
+    files.erase(id);
+    if(!sending)
+        writers.erase(id);
+}
+void ConnectionPeer::closed() {
+    FireEvent("ondisconnect", FB::variant_list_of(true));
 }
 
 void ConnectionPeer::getLocalConfiguration(
@@ -128,5 +403,6 @@ void ConnectionPeer::addRemoteConfiguration(
 }
 // disconnects and stops listening
 void ConnectionPeer::close(){
-    FireEvent("ondisconnect", FB::variant_list_of(true));
+    /* ondisconnect fires once the transport is gone */
+    iceClient.close();
 }
\ No newline at end of file
@@ -23,18 +23,51 @@
 
 #pragma once
 
+/* STL includes */
+#include <map>
+
+/* Boost includes */
+#include <boost/thread/mutex.hpp>
+
 /* firebreath headers */
 #include "JSAPIAuto.h"
 #include "JSObject.h"
 
 /* web_p2p headers */
+#include "BitmapTransfer.hpp"
+#include "FileTransfer.hpp"
 #include "ICEClient.hpp"
 
 class ConnectionPeer : 
 	public FB::JSAPIAuto,
-	public ICEClient::Callbacks {
+	public ICEClient::Callbacks,
+	public FileTransfer::Link,
+	public FileTransfer::Handler,
+	public BitmapTransfer::Handler {
 private:
-    ICEClient iceClient;
+    /* files in both directions, guarded by the mutex as the ICE thread
+     * drives them as well
+    **/
+    boost::mutex fileMutex;
+    FileTransfer fileTransfer;
+    std::string downloadDirectory;
+    std::map<FileTransfer::Id, std::string> filesReceiving;
+    /* which tell where the files ended up */
+    std::map<FileTransfer::Id, boost::shared_ptr<SparseFileWriter> > writers;
+    std::map<FileTransfer::Id, std::string> filesSending;
+
+    /* sends the messages of the bitmap transfer on their channel */
+    class BitmapLink : public BitmapTransfer::Link {
+        ConnectionPeer& peer;
+    public:
+        BitmapLink(ConnectionPeer& peer) : peer(peer) {}
+        bool sendMessage(const std::string& message);
+    };
+
+    /* bitmaps in both directions, the same way */
+    boost::mutex bitmapMutex;
+    BitmapLink bitmapLink;
+    BitmapTransfer bitmapTransfer;
     
     /* configuration properties */
     std::string serverConfiguration;
@@ -46,19 +79,60 @@ private:
     /* HTML5 Stream objects */
     //std::vector<FB:JSAPIPtr> localStreams;
     //std::vector<FB:JSAPIPtr> remoteStreams;
+
+    /* Last, so it goes first: its destructor waits for the reactor thread
+     * to stop calling back, while everything the callbacks use is still
+     * there.
+    **/
+    ICEClient iceClient;
 public:
     ConnectionPeer(const std::string& server_configuration);
     ~ConnectionPeer();
     
     virtual void setLocalCandidates(const std::string& localConfiguration);
     virtual void negotiationComplete();
-    virtual void dataReceived(const std::string& text);
+    virtual void dataReceived(ReliableChannel::ChannelId channel,
+        const PacketSlice& data);
+    virtual void bufferedAmountLow();
+    virtual void closed();
+
+    virtual bool sendMessage(const std::string& message);
+    virtual boost::shared_ptr<FileSink> fileOffered(FileTransfer::Id id,
+        const std::string& name, FileTransfer::Offset size);
+    virtual void fileReceived(FileTransfer::Id id);
+    virtual void fileSent(FileTransfer::Id id);
+    virtual void fileFailed(FileTransfer::Id id, bool sending,
+        const std::string& reason);
+    virtual void bitmapReceived(const Bitmap& bitmap);
     
     // if second arg is true, then use unreliable low-latency transport 
-    // (UDP-like), otherwise guarantee delivery (TCP-like)
-    void sendText(const std::string& text, const /*optional*/ bool unimportant);
-    void sendBitmap(const FB::JSAPIPtr& /*HTMLImageElement*/ image);
-    void sendFile(const FB::JSAPIPtr& /*File*/ file);
+    // (UDP-like), otherwise guarantee delivery (TCP-like). Returns false
+    // if the text was not accepted, for instance because too much is
+    // buffered already.
+    bool sendText(const std::string& text, const /*optional*/ bool unimportant);
+    // bytes of text accepted by sendText and not sent yet; 
+    // onbufferedamountlow fires when it drops to the threshold again
+    unsigned long getBufferedAmount();
+    unsigned long getBufferedAmountLowThreshold();
+    void setBufferedAmountLowThreshold(unsigned long bytes);
+    // takes the width, the height and the data of the ImageData of a
+    // canvas, the data as base64 so it crosses over as one string rather
+    // than a value per byte; only the tiles that changed since the last
+    // bitmap the other side received are sent, and onbitmap fires there
+    // with the width, the height and the data the same way. A bitmap sent
+    // while earlier ones are still on their way replaces the one waiting.
+    void sendBitmap(unsigned width, unsigned height,
+        const std::string& /*base64*/ data);
+    // asks the user which file to send with a dialog of the plugin, and
+    // streams it in the background; onfile fires on the other side with
+    // the path it was written to once all of it is there, what an earlier
+    // attempt left of the same file is kept. Pages never name the paths
+    // the plugin reads or writes. Returns false if the user cancelled.
+    bool sendFile();
+    // where received files go, read-only for the page; the user picks
+    // another one with the dialog chooseDownloadDirectory shows
+    std::string getDownloadDirectory();
+    bool chooseDownloadDirectory();
     
     void addStream(const FB::JSAPIPtr& /*Stream*/ stream);
     void removeStream(const FB::JSAPIPtr& /*Stream*/ stream);
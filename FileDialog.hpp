@@ -0,0 +1,35 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    FileDialog.hpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Definition of the file dialogs the plugin shows itself, the
+ *              only source of the paths it reads and writes. Implemented
+ *              once per platform, in Win/, Mac/ and X11/.
+**/
+
+#pragma once
+
+/* STL includes */
+#include <string>
+
+namespace FileDialog {
+    /* A file to send. False when the user cancels. */
+    bool chooseFile(std::string& path);
+    /* A directory to save received files in. False when the user cancels. */
+    bool chooseDirectory(std::string& path);
+}
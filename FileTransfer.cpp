@@ -0,0 +1,810 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    FileTransfer.cpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Implementation of the file transfer engine.
+**/
+
+/* STL includes */
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <sstream>
+
+/* System includes */
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef WIN32
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+/* Boost includes */
+#include <boost/crc.hpp>
+
+/* WebP2P includes */
+#include "FileTransfer.hpp"
+
+/* Message layout, all numbers in network byte order:
+ *
+ *   offer:            type (1)  id (4)  size (8)  version (8)  name
+ *   resume:           type (1)  id (4)  offset (8)
+ *   chunk:            type (1)  id (4)  offset (8)  CRC-32 (4)  data
+ *   acknowledgement:  type (1)  id (4)  offset (8)
+ *   abort sending:    type (1)  id (4)  offset (8)
+ *   abort receiving:  type (1)  id (4)  offset (8)
+ *   resend:           type (1)  id (4)  offset (8)
+ *
+ * The sender numbers the files it sends, the receiver answers with the same
+ * id. The version tells the receiver whether what it has of a file by the
+ * name is of the same content. Resume, acknowledgement and resend come from the receiver: the first
+ * tells where to start, after what it already has, the second up to where
+ * everything was written, the last which corrupt chunk to send again.
+**/
+enum MessageType {
+    MESSAGE_OFFER           = 1,
+    MESSAGE_RESUME          = 2,
+    MESSAGE_CHUNK           = 3,
+    MESSAGE_ACKNOWLEDGEMENT = 4,
+    MESSAGE_ABORT_SENDING   = 5,
+    MESSAGE_ABORT_RECEIVING = 6,
+    MESSAGE_RESEND          = 7
+};
+
+enum {
+    CONTROL_SIZE      = 13,
+    OFFER_HEADER_SIZE = 21,
+    CHUNK_HEADER_SIZE = 17
+};
+
+static void write32(char* p, boost::uint32_t value) {
+    for(int i = 3; i >= 0; i--, value >>= 8)
+        p[i] = static_cast<char>(value);
+}
+
+static void write64(char* p, boost::uint64_t value) {
+    for(int i = 7; i >= 0; i--, value >>= 8)
+        p[i] = static_cast<char>(value);
+}
+
+static boost::uint32_t read32(const char* p) {
+    boost::uint32_t value = 0;
+    for(int i = 0; i < 4; i++)
+        value = (value << 8) | static_cast<unsigned char>(p[i]);
+    return value;
+}
+
+static boost::uint64_t read64(const char* p) {
+    boost::uint64_t value = 0;
+    for(int i = 0; i < 8; i++)
+        value = (value << 8) | static_cast<unsigned char>(p[i]);
+    return value;
+}
+
+static boost::uint32_t checksum(const char* data, size_t size) {
+    boost::crc_32_type crc;
+    crc.process_bytes(data, size);
+    return crc.checksum();
+}
+
+/* Creates a file that is not there yet, for the owner alone. A link put in
+ * its place in a shared directory makes it fail rather than be followed.
+**/
+static bool createExclusive(const std::string& path) {
+#ifdef WIN32
+    int fd = _open(path.c_str(), _O_CREAT | _O_EXCL | _O_RDWR | _O_BINARY,
+        _S_IREAD | _S_IWRITE);
+    if(fd < 0)
+        return false;
+    _close(fd);
+#else
+    int fd = ::open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if(fd < 0)
+        return false;
+    ::close(fd);
+#endif
+    return true;
+}
+
+/* a file an earlier writer left: a plain file of this user, not a link */
+static bool isOwnFile(const std::string& path) {
+#ifdef WIN32
+    struct _stat s;
+    return _stat(path.c_str(), &s) == 0 && (s.st_mode & _S_IFREG);
+#else
+    struct stat s;
+    return lstat(path.c_str(), &s) == 0 && S_ISREG(s.st_mode)
+        && s.st_uid == getuid() && s.st_nlink == 1;
+#endif
+}
+
+static bool exists(const std::string& path) {
+#ifdef WIN32
+    struct _stat s;
+    return _stat(path.c_str(), &s) == 0;
+#else
+    struct stat s;
+    return lstat(path.c_str(), &s) == 0;
+#endif
+}
+
+/* Gives a file another name, failing rather than replacing one there. */
+static bool renameExclusive(const std::string& from, const std::string& to) {
+#ifdef WIN32
+    /* which never replaces on Windows */
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#else
+    if(::link(from.c_str(), to.c_str()) == 0) {
+        ::unlink(from.c_str());
+        return true;
+    }
+    if(errno != EPERM && errno != ENOTSUP && errno != EOPNOTSUPP)
+        return false;
+
+    /* No hard links on FAT and most network shares. Taking the name with
+     * an empty file first makes the rename replace nothing but that.
+    **/
+    if(!createExclusive(to))
+        return false;
+    if(std::rename(from.c_str(), to.c_str()) != 0) {
+        std::remove(to.c_str());
+        return false;
+    }
+    return true;
+#endif
+}
+
+/* "name (n).ext", in the directory of path */
+static std::string numbered(const std::string& path, unsigned n) {
+    std::string::size_type slash = path.find_last_of("/\\");
+    std::string::size_type dot = path.find_last_of('.');
+    if(dot == std::string::npos || dot == 0
+        || (slash != std::string::npos && dot <= slash + 1))
+        dot = path.size();
+    std::stringstream ss;
+    ss << path.substr(0, dot) << " (" << n << ")" << path.substr(dot);
+    return ss.str();
+}
+
+FileReader::FileReader(const std::string& path, size_t blockSize) :
+    file(path.c_str(), std::ios::in | std::ios::binary),
+    length(0),
+    blockOffset(0),
+    blockSize(blockSize),
+    modified(0) {
+    if(file.is_open()) {
+        file.seekg(0, std::ios::end);
+        length = static_cast<Offset>(file.tellg());
+        file.seekg(0, std::ios::beg);
+    }
+    struct stat s;
+    if(stat(path.c_str(), &s) == 0)
+        modified = static_cast<Version>(s.st_mtime);
+}
+
+bool FileReader::isOpen() const {
+    return file.is_open();
+}
+
+FileReader::Offset FileReader::size() const {
+    return length;
+}
+
+FileReader::Version FileReader::version() const {
+    return modified;
+}
+
+size_t FileReader::read(Offset offset, char* data, size_t size) {
+    size_t done = 0;
+    while(done < size && offset < length) {
+        /* one large read for many chunks */
+        if(offset < blockOffset || offset >= blockOffset + block.size()) {
+            block.resize(static_cast<size_t>(std::min<Offset>(
+                blockSize, length - offset)));
+            file.clear();
+            file.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+            file.read(&block[0], static_cast<std::streamsize>(block.size()));
+            block.resize(static_cast<size_t>(file.gcount()));
+            blockOffset = offset;
+            if(block.empty())
+                break;
+        }
+        size_t start = static_cast<size_t>(offset - blockOffset);
+        size_t n = std::min(size - done, block.size() - start);
+        std::memcpy(data + done, &block[start], n);
+        done += n;
+        offset += n;
+    }
+    return done;
+}
+
+FileWriter::FileWriter(const std::string& path) :
+    length(0),
+    position(0) {
+    /* an existing file is kept, the transfer resumes after it */
+    file.open(path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    if(!file.is_open()) {
+        file.clear();
+        file.open(path.c_str(),
+            std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+    }
+    if(file.is_open()) {
+        file.seekp(0, std::ios::end);
+        length = position = static_cast<Offset>(file.tellp());
+    }
+}
+
+bool FileWriter::isOpen() const {
+    return file.is_open();
+}
+
+FileWriter::Offset FileWriter::size() const {
+    return length;
+}
+
+bool FileWriter::write(Offset offset, const char* data, size_t size) {
+    if(offset != position)
+        file.seekp(static_cast<std::streamoff>(offset), std::ios::beg);
+    file.write(data, static_cast<std::streamsize>(size));
+    position = offset + size;
+    length = std::max(length, position);
+    return file.good();
+}
+
+SparseFileWriter::SparseFileWriter(const std::string& path, size_t blockSize) :
+    path(path),
+    blockSize(blockSize),
+    length(0),
+    fileVersion(0),
+    blocksDone(0),
+    allocated(false),
+    finished(false) {
+    std::string part = path + ".part";
+    if(isOwnFile(part)) {
+        file.open(part.c_str(),
+            std::ios::in | std::ios::out | std::ios::binary);
+        if(file.is_open())
+            loadMap();
+    } else if(createExclusive(part)) {
+        file.open(part.c_str(),
+            std::ios::in | std::ios::out | std::ios::binary);
+    }
+}
+
+SparseFileWriter::~SparseFileWriter() {
+    if(file.is_open() && !finished && allocated)
+        saveMap();
+}
+
+/* map: block size (4)  version (8)  length (8)  bitmap, a bit per block,
+ * first block in the high bit of the first byte
+**/
+void SparseFileWriter::loadMap() {
+    std::string mapPath = path + ".part.map";
+    if(!isOwnFile(mapPath))
+        return;
+    std::ifstream map(mapPath.c_str(), std::ios::in | std::ios::binary);
+    char header[20];
+    if(!map.read(header, sizeof(header)) || read32(header) != blockSize)
+        return;
+    Version mapVersion = read64(header + 4);
+    Offset mapLength = read64(header + 12);
+    Offset count = (mapLength + blockSize - 1) / blockSize;
+    if(count > blocks.max_size())
+        return;
+
+    /* a damaged map is ignored, the transfer starts over */
+    try {
+        std::vector<char> bits(static_cast<size_t>((count + 7) / 8));
+        if(!bits.empty() && !map.read(&bits[0], bits.size()))
+            return;
+        blocks.assign(static_cast<size_t>(count), false);
+        for(size_t i = 0; i < blocks.size(); i++) {
+            if(bits[i / 8] & (0x80 >> (i % 8))) {
+                blocks[i] = true;
+                blocksDone++;
+            }
+        }
+    } catch(const std::bad_alloc&) {
+        blocks.clear();
+        blocksDone = 0;
+        return;
+    }
+    fileVersion = mapVersion;
+    length = mapLength;
+}
+
+void SparseFileWriter::saveMap() const {
+    std::string mapPath = path + ".part.map";
+    std::remove(mapPath.c_str());
+    if(!createExclusive(mapPath))
+        return;
+    std::ofstream map(mapPath.c_str(),
+        std::ios::out | std::ios::trunc | std::ios::binary);
+    char header[20];
+    write32(header, static_cast<boost::uint32_t>(blockSize));
+    write64(header + 4, fileVersion);
+    write64(header + 12, length);
+    std::vector<char> bits((blocks.size() + 7) / 8, '\0');
+    for(size_t i = 0; i < blocks.size(); i++)
+        if(blocks[i])
+            bits[i / 8] |= static_cast<char>(0x80 >> (i % 8));
+    map.write(header, sizeof(header));
+    if(!bits.empty())
+        map.write(&bits[0], bits.size());
+}
+
+bool SparseFileWriter::isOpen() const {
+    return file.is_open();
+}
+
+bool SparseFileWriter::isComplete() const {
+    return allocated && blocksDone == blocks.size();
+}
+
+const std::string& SparseFileWriter::getPath() const {
+    return finalPath;
+}
+
+SparseFileWriter::Offset SparseFileWriter::blockEnd(size_t block) const {
+    return std::min<Offset>(static_cast<Offset>(block + 1) * blockSize,
+        length);
+}
+
+SparseFileWriter::Offset SparseFileWriter::size() const {
+    size_t block = 0;
+    while(block < blocks.size() && blocks[block])
+        block++;
+    return block ? blockEnd(block - 1) : 0;
+}
+
+bool SparseFileWriter::allocate(Offset size, Version version) {
+    if(!file.is_open())
+        return false;
+    /* a map of another file, or of another version of it, is of no use */
+    if(size != length || version != fileVersion || version == 0) {
+        Offset count = (size + blockSize - 1) / blockSize;
+        if(count > blocks.max_size())
+            return false;
+        try {
+            blocks.assign(static_cast<size_t>(count), false);
+        } catch(const std::bad_alloc&) {
+            return false;
+        }
+        fileVersion = version;
+        length = size;
+        blocksDone = 0;
+    }
+    partialBlocks.clear();
+    allocated = true;
+
+    /* Setting the last byte makes the file its full size. The file system
+     * keeps the rest sparse until it is written, and a full disk shows up
+     * now rather than halfway. A file of that size already may hold the
+     * last block.
+    **/
+    file.seekp(0, std::ios::end);
+    if(static_cast<Offset>(file.tellp()) < size) {
+        file.seekp(static_cast<std::streamoff>(size - 1), std::ios::beg);
+        file.put('\0');
+        file.flush();
+    }
+    return file.good();
+}
+
+bool SparseFileWriter::write(Offset offset, const char* data, size_t size) {
+    if(!allocated || offset + size > length)
+        return false;
+    file.seekp(static_cast<std::streamoff>(offset), std::ios::beg);
+    file.write(data, static_cast<std::streamsize>(size));
+    if(!file.good())
+        return false;
+
+    /* count the bytes of each block the write touches */
+    Offset end = offset + size;
+    for(size_t block = static_cast<size_t>(offset / blockSize);
+        offset < end; block++) {
+        Offset next = std::min(blockEnd(block), end);
+        if(!blocks[block]) {
+            size_t& written = partialBlocks[block];
+            written += static_cast<size_t>(next - offset);
+            if(written == blockEnd(block) - block * static_cast<Offset>(
+                blockSize)) {
+                partialBlocks.erase(block);
+                blocks[block] = true;
+                blocksDone++;
+            }
+        }
+        offset = next;
+    }
+    return true;
+}
+
+bool SparseFileWriter::finish() {
+    if(!isComplete())
+        return false;
+    file.close();
+    std::string part = path + ".part";
+    std::string mapPath = path + ".part.map";
+    std::remove(mapPath.c_str());
+
+    /* a file of the same name is kept, this one takes the next free name */
+    for(unsigned n = 0; n < 1000 && !finished; n++) {
+        std::string candidate = n ? numbered(path, n) : path;
+        if(renameExclusive(part, candidate)) {
+            finalPath = candidate;
+            finished = true;
+        } else if(!exists(candidate)) {
+            break;
+        }
+    }
+    return finished;
+}
+
+FileTransfer::Configuration::Configuration() :
+    chunkSize(64 * 1024),
+    pipeline(32),
+    maxFileSize(1ULL << 40) {
+}
+
+FileTransfer::Statistics::Statistics() :
+    filesSent(0),
+    filesReceived(0),
+    chunksSent(0),
+    chunksReceived(0),
+    bytesSent(0),
+    bytesReceived(0),
+    corruptChunks(0),
+    chunksOutOfOrder(0),
+    bytesResumed(0) {
+}
+
+FileTransfer::Outgoing::Outgoing() :
+    size(0),
+    offered(false),
+    started(false),
+    next(0),
+    acknowledged(0) {
+}
+
+FileTransfer::FileTransfer(
+    Link& link,
+    Handler& handler,
+    const Configuration& configuration) :
+    link(link),
+    handler(handler),
+    configuration(configuration),
+    nextId(0) {
+}
+
+FileTransfer::Id FileTransfer::sendFile(
+    const std::string& name,
+    const boost::shared_ptr<FileSource>& source) {
+    Id id = nextId++;
+    Outgoing& o = outgoing[id];
+    o.name = name;
+    o.source = source;
+    o.size = source->size();
+    pump(id, o);
+    return id;
+}
+
+size_t FileTransfer::getActiveCount() const {
+    return outgoing.size() + incoming.size();
+}
+
+FileTransfer::Statistics FileTransfer::getStatistics() const {
+    return statistics;
+}
+
+void FileTransfer::pump() {
+    while(!pendingControl.empty()) {
+        if(!link.sendMessage(pendingControl.front()))
+            return;
+        pendingControl.erase(pendingControl.begin());
+    }
+
+    /* pump(id, o) may finish the transfer, so step ahead first */
+    std::map<Id, Outgoing>::iterator i = outgoing.begin();
+    while(i != outgoing.end()) {
+        std::map<Id, Outgoing>::iterator current = i++;
+        if(!pump(current->first, current->second))
+            return;
+    }
+}
+
+bool FileTransfer::pump(Id id, Outgoing& o) {
+    if(!o.offered) {
+        std::string offer(CONTROL_SIZE, '\0');
+        offer[0] = MESSAGE_OFFER;
+        write32(&offer[1], id);
+        write64(&offer[5], o.size);
+        offer.resize(OFFER_HEADER_SIZE);
+        write64(&offer[CONTROL_SIZE], o.source->version());
+        offer += o.name;
+        if(!link.sendMessage(offer))
+            return false;
+        o.offered = true;
+    }
+    if(!o.started)
+        return true;
+
+    /* repairs first, the receiver cannot acknowledge past them */
+    while(!o.resend.empty()) {
+        SendResult result = sendChunk(id, o, *o.resend.begin());
+        if(result == FAILED)
+            return true;
+        if(result == REFUSED)
+            return false;
+        o.resend.erase(o.resend.begin());
+    }
+
+    Offset window = static_cast<Offset>(configuration.pipeline)
+        * configuration.chunkSize;
+    while(o.next < o.size && o.next - o.acknowledged < window) {
+        SendResult result = sendChunk(id, o, o.next);
+        if(result == FAILED)
+            return true;
+        if(result == REFUSED)
+            return false;
+        o.next += std::min<Offset>(configuration.chunkSize, o.size - o.next);
+    }
+    return true;
+}
+
+FileTransfer::SendResult FileTransfer::sendChunk(
+    Id id, Outgoing& o, Offset offset) {
+    size_t size = static_cast<size_t>(std::min<Offset>(
+        configuration.chunkSize, o.size - offset));
+
+    /* read straight into the message */
+    std::string message(CHUNK_HEADER_SIZE + size, '\0');
+    if(o.source->read(offset, &message[CHUNK_HEADER_SIZE], size) != size) {
+        sendingFailed(id, "the file could not be read", true);
+        return FAILED;
+    }
+    message[0] = MESSAGE_CHUNK;
+    write32(&message[1], id);
+    write64(&message[5], offset);
+    write32(&message[13], checksum(&message[CHUNK_HEADER_SIZE], size));
+
+    if(!link.sendMessage(message))
+        return REFUSED;
+    statistics.chunksSent++;
+    statistics.bytesSent += size;
+    return SENT;
+}
+
+void FileTransfer::messageReceived(const PacketSlice& message) {
+    if(message.size() < CONTROL_SIZE)
+        return;
+    const char* data = message.data();
+    Id id = read32(data + 1);
+    Offset offset = read64(data + 5);
+
+    switch(data[0]) {
+    case MESSAGE_OFFER:
+        offerReceived(data, message.size());
+        break;
+    case MESSAGE_RESUME:
+        resumeReceived(id, offset);
+        break;
+    case MESSAGE_CHUNK:
+        chunkReceived(data, message.size());
+        break;
+    case MESSAGE_ACKNOWLEDGEMENT:
+        acknowledgementReceived(id, offset);
+        break;
+    case MESSAGE_ABORT_SENDING:
+        receivingFailed(id, "the sender gave up", false);
+        break;
+    case MESSAGE_ABORT_RECEIVING:
+        sendingFailed(id, "the receiver gave up", false);
+        break;
+    case MESSAGE_RESEND:
+        resendReceived(id, offset);
+        break;
+    default:
+        break;
+    }
+}
+
+void FileTransfer::offerReceived(const char* data, size_t size) {
+    if(size < OFFER_HEADER_SIZE)
+        return;
+    Id id = read32(data + 1);
+    Offset length = read64(data + 5);
+    FileSink::Version version = read64(data + CONTROL_SIZE);
+    std::string name(data + OFFER_HEADER_SIZE, size - OFFER_HEADER_SIZE);
+    if(incoming.count(id))
+        return;
+    /* refused before anyone is asked, the size is the peer's word */
+    if(length > configuration.maxFileSize) {
+        sendControl(MESSAGE_ABORT_RECEIVING, id, 0);
+        return;
+    }
+
+    boost::shared_ptr<FileSink> sink = handler.fileOffered(id, name, length);
+    if(!sink) {
+        sendControl(MESSAGE_ABORT_RECEIVING, id, 0);
+        return;
+    }
+    /* the sink may size its bookkeeping by the file, and fail doing so */
+    bool allocated;
+    try {
+        allocated = sink->allocate(length, version);
+    } catch(const std::bad_alloc&) {
+        allocated = false;
+    }
+    if(!allocated) {
+        sendControl(MESSAGE_ABORT_RECEIVING, id, 0);
+        handler.fileFailed(id, false, "the file could not be allocated");
+        return;
+    }
+
+    Incoming& i = incoming[id];
+    i.sink = sink;
+    i.size = length;
+    i.expected = std::min(sink->size(), length);
+    statistics.bytesResumed += i.expected;
+
+    if(i.expected == i.size) {
+        if(!sink->finish()) {
+            receivingFailed(id, "the file could not be completed", true);
+            return;
+        }
+        sendControl(MESSAGE_ACKNOWLEDGEMENT, id, i.size);
+        incoming.erase(id);
+        statistics.filesReceived++;
+        handler.fileReceived(id);
+        return;
+    }
+    sendControl(MESSAGE_RESUME, id, i.expected);
+}
+
+void FileTransfer::resumeReceived(Id id, Offset offset) {
+    std::map<Id, Outgoing>::iterator i = outgoing.find(id);
+    if(i == outgoing.end())
+        return;
+    Outgoing& o = i->second;
+    if(offset > o.size) {
+        sendingFailed(id, "the receiver has more than the file", true);
+        return;
+    }
+    /* everything after it is sent again */
+    o.started = true;
+    o.next = offset;
+    o.acknowledged = offset;
+    o.resend.clear();
+    pump(id, o);
+}
+
+void FileTransfer::resendReceived(Id id, Offset offset) {
+    std::map<Id, Outgoing>::iterator i = outgoing.find(id);
+    if(i == outgoing.end())
+        return;
+    Outgoing& o = i->second;
+    if(offset < o.acknowledged || offset >= o.next)
+        return;
+    o.resend.insert(offset);
+    pump(id, o);
+}
+
+void FileTransfer::acknowledgementReceived(Id id, Offset offset) {
+    std::map<Id, Outgoing>::iterator i = outgoing.find(id);
+    if(i == outgoing.end())
+        return;
+    Outgoing& o = i->second;
+    o.acknowledged = std::max(o.acknowledged, std::min(offset, o.next));
+    if(offset >= o.size) {
+        outgoing.erase(i);
+        statistics.filesSent++;
+        handler.fileSent(id);
+        return;
+    }
+    pump(id, o);
+}
+
+void FileTransfer::chunkReceived(const char* data, size_t size) {
+    if(size < CHUNK_HEADER_SIZE)
+        return;
+    Id id = read32(data + 1);
+    Offset offset = read64(data + 5);
+    boost::uint32_t crc = read32(data + 13);
+    const char* payload = data + CHUNK_HEADER_SIZE;
+    size_t length = size - CHUNK_HEADER_SIZE;
+
+    std::map<Id, Incoming>::iterator i = incoming.find(id);
+    if(i == incoming.end())
+        return;
+    Incoming& in = i->second;
+
+    /* written already */
+    if(offset < in.expected || in.ahead.count(offset))
+        return;
+    if(offset > in.size || length > in.size - offset) {
+        receivingFailed(id, "the sender sent more than the file", true);
+        return;
+    }
+    /* only this chunk is sent again, the ones behind it are kept */
+    if(checksum(payload, length) != crc) {
+        statistics.corruptChunks++;
+        sendControl(MESSAGE_RESEND, id, offset);
+        return;
+    }
+    if(!in.sink->write(offset, payload, length)) {
+        receivingFailed(id, "the file could not be written", true);
+        return;
+    }
+    statistics.chunksReceived++;
+    statistics.bytesReceived += length;
+
+    if(offset != in.expected) {
+        in.ahead[offset] = offset + length;
+        statistics.chunksOutOfOrder++;
+        return;
+    }
+    in.expected += length;
+    std::map<Offset, Offset>::iterator next;
+    while((next = in.ahead.find(in.expected)) != in.ahead.end()) {
+        in.expected = next->second;
+        in.ahead.erase(next);
+    }
+    sendControl(MESSAGE_ACKNOWLEDGEMENT, id, in.expected);
+
+    if(in.expected == in.size) {
+        if(!in.sink->finish()) {
+            receivingFailed(id, "the file could not be completed", true);
+            return;
+        }
+        incoming.erase(i);
+        statistics.filesReceived++;
+        handler.fileReceived(id);
+    }
+}
+
+void FileTransfer::sendingFailed(
+    Id id, const std::string& reason, bool tellPeer) {
+    if(!outgoing.erase(id))
+        return;
+    if(tellPeer)
+        sendControl(MESSAGE_ABORT_SENDING, id, 0);
+    handler.fileFailed(id, true, reason);
+}
+
+void FileTransfer::receivingFailed(
+    Id id, const std::string& reason, bool tellPeer) {
+    if(!incoming.erase(id))
+        return;
+    if(tellPeer)
+        sendControl(MESSAGE_ABORT_RECEIVING, id, 0);
+    handler.fileFailed(id, false, reason);
+}
+
+void FileTransfer::sendControl(unsigned char type, Id id, Offset offset) {
+    std::string message(CONTROL_SIZE, '\0');
+    message[0] = static_cast<char>(type);
+    write32(&message[1], id);
+    write64(&message[5], offset);
+    /* in order behind the ones that are waiting already */
+    if(!pendingControl.empty() || !link.sendMessage(message))
+        pendingControl.push_back(message);
+}
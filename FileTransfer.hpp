@@ -0,0 +1,284 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    FileTransfer.hpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Definition of the file transfer engine. Files are offered,
+ *              streamed as checksummed chunks with many of them in flight,
+ *              and acknowledged as they are written, so an interrupted
+ *              transfer resumes after what the receiver already has.
+ *              Chunks are written where they belong as they arrive, a
+ *              damaged one is asked for again without holding up the rest.
+**/
+
+#pragma once
+
+/* STL includes */
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/* Boost includes */
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+/* WebP2P includes */
+#include "PacketBuffer.hpp"
+
+/* Where the bytes of a file that is sent come from. */
+class FileSource {
+public:
+    typedef boost::uint64_t Offset;
+    typedef boost::uint64_t Version;
+
+    virtual ~FileSource() {}
+    virtual Offset size() const = 0;
+    /* Tells this content of the file from another by the same name, such
+     * as its modification time. 0 when unknown, nothing resumes then.
+    **/
+    virtual Version version() const { return 0; }
+    /* fewer bytes than asked for only at the end or on errors */
+    virtual size_t read(Offset offset, char* data, size_t size) = 0;
+};
+
+/* Where the bytes of a file that is received go. */
+class FileSink {
+public:
+    typedef boost::uint64_t Offset;
+    typedef boost::uint64_t Version;
+
+    virtual ~FileSink() {}
+    /* bytes already there, the transfer resumes after them */
+    virtual Offset size() const = 0;
+    /* writes may come in any order, never twice to the same bytes */
+    virtual bool write(Offset offset, const char* data, size_t size) = 0;
+    /* the size and version of the file, before anything is written */
+    virtual bool allocate(Offset size, Version version) { return true; }
+    /* every byte was written */
+    virtual bool finish() { return true; }
+};
+
+/* Reads a file in large sequential blocks and hands out chunks of them. */
+class FileReader : public FileSource {
+    mutable std::ifstream file;
+    Offset                length;
+    std::vector<char>     block;
+    Offset                blockOffset;
+    size_t                blockSize;
+    Version               modified;
+
+public:
+    enum { DEFAULT_BLOCK_SIZE = 1024 * 1024 };
+
+    FileReader(const std::string& path,
+        size_t blockSize = DEFAULT_BLOCK_SIZE);
+
+    bool isOpen() const;
+    Offset size() const;
+    /* the modification time */
+    Version version() const;
+    size_t read(Offset offset, char* data, size_t size);
+};
+
+/* Writes a file, keeping what an earlier transfer left in it. Only suited
+ * to writes in order, a hole would be taken for data on resuming.
+**/
+class FileWriter : public FileSink {
+    std::fstream file;
+    Offset       length;
+    Offset       position;
+
+public:
+    FileWriter(const std::string& path);
+
+    bool isOpen() const;
+    Offset size() const;
+    bool write(Offset offset, const char* data, size_t size);
+};
+
+/* Writes a file at the offsets of the chunks as they arrive, into
+ * path.part preallocated to the full size, and gives it the name path once
+ * every block is there, or "name (1).ext" and so on when path is taken.
+ * Which blocks are is kept in a bitmap, saved in path.part.map when the
+ * writer goes away unfinished, so the next transfer of the same version
+ * of the file resumes after the blocks already written. Neither file is
+ * taken over when it is a link or belongs to someone else.
+**/
+class SparseFileWriter : public FileSink, boost::noncopyable {
+    std::string       path;
+    std::string       finalPath;
+    std::fstream      file;
+    size_t            blockSize;
+    Offset            length;
+    Version           fileVersion;
+    /* one bit per block, vector<bool> packs them */
+    std::vector<bool> blocks;
+    size_t            blocksDone;
+    /* bytes written to the blocks that are not complete yet */
+    std::map<size_t, size_t> partialBlocks;
+    bool              allocated;
+    bool              finished;
+
+    Offset blockEnd(size_t block) const;
+    void loadMap();
+    void saveMap() const;
+
+public:
+    enum { DEFAULT_BLOCK_SIZE = 64 * 1024 };
+
+    SparseFileWriter(const std::string& path,
+        size_t blockSize = DEFAULT_BLOCK_SIZE);
+    ~SparseFileWriter();
+
+    bool isOpen() const;
+    bool isComplete() const;
+    /* where finish() put the file */
+    const std::string& getPath() const;
+    /* the complete blocks at the start of the file */
+    Offset size() const;
+    bool write(Offset offset, const char* data, size_t size);
+    bool allocate(Offset size, Version version);
+    bool finish();
+};
+
+class FileTransfer : boost::noncopyable {
+public:
+    typedef boost::uint32_t Id;
+    typedef boost::uint64_t Offset;
+
+    /* Carries the messages of the transfers, reliably and in order. */
+    class Link {
+    public:
+        virtual ~Link() {}
+        /* false if the message was not taken, pump() tries again later */
+        virtual bool sendMessage(const std::string& message) = 0;
+    };
+
+    class Handler {
+    public:
+        virtual ~Handler() {}
+        /* The sink for a file the peer offers, or none to refuse it. */
+        virtual boost::shared_ptr<FileSink> fileOffered(
+            Id id, const std::string& name, Offset size) = 0;
+        virtual void fileReceived(Id id) = 0;
+        virtual void fileSent(Id id) = 0;
+        /* either way, the id is the one fileOffered or sendFile gave */
+        virtual void fileFailed(Id id, bool sending,
+            const std::string& reason) = 0;
+    };
+
+    struct Configuration {
+        size_t   chunkSize;
+        /* chunks sent and not acknowledged yet */
+        unsigned pipeline;
+        /* larger offers are refused */
+        Offset   maxFileSize;
+
+        Configuration();
+    };
+
+    struct Statistics {
+        unsigned long long filesSent;
+        unsigned long long filesReceived;
+        unsigned long long chunksSent;
+        unsigned long long chunksReceived;
+        unsigned long long bytesSent;
+        unsigned long long bytesReceived;
+        /* chunks that failed their checksum and were sent again */
+        unsigned long long corruptChunks;
+        /* chunks the receiver wrote before the ones in front of them */
+        unsigned long long chunksOutOfOrder;
+        /* bytes the receivers already had when a transfer started */
+        unsigned long long bytesResumed;
+
+        Statistics();
+    };
+
+private:
+    enum SendResult { SENT, REFUSED, FAILED };
+
+    struct Outgoing {
+        std::string                   name;
+        boost::shared_ptr<FileSource> source;
+        Offset                        size;
+        bool                          offered;
+        /* the receiver said where to start */
+        bool                          started;
+        Offset                        next;
+        Offset                        acknowledged;
+        /* chunks the receiver asked for again */
+        std::set<Offset>              resend;
+
+        Outgoing();
+    };
+
+    struct Incoming {
+        boost::shared_ptr<FileSink> sink;
+        Offset                      size;
+        /* everything before it is written */
+        Offset                      expected;
+        /* the start and end of the chunks written after a gap, at most
+         * the pipeline of the sender
+        **/
+        std::map<Offset, Offset>    ahead;
+    };
+
+    Link&                      link;
+    Handler&                   handler;
+    Configuration              configuration;
+    Statistics                 statistics;
+    Id                         nextId;
+    std::map<Id, Outgoing>     outgoing;
+    std::map<Id, Incoming>     incoming;
+    /* control messages the link refused, sent again by pump() */
+    std::vector<std::string>   pendingControl;
+
+public:
+    FileTransfer(
+        Link& link,
+        Handler& handler,
+        const Configuration& configuration = Configuration());
+
+    Id sendFile(const std::string& name,
+        const boost::shared_ptr<FileSource>& source);
+
+    void messageReceived(const PacketSlice& message);
+
+    /* Sends what the pipelines allow. Call it when the link takes
+     * messages again after refusing one.
+    **/
+    void pump();
+
+    /* transfers in either direction that did not finish yet */
+    size_t getActiveCount() const;
+    Statistics getStatistics() const;
+
+private:
+    bool pump(Id id, Outgoing& o);
+    SendResult sendChunk(Id id, Outgoing& o, Offset offset);
+    void offerReceived(const char* data, size_t size);
+    void resumeReceived(Id id, Offset offset);
+    void acknowledgementReceived(Id id, Offset offset);
+    void resendReceived(Id id, Offset offset);
+    void chunkReceived(const char* data, size_t size);
+    void sendingFailed(Id id, const std::string& reason, bool tellPeer);
+    void receivingFailed(Id id, const std::string& reason, bool tellPeer);
+    void sendControl(unsigned char type, Id id, Offset offset);
+};
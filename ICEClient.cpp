@@ -22,16 +22,18 @@
 **/
 
 /* STL includes */
-#include <sstream>
+#include <algorithm>
 #include <string>
 #include <iostream>
 
 /* Boost includes */
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/bind.hpp>
 #include <boost/scoped_array.hpp>
 
 /* WebP2P includes */
 #include "ICEClient.hpp"
-#include "SessionDescriptor.hpp"
+#include "SessionDescriptorWriter.hpp"
 
 ICEClient::ServerConfiguration::ServerConfiguration(
 	const std::string& serverConfigString) {
@@ -69,88 +71,92 @@ const std::string& ICEClient::ServerConfiguration::getTurnPassword() {
     return turnPassword;
 }
 
+static void onChannelTimer(pj_timer_heap_t* timerHeap, pj_timer_entry* entry);
+
 ICEClient::ICEClient(const std::string& server_cfg) :
+    reactor(NULL),
     icest(NULL),
-    thread(NULL),
-    thread_quit_flag(PJ_FALSE),
     pool(NULL),
     serverConfiguration(server_cfg),
-    comp_cnt(1) {
+    remoteDescriptionHandler(*this),
+    remoteDescriptionParser(remoteDescriptionHandler, remoteDescriptionLimits()),
+    comp_cnt(1),
+    state(OPEN),
+    notifyClosed(true),
+    channelEndpoint(*this),
+    channel(channelEndpoint, channelEndpoint),
+    channelTimerScheduled(false),
+    channelTimerRequested(false),
+    channelTimerDeadline(ReliableChannel::NEVER),
+    bufferedAmountLowPending(false),
+    selfReference(new ICEClient*(this)),
+    callbacks(NULL) {
+    pj_timer_entry_init(&channelTimer, 0, this, &onChannelTimer);
     initializeClient();
 }
 
+/* One component per media section. */
+SessionDescriptorParser::Limits ICEClient::remoteDescriptionLimits() {
+    SessionDescriptorParser::Limits limits;
+    limits.maxMediaDescriptions = PJ_ICE_MAX_COMP;
+    return limits;
+}
+
 ICEClient::~ICEClient() {
-    shutdownSession();
-    shutdownTransport();
-    shutdownClient();
+    selfReference.reset();
+    {
+        /* the owner is going away, there is nobody left to tell */
+        boost::mutex::scoped_lock lock(stateMutex);
+        notifyClosed = false;
+    }
+    close();
+    waitUntilClosed();
+
+    /* here rather than on the reactor thread, which the runtime joins when
+     * this was the last client
+    **/
+    runtime.reset();
 }
 
-static int worker_thread(void *ICEClient_instance) {
-    while (!static_cast<ICEClient*>(ICEClient_instance)
-    	->handleEvents(500, NULL)) {}
+void ICEClient::close() {
+    {
+        boost::mutex::scoped_lock lock(stateMutex);
+        if(state != OPEN)
+            return;
+        state = CLOSING;
+    }
+    if(reactor == NULL || reactor->isCurrentThread())
+        finishClose();
+    else
+        reactor->post(boost::bind(&ICEClient::finishClose, this));
+}
 
-    return 0;
+bool ICEClient::isOpen() const {
+    return state == OPEN;
 }
 
-pj_bool_t ICEClient::handleEvents(unsigned max_msec, unsigned *p_count) {
-    enum { MAX_NET_EVENTS = 1 };
-    pj_time_val max_timeout = {0, 0};
-    pj_time_val timeout = {0, 0};
-    unsigned count = 0, net_event_count = 0;
-    int c;
-    
-    max_timeout.msec = max_msec;
-    
-    /* Poll the timer to run it and also to retrieve the earliest entry. */
-    timeout.sec = timeout.msec = 0;
-    c = pj_timer_heap_poll( ice_cfg.stun_cfg.timer_heap, &timeout );
-    if (c > 0)
-        count += c;
-    
-    /* timer_heap_poll should never ever returns negative value, or otherwise
-     * ioqueue_poll() will block forever!
-     */
-    pj_assert(timeout.sec >= 0 && timeout.msec >= 0);
-    if (timeout.msec >= 1000) timeout.msec = 999;
-    
-    /* compare the value with the timeout to wait from timer, and use the 
-     * minimum value. 
-     */
-    if (PJ_TIME_VAL_GT(timeout, max_timeout))
-        timeout = max_timeout;
-    
-    /* Poll ioqueue. 
-     * Repeat polling the ioqueue while we have immediate events, because
-     * timer heap may process more than one events, so if we only process
-     * one network events at a time (such as when IOCP backend is used),
-     * the ioqueue may have trouble keeping up with the request rate.
-     *
-     * For example, for each send() request, one network event will be
-     *   reported by ioqueue for the send() completion. If we don't poll
-     *   the ioqueue often enough, the send() completion will not be
-     *   reported in timely manner.
-     */
-    do {
-        c = pj_ioqueue_poll(ice_cfg.stun_cfg.ioqueue, &timeout);
-        if (c < 0) {
-            //pj_status_t err = pj_get_netos_error();
-            pj_thread_sleep(PJ_TIME_VAL_MSEC(timeout));
-            if (p_count)
-                *p_count = count;
-            return thread_quit_flag;
-        } else if (c == 0) {
-            break;
-        } else {
-            net_event_count += c;
-            timeout.sec = timeout.msec = 0;
-        }
-    } while (c > 0 && net_event_count < MAX_NET_EVENTS);
-    
-    count += net_event_count;
-    if (p_count)
-        *p_count = count;
-    
-    return thread_quit_flag;
+void ICEClient::finishClose() {
+    bool notify;
+    {
+        boost::mutex::scoped_lock lock(stateMutex);
+        cancelChannelTimer();
+        shutdownSession();
+        shutdownTransport();
+        shutdownClient();
+        notify = notifyClosed && callbacks != NULL;
+    }
+    if(notify)
+        callbacks->closed();
+
+    boost::mutex::scoped_lock lock(stateMutex);
+    state = CLOSED;
+    stateChanged.notify_all();
+}
+
+void ICEClient::waitUntilClosed() {
+    boost::mutex::scoped_lock lock(stateMutex);
+    while(state != CLOSED)
+        stateChanged.wait(lock);
 }
 
 /*
@@ -171,9 +177,14 @@ static void cb_on_rx_data(pj_ice_strans *ice_st,
     PJ_UNUSED_ARG(src_addr_len);
     PJ_UNUSED_ARG(pkt);
     
-    std::string receivedText((const char*)pkt, size);
-    static_cast<ICEClient*>(pj_ice_strans_get_user_data(ice_st))->
-            callbacks->dataReceived(receivedText);
+    ICEClient* client
+        = static_cast<ICEClient*>(pj_ice_strans_get_user_data(ice_st));
+    if(!client->isOpen())
+        return;
+    /* pjnath reuses its receive buffer once this returns, the copy into a
+     * pooled buffer is the only one the data needs
+    **/
+    client->packetReceived(PacketBufferPool::shared().copy(pkt, size));
     
     // Don't do this! It will ruin the packet buffer in case TCP is used!
     //((char*)pkt)[size] = '\0';
@@ -193,6 +204,11 @@ static void cb_on_ice_complete(pj_ice_strans *ice_st,
                                pj_ice_strans_op op,
                                pj_status_t status)
 {
+    /* closing, the owner no longer wants to hear about it */
+    if(!static_cast<ICEClient*>(pj_ice_strans_get_user_data(ice_st))
+        ->isOpen())
+        return;
+
     if(op == PJ_ICE_STRANS_OP_INIT) {
         /* Initialization (candidate gathering) */
         static_cast<ICEClient*>(pj_ice_strans_get_user_data(ice_st))
@@ -203,7 +219,7 @@ static void cb_on_ice_complete(pj_ice_strans *ice_st,
         /* Negotiation */
         std::cout << "ICEClient: ICE Negotiation Complete";
         static_cast<ICEClient*>(pj_ice_strans_get_user_data(ice_st))->
-            callbacks->negotiationComplete();
+            negotiationComplete(status == PJ_SUCCESS);
     }
     else if(op == PJ_ICE_STRANS_OP_KEEP_ALIVE) {
         /* This operation is used to report failure in keep-alive operation. */
@@ -217,70 +233,31 @@ static void cb_on_ice_complete(pj_ice_strans *ice_st,
 }
 
 std::string ICEClient::initializeClient() {
-    pj_status_t status;
-    
-    /* Initialize libraries */
-    status = pj_init();
-    if(status != PJ_SUCCESS) {
-        return std::string("pj_init() failed");
-    }
-    status = pjlib_util_init();
-    if(status != PJ_SUCCESS) {
-        return std::string("pjlib_util_init() failed");
-    }
-    status = pjnath_init();
-    if(status != PJ_SUCCESS) {
-        return std::string("pjnath_init() failed");
+    /* the libraries are shared, the event loop and the resolver are those
+     * of the least busy reactor
+    **/
+    runtime = ICERuntime::acquire();
+    if(!runtime->error().empty()) {
+        return runtime->error();
     }
+    reactor = runtime->attach();
     
     /* Init ICE settings with default values */
     pj_ice_strans_cfg_default(&ice_cfg);
     pj_stun_sock_cfg_default(&ice_cfg.stun.cfg);
     pj_turn_sock_cfg_default(&ice_cfg.turn.cfg);
     
-    /* Create the caching pool factory */
-    pj_caching_pool_init(&cp, NULL, 0);
-    ice_cfg.stun_cfg.pf = &cp.factory;
+    ice_cfg.stun_cfg.pf         = runtime->getPoolFactory();
+    ice_cfg.stun_cfg.timer_heap = reactor->getTimerHeap();
+    ice_cfg.stun_cfg.ioqueue    = reactor->getIOQueue();
+    ice_cfg.resolver            = reactor->getResolver();
     
     /* Create memory pool */
-    pool = pj_pool_create(&cp.factory, "web_p2p", 512, 512, NULL);
+    pool = pj_pool_create(runtime->getPoolFactory(), "web_p2p", 512, 512, NULL);
     if(pool == NULL) {
         return std::string("pj_pool_create() failed");
     }
     
-    /* Create timer heap */
-    status = pj_timer_heap_create(pool, 100, &ice_cfg.stun_cfg.timer_heap);
-    if(status != PJ_SUCCESS) {
-        return std::string("pj_timer_heap_create() failed");
-    }
-    
-    /* Create ioqueue */
-    status = pj_ioqueue_create(pool, 16, &ice_cfg.stun_cfg.ioqueue);
-    if(status != PJ_SUCCESS) {
-        return std::string("pj_ioqueue_create() failed");
-    }
-    
-    /* Create event polling thread */
-    status = pj_thread_create(
-    	pool, "web_p2p", &worker_thread, this, 0, 0, &thread);
-    if(status != PJ_SUCCESS) {
-        return std::string("pj_thread_create() failed");
-    }
-    
-    /* Create DNS resolver */
-    pj_str_t dnsServer;
-    pj_cstr(&dnsServer, "8.8.8.8");
-    status = pj_dns_resolver_create(
-    	&cp.factory, "resolver", 0, ice_cfg.stun_cfg.timer_heap,
-        ice_cfg.stun_cfg.ioqueue, &ice_cfg.resolver);
-    if(status != PJ_SUCCESS) {
-        return std::string("pj_dns_resolver() failed");
-    }
-    status = pj_dns_resolver_set_ns(ice_cfg.resolver, 1, &dnsServer, NULL);
-    if(status != PJ_SUCCESS) {
-        return std::string("pj_dns_resolver_set_ns() failed");
-    }
-    
     /* Maximum number of host candidates */
     ice_cfg.stun.max_host_cands = PJ_ICE_ST_MAX_CAND;
     
@@ -321,23 +298,15 @@ std::string ICEClient::initializeClient() {
 void ICEClient::shutdownClient() {
     if(icest)
         pj_ice_strans_destroy(icest);
+    icest = NULL;
 
-    pj_thread_sleep(500);
-    thread_quit_flag = PJ_TRUE;
-    if(thread) {
-        pj_thread_join(thread);
-        pj_thread_destroy(thread);
-    }
-    
-    if(ice_cfg.stun_cfg.ioqueue)
-        pj_ioqueue_destroy(ice_cfg.stun_cfg.ioqueue);
+    if(pool)
+        pj_pool_release(pool);
+    pool = NULL;
 
-    if(ice_cfg.stun_cfg.timer_heap)
-        pj_timer_heap_destroy(ice_cfg.stun_cfg.timer_heap);
-    
-    pj_caching_pool_destroy(&cp);
-    
-    pj_shutdown();
+    if(runtime)
+        runtime->detach(reactor);
+    reactor = NULL;
 }
 
 void ICEClient::initializeTransport() {
@@ -364,7 +333,6 @@ void ICEClient::shutdownTransport() {
     
     pj_ice_strans_destroy(icest);
     icest = NULL;
-    resetRemoteCandidates();
 }
 
 void ICEClient::initializeSession() {
@@ -381,8 +349,6 @@ void ICEClient::initializeSession() {
     if (status != PJ_SUCCESS) {
         return;
     }
-
-    resetRemoteCandidates();    
 }
 
 void ICEClient::shutdownSession() {
@@ -392,7 +358,6 @@ void ICEClient::shutdownSession() {
         return;
     
     pj_ice_strans_stop_ice(icest);
-    resetRemoteCandidates();
 }
 
 void ICEClient::setCallbacks(Callbacks* callbacks) {
@@ -411,204 +376,475 @@ void ICEClient::deliverLocalCandidates() {
     callbacks->setLocalCandidates(localCandidates);
 }
 
-std::string ICEClient::getLocalCandidates() {
-    pj_status_t status;
-    
+template<typename Buffer> static void writeAddress(
+    SessionDescriptorWriter<Buffer>& w, const pj_sockaddr& addr) {
+    if(addr.addr.sa_family == pj_AF_INET()) {
+        w.ipv4Address(reinterpret_cast<const unsigned char*>(
+            &addr.ipv4.sin_addr));
+    } else {
+        char ipaddr[PJ_INET6_ADDRSTRLEN];
+        w.text(pj_sockaddr_print(&addr, ipaddr, sizeof(ipaddr), 0));
+    }
+}
+
+/* Returns NULL on success, or the name of the call that failed. */
+template<typename Buffer> static const char* writeLocalCandidates(
+    SessionDescriptorWriter<Buffer>& w, pj_ice_strans* icest, unsigned comp_cnt) {
     pj_str_t local_ufrag, local_pwd;
-    status = pj_ice_strans_get_ufrag_pwd(icest, &local_ufrag, &local_pwd, 
-    	NULL, NULL);
-    if(status != PJ_SUCCESS)
-        return std::string("pj_ice_strans_get_ufrag_pwd() failed");
-    
-    std::stringstream candidateList;
-    candidateList << "v=0\no=- 3414953978 3414953978 IN IP4 localhost\ns=ice\nt=0 0\n";
-    candidateList << "a=ice-ufrag:";
-    candidateList.write(local_ufrag.ptr, local_ufrag.slen);
-    candidateList << "\na=ice-pwd:";
-    candidateList.write(local_pwd.ptr, local_pwd.slen);
-    candidateList << "\n";
+    if(pj_ice_strans_get_ufrag_pwd(icest, &local_ufrag, &local_pwd,
+        NULL, NULL) != PJ_SUCCESS)
+        return "pj_ice_strans_get_ufrag_pwd()";
+
+    w.text("v=0\no=- 3414953978 3414953978 IN IP4 localhost\ns=ice\nt=0 0\n");
+    w.text("a=ice-ufrag:").text(local_ufrag.ptr, local_ufrag.slen).endLine();
+    w.text("a=ice-pwd:").text(local_pwd.ptr, local_pwd.slen).endLine();
 
-    
     for(unsigned comp = 1; comp <= comp_cnt; ++comp) {
-        char ipaddr[PJ_INET6_ADDRSTRLEN];
         unsigned cand_cnt;
         pj_ice_sess_cand cand[PJ_ICE_ST_MAX_CAND];
 
-        status = pj_ice_strans_get_def_cand(icest, comp, &cand[0]);
-        if(status != PJ_SUCCESS)
-            return std::string("pj_ice_strans_get_def_cand() failed");
+        if(pj_ice_strans_get_def_cand(icest, comp, &cand[0]) != PJ_SUCCESS)
+            return "pj_ice_strans_get_def_cand()";
 
+        unsigned port = pj_sockaddr_get_port(&cand[0].addr);
         if(comp == 1) {
-            candidateList << "m=audio ";
-            candidateList << (unsigned)pj_sockaddr_get_port(&cand[0].addr);
-            candidateList << " RTP/AVP 0\nc=IN IP4 ";
-            candidateList 
-            	<< pj_sockaddr_print(&cand[0].addr, ipaddr, sizeof(ipaddr), 0);
-            candidateList << "\n";
+            w.text("m=audio ").number(port).text(" RTP/AVP 0\nc=IN IP4 ");
         }
         else if(comp == 2) {
-            candidateList << "m=rtcp:";
-            candidateList << (unsigned)pj_sockaddr_get_port(&cand[0].addr);
-            candidateList << " IN IP4 ";
-            candidateList 
-            	<< pj_sockaddr_print(&cand[0].addr, ipaddr, sizeof(ipaddr), 0);
-            candidateList << "\n";
+            w.text("m=rtcp:").number(port).text(" IN IP4 ");
         }
         else {
-            candidateList << "a=Xice-defcand:";
-            candidateList << (unsigned)pj_sockaddr_get_port(&cand[0].addr);
-            candidateList << " IN IP4 ";
-            candidateList 
-            	<< pj_sockaddr_print(&cand[0].addr, ipaddr, sizeof(ipaddr), 0);
-            candidateList << "\n";
+            w.text("a=Xice-defcand:").number(port).text(" IN IP4 ");
         }
+        writeAddress(w, cand[0].addr);
+        w.endLine();
 
-        status = pj_ice_strans_enum_cands(icest, comp, &cand_cnt, cand);
-        if(status != PJ_SUCCESS)
-            return std::string("pj_ice_strans_enum_cands() failed");
+        cand_cnt = PJ_ARRAY_SIZE(cand);
+        if(pj_ice_strans_enum_cands(icest, comp, &cand_cnt, cand) != PJ_SUCCESS)
+            return "pj_ice_strans_enum_cands()";
     
         for(unsigned j = 0; j < cand_cnt; ++j) {
-            candidateList << "a=candidate:";
-            candidateList.write(
-            	cand[j].foundation.ptr, cand[j].foundation.slen);
-            candidateList 
-            	<< " " 
-            	<< (unsigned) cand[j].comp_id 
-            	<< " UDP " 
-            	<< cand[j].prio 
-            	<< " ";
-            candidateList 
-            	<< pj_sockaddr_print(&cand[j].addr, ipaddr, sizeof(ipaddr), 0);
-            candidateList 
-            	<< " " 
-            	<< (unsigned) pj_sockaddr_get_port(&cand[j].addr) 
-            	<< " typ ";
-            candidateList << pj_ice_get_cand_type_name(cand[j].type);
-            candidateList << "\n";
+            w.text("a=candidate:")
+                .text(cand[j].foundation.ptr, cand[j].foundation.slen)
+                .character(' ').number(cand[j].comp_id)
+                .text(" UDP ").number(cand[j].prio)
+                .character(' ');
+            writeAddress(w, cand[j].addr);
+            w.character(' ').number(pj_sockaddr_get_port(&cand[j].addr))
+                .text(" typ ").text(pj_ice_get_cand_type_name(cand[j].type))
+                .endLine();
         }
     }
+    return NULL;
+}
 
-    return candidateList.str();
+std::string ICEClient::getLocalCandidates() {
+    /* a stack buffer is enough unless there are many candidates */
+    FixedBuffer<2048> fixed;
+    SessionDescriptorWriter<FixedBuffer<2048> > w(fixed);
+    const char* failure = writeLocalCandidates(w, icest, comp_cnt);
+    if(failure)
+        return std::string(failure) + " failed";
+    if(!fixed.overflowed())
+        return std::string(fixed.data(), fixed.size());
+
+    std::string candidateList;
+    StringBuffer growable(candidateList);
+    SessionDescriptorWriter<StringBuffer> g(growable);
+    failure = writeLocalCandidates(g, icest, comp_cnt);
+    if(failure)
+        return std::string(failure) + " failed";
+    return candidateList;
 }
 
-void ICEClient::addRemoteCandidates(const std::string& remoteCandidates) {
-    try {
-        SessionDescriptor remoteSDP = SessionDescriptor(remoteCandidates);
-        SessionDescriptorData& sdp = remoteSDP.getData();
-        for(std::vector<Attribute>::iterator i = sdp.sessionAttributes.begin();
-            i != sdp.sessionAttributes.end(); i++) {
-            if(ValuedAttribute* at = boost::get<ValuedAttribute>(&*i)) {
-                std::string attributeName = boost::fusion::at_c<0>(*at);
-                std::string attributeValue = boost::fusion::at_c<1>(*at);
-                if(attributeName ==  "ice-ufrag")
-                    remoteConfiguration.ufrag = attributeValue;
-                else if(attributeName == "ice-pwd")
-                    remoteConfiguration.pwd = attributeValue;
-            }
-        }
+static pj_str_t toPjString(const StringView& view) {
+    pj_str_t result;
+    result.ptr  = const_cast<char*>(view.empty() ? "" : &*view.begin());
+    result.slen = view.size();
+    return result;
+}
 
-        remoteConfiguration.comp_cnt = 0;
-        for(std::vector<MediaDescription>::iterator i = sdp.mediaDescriptions.begin();
-            i != sdp.mediaDescriptions.end(); i++) {
-            remoteConfiguration.comp_cnt++;
-            
-            if(i->connectionData.size() >= 1)
-            {
-                ConnectionData& cdata = i->connectionData[0];
-                if(cdata.netType == "IN")
-                {
-                    int af = (cdata.addressType == "IP4") ?
-                        pj_AF_INET() : pj_AF_INET6();
-                    pj_sockaddr addr;
-                    pj_sockaddr_init(af, &addr, NULL, 0);
-                    pj_str_t temp;
-                    pj_cstr(&temp, cdata.connectionAddress.data());
-                    pj_sockaddr_set_str_addr(af, &addr, &temp);
-                    remoteConfiguration.def_addr.push_back(addr);
-                }
-            }
-
-            for(std::vector<Attribute>::iterator j = i->mediaAttributes.begin();
-                j != i->mediaAttributes.end(); j++) {
-                if(ValuedAttribute* at = boost::get<ValuedAttribute>(&*j)) {
-                    std::string attributeName = boost::fusion::at_c<0>(*at);
-                    std::string attributeValue = boost::fusion::at_c<1>(*at);
-                    if(attributeName ==  "candidate") {
-                        std::stringstream ss(attributeValue);
-                        pj_ice_sess_cand cand;
-                        std::string foundation;
-                        int comp_id;
-                        std::string transport;
-                        int prio;
-                        std::string ipaddr;
-                        unsigned short port;
-                        std::string skip, type;
-                        ss >> foundation
-                           >> comp_id
-                           >> transport
-                           >> prio
-                           >> ipaddr
-                           >> port
-                           >> skip
-                           >> type;
-                        if(type == "host") {
-                            cand.type = PJ_ICE_CAND_TYPE_HOST;
-                        } else if(type == "srflx") {
-                            cand.type = PJ_ICE_CAND_TYPE_SRFLX;
-                        } else if(type == "relay") {
-                            cand.type = PJ_ICE_CAND_TYPE_RELAYED;
-                        }
-                        cand.comp_id = (pj_uint8_t) comp_id;
-                        cand.prio    = prio;
-                        pj_strdup2(pool, &cand.foundation, foundation.c_str());
-                        
-                        int af;
-                        if(ipaddr.find(":") == std::string::npos) {
-                            af = pj_AF_INET();
-                        } else {
-                            af = pj_AF_INET6();
-                        }
-                        
-                        pj_str_t temp;
-                        pj_cstr(&temp, ipaddr.c_str());
-                        pj_sockaddr_init(af, &cand.addr, NULL, 0);
-                        pj_sockaddr_set_str_addr(af, &cand.addr, &temp);
-                        pj_sockaddr_set_port(&cand.addr, (pj_uint16_t)port);
-                        remoteConfiguration.cand.push_back(cand);
-                    }
-                }
-            }
-        }
-        pj_str_t rufrag, rpwd;
-        pj_status_t status;
-        
-        int cand_cnt = remoteConfiguration.cand.size();        
-        boost::scoped_array<pj_ice_sess_cand> cand(new pj_ice_sess_cand[cand_cnt]);
-        for(int i = 0; i < cand_cnt; i++) {
-            cand[i] = remoteConfiguration.cand[i];
-        }
-        status = pj_ice_strans_start_ice(icest, 
-			pj_cstr(&rufrag, remoteConfiguration.ufrag.c_str()),
-			pj_cstr(&rpwd, remoteConfiguration.pwd.c_str()),
-			cand_cnt,
-			cand.get());
-        
-    } catch (std::exception) {
+static bool setAddress(const StringView& address, unsigned short port,
+    pj_sockaddr& addr) {
+    int af = std::find(address.begin(), address.end(), ':') == address.end()
+        ? pj_AF_INET() : pj_AF_INET6();
+    pj_str_t temp = toPjString(address);
+    pj_sockaddr_init(af, &addr, NULL, 0);
+    if(pj_sockaddr_set_str_addr(af, &addr, &temp) != PJ_SUCCESS)
+        return false;
+    pj_sockaddr_set_port(&addr, (pj_uint16_t)port);
+    return true;
+}
+
+ICEClient::RemoteDescriptionHandler::RemoteDescriptionHandler(
+    ICEClient& client) :
+    client(client),
+    hasConnectionData(false) {
+}
+
+void ICEClient::RemoteDescriptionHandler::origin(const OriginView& origin) {
+    /* o= directly follows v=, a new description starts here */
+    RemoteConfiguration& remote = client.parsedConfiguration;
+    remote.ufrag.clear();
+    remote.pwd.clear();
+    remote.comp_cnt = 0;
+    remote.def_addr.clear();
+    remote.cand.clear();
+}
+
+void ICEClient::RemoteDescriptionHandler::sessionAttribute(
+    const AttributeView& attribute) {
+    switch(attribute.id) {
+    case ATTRIBUTE_ICE_UFRAG:
+        client.parsedConfiguration.ufrag.assign(
+            attribute.value.begin(), attribute.value.end());
+        break;
+    case ATTRIBUTE_ICE_PWD:
+        client.parsedConfiguration.pwd.assign(
+            attribute.value.begin(), attribute.value.end());
+        break;
+    default:
+        break;
+    }
+}
+
+void ICEClient::RemoteDescriptionHandler::mediaDescription(
+    const MediaView& media) {
+    client.parsedConfiguration.comp_cnt++;
+    hasConnectionData = false;
+}
+
+void ICEClient::RemoteDescriptionHandler::connectionData(
+    const ConnectionDataView& c) {
+    using boost::algorithm::equals;
+
+    /* only the first c= of a media section is the default address */
+    if(hasConnectionData)
+        return;
+    hasConnectionData = true;
+
+    if(equals(c.netType, "IN")) {
+        int af = equals(c.addressType, "IP4") ? pj_AF_INET() : pj_AF_INET6();
+        pj_sockaddr addr;
+        pj_sockaddr_init(af, &addr, NULL, 0);
+        pj_str_t temp = toPjString(c.connectionAddress);
+        pj_sockaddr_set_str_addr(af, &addr, &temp);
+        client.parsedConfiguration.def_addr.push_back(addr);
+    }
+}
+
+void ICEClient::RemoteDescriptionHandler::candidate(
+    const StringView& candidate) {
+    client.addRemoteCandidate(candidate);
+}
+
+void ICEClient::addRemoteCandidate(const StringView& candidate) {
+    using boost::algorithm::equals;
+    using boost::algorithm::iequals;
+
+    /* pj_ice_strans_start_ice() rejects more than PJ_ICE_MAX_CAND */
+    if(parsedConfiguration.cand.size() >= PJ_ICE_MAX_CAND)
+        return;
+
+    CandidateView view;
+    if(!SessionDescriptorParser::parseCandidate(
+        candidate.begin(), candidate.end(), view))
+        return;
+
+    /* pjnath only does UDP and knows four candidate types */
+    if(!iequals(view.transport, "UDP")
+        || view.componentID < 1 || view.componentID > PJ_ICE_MAX_COMP)
+        return;
+
+    pj_ice_sess_cand cand;
+    pj_bzero(&cand, sizeof(cand));
+    if(equals(view.type, "host")) {
+        cand.type = PJ_ICE_CAND_TYPE_HOST;
+    } else if(equals(view.type, "srflx")) {
+        cand.type = PJ_ICE_CAND_TYPE_SRFLX;
+    } else if(equals(view.type, "prflx")) {
+        cand.type = PJ_ICE_CAND_TYPE_PRFLX;
+    } else if(equals(view.type, "relay")) {
+        cand.type = PJ_ICE_CAND_TYPE_RELAYED;
+    } else {
+        return;
     }
+    cand.comp_id = (pj_uint8_t) view.componentID;
+    cand.prio    = view.priority;
+
+    if(!setAddress(view.connectionAddress, view.port, cand.addr))
+        return;
+    if(!view.relatedAddress.empty()
+        && !setAddress(view.relatedAddress, view.relatedPort, cand.rel_addr))
+        return;
+
+    /* the view points into the parser's buffer, keep a copy in the pool,
+     * which close() releases on the reactor thread
+    **/
+    pj_str_t foundation = toPjString(view.foundation);
+    {
+        boost::mutex::scoped_lock lock(stateMutex);
+        if(state != OPEN)
+            return;
+        pj_strdup(pool, &cand.foundation, &foundation);
+    }
+    parsedConfiguration.cand.push_back(cand);
 }
 
-void ICEClient::sendMessage(std::string message) {
+void ICEClient::startNegotiation() {
+    pj_str_t rufrag, rpwd;
     pj_status_t status;
     
-    status = pj_ice_strans_sendto(
-        icest,
+    int cand_cnt = remoteConfiguration.cand.size();        
+    boost::scoped_array<pj_ice_sess_cand> cand(new pj_ice_sess_cand[cand_cnt]);
+    for(int i = 0; i < cand_cnt; i++) {
+        cand[i] = remoteConfiguration.cand[i];
+    }
+    status = pj_ice_strans_start_ice(icest, 
+        pj_cstr(&rufrag, remoteConfiguration.ufrag.c_str()),
+        pj_cstr(&rpwd, remoteConfiguration.pwd.c_str()),
+        cand_cnt,
+        cand.get());
+}
+
+void ICEClient::addRemoteCandidates(const std::string& remoteCandidates) {
+    if(!isOpen())
+        return;
+    remoteDescriptionParser.reset();
+    if(feedRemoteCandidates(remoteCandidates))
+        endRemoteCandidates();
+}
+
+bool ICEClient::feedRemoteCandidates(const std::string& chunk) {
+    if(!isOpen())
+        return false;
+    if(!remoteDescriptionParser.feed(chunk)) {
+        std::cout << "ICEClient: Invalid remote configuration: "
+                  << remoteDescriptionParser.error().toString() << "\n";
+        remoteDescriptionParser.reset();
+        return false;
+    }
+    return true;
+}
+
+bool ICEClient::endRemoteCandidates() {
+    /* pjnath only accepts the remote candidates all at once when checks
+     * start, so negotiation waits for the end of the description.
+    **/
+    bool success = remoteDescriptionParser.finish();
+    if(!success)
+        std::cout << "ICEClient: Invalid remote configuration: "
+                  << remoteDescriptionParser.error().toString() << "\n";
+    remoteDescriptionParser.reset();
+    if(success) {
+        boost::mutex::scoped_lock lock(stateMutex);
+        if(state != OPEN)
+            return false;
+        std::swap(remoteConfiguration, parsedConfiguration);
+        startNegotiation();
+    }
+    return success;
+}
+
+ICEClient::ChannelEndpoint::ChannelEndpoint(ICEClient& client) :
+    client(client) {
+}
+
+void ICEClient::ChannelEndpoint::sendPacket(const char* data, size_t size) {
+    /* the channel only sends with the state mutex held, which keeps the
+     * remote configuration still. Before negotiation the reliable packets
+     * wait for a retransmission.
+    **/
+    if(client.icest == NULL || client.remoteConfiguration.def_addr.empty())
+        return;
+
+    pj_ice_strans_sendto(
+        client.icest,
         1,
-        message.c_str(),
-        message.length(),
-        &remoteConfiguration.def_addr[0],
-        pj_sockaddr_get_len(&remoteConfiguration.def_addr[0]));
+        data,
+        size,
+        &client.remoteConfiguration.def_addr[0],
+        pj_sockaddr_get_len(&client.remoteConfiguration.def_addr[0]));
+}
+
+void ICEClient::ChannelEndpoint::messageReceived(
+    ReliableChannel::ChannelId channel,
+    const PacketSlice& message, bool reliable) {
+    client.receivedMessages.push_back(std::make_pair(channel, message));
+}
+
+void ICEClient::ChannelEndpoint::bufferedAmountLow() {
+    client.bufferedAmountLowPending = true;
+}
+
+ReliableChannel::Milliseconds ICEClient::currentTime() {
+    pj_time_val now;
+    pj_gettickcount(&now);
+    return static_cast<ReliableChannel::Milliseconds>(now.sec) * 1000
+        + now.msec;
+}
+
+bool ICEClient::sendMessage(
+    ReliableChannel::ChannelId channelId, const std::string& message) {
+    boost::mutex::scoped_lock lock(stateMutex);
+    if(state != OPEN)
+        return false;
+
+    bool sent = channel.send(
+        channelId, message.data(), message.size(), currentTime());
+    requestChannelTimer();
+    return sent;
+}
+
+void ICEClient::setChannelDelivery(
+    ReliableChannel::ChannelId channelId, ReliableChannel::Delivery delivery) {
+    boost::mutex::scoped_lock lock(stateMutex);
+    channel.setDelivery(channelId, delivery);
+}
+
+void ICEClient::setChannelPriority(ReliableChannel::ChannelId channelId,
+    SendScheduler::Priority priority, unsigned weight) {
+    boost::mutex::scoped_lock lock(stateMutex);
+    channel.setPriority(channelId, priority);
+    channel.setWeight(channelId, weight);
+}
+
+SendScheduler::ClassStatistics ICEClient::getChannelStatistics(
+    ReliableChannel::ChannelId channelId) {
+    boost::mutex::scoped_lock lock(stateMutex);
+    return channel.getChannelStatistics(channelId);
 }
 
-void ICEClient::resetRemoteCandidates() {
-    pj_bzero(&rem, sizeof(rem));
-}
\ No newline at end of file
+size_t ICEClient::maxMessageSize() const {
+    return channel.maxMessageSize();
+}
+
+void ICEClient::setCongestionControl(CongestionController::Mode mode) {
+    boost::mutex::scoped_lock lock(stateMutex);
+    channel.setCongestionControl(mode);
+}
+
+CongestionController::State ICEClient::getCongestionState() {
+    boost::mutex::scoped_lock lock(stateMutex);
+    return channel.getCongestionState();
+}
+
+size_t ICEClient::getBufferedAmount() {
+    boost::mutex::scoped_lock lock(stateMutex);
+    return channel.getBufferedAmount();
+}
+
+size_t ICEClient::getBufferedAmountLowThreshold() {
+    boost::mutex::scoped_lock lock(stateMutex);
+    return channel.getLowWaterMark();
+}
+
+void ICEClient::setBufferedAmountLowThreshold(size_t bytes) {
+    boost::mutex::scoped_lock lock(stateMutex);
+    channel.setLowWaterMark(bytes);
+}
+
+void ICEClient::packetReceived(const PacketSlice& packet) {
+    std::vector<std::pair<ReliableChannel::ChannelId, PacketSlice> > messages;
+    bool bufferedAmountLow;
+    {
+        boost::mutex::scoped_lock lock(stateMutex);
+        if(state != OPEN)
+            return;
+        channel.packetReceived(packet, currentTime());
+        scheduleChannelTimer();
+        messages.swap(receivedMessages);
+        bufferedAmountLow = bufferedAmountLowPending;
+        bufferedAmountLowPending = false;
+    }
+
+    /* without the mutex, so the callbacks can send */
+    for(size_t i = 0; i < messages.size(); i++)
+        callbacks->dataReceived(messages[i].first, messages[i].second);
+    if(bufferedAmountLow)
+        callbacks->bufferedAmountLow();
+}
+
+void ICEClient::negotiationComplete(bool succeeded) {
+    if(succeeded) {
+        /* the packets sent so far were dropped for want of an address */
+        boost::mutex::scoped_lock lock(stateMutex);
+        if(state != OPEN)
+            return;
+        channel.linkEstablished(currentTime());
+        scheduleChannelTimer();
+    }
+    callbacks->negotiationComplete();
+}
+
+static void onChannelTimer(pj_timer_heap_t* timerHeap, pj_timer_entry* entry) {
+    static_cast<ICEClient*>(entry->user_data)->channelTimerExpired();
+}
+
+void ICEClient::channelTimerExpired() {
+    boost::mutex::scoped_lock lock(stateMutex);
+    channelTimerScheduled = false;
+    if(state != OPEN)
+        return;
+    channel.timerExpired(currentTime());
+    scheduleChannelTimer();
+}
+
+/* A message sent while the timer runs only adds a later timeout, so the
+ * timer only has to be started when it is not running.
+**/
+void ICEClient::requestChannelTimer() {
+    if(reactor == NULL || channelTimerScheduled || channelTimerRequested)
+        return;
+    if(reactor->isCurrentThread()) {
+        scheduleChannelTimer();
+    } else {
+        /* runs before any close that is posted later */
+        channelTimerRequested = true;
+        reactor->post(boost::bind(&ICEClient::startChannelTimerOf,
+            boost::weak_ptr<ICEClient*>(selfReference)));
+    }
+}
+
+void ICEClient::startChannelTimerOf(
+    const boost::weak_ptr<ICEClient*>& client) {
+    boost::shared_ptr<ICEClient*> alive = client.lock();
+    if(alive)
+        (*alive)->startChannelTimer();
+}
+
+void ICEClient::startChannelTimer() {
+    boost::mutex::scoped_lock lock(stateMutex);
+    channelTimerRequested = false;
+    if(state == OPEN)
+        scheduleChannelTimer();
+}
+
+void ICEClient::scheduleChannelTimer() {
+    if(reactor == NULL)
+        return;
+    ReliableChannel::Milliseconds deadline = channel.nextTimeout();
+    if(channelTimerScheduled && deadline == channelTimerDeadline)
+        return;
+    cancelChannelTimer();
+    if(deadline == ReliableChannel::NEVER)
+        return;
+
+    ReliableChannel::Milliseconds now = currentTime();
+    ReliableChannel::Milliseconds delay = deadline > now ? deadline - now : 0;
+    pj_time_val delayValue;
+    delayValue.sec  = static_cast<long>(delay / 1000);
+    delayValue.msec = static_cast<long>(delay % 1000);
+    if(pj_timer_heap_schedule(reactor->getTimerHeap(), &channelTimer,
+        &delayValue) == PJ_SUCCESS) {
+        channelTimerScheduled = true;
+        channelTimerDeadline = deadline;
+    }
+}
+
+void ICEClient::cancelChannelTimer() {
+    if(channelTimerScheduled)
+        pj_timer_heap_cancel(reactor->getTimerHeap(), &channelTimer);
+    channelTimerScheduled = false;
+    channelTimerDeadline = ReliableChannel::NEVER;
+}
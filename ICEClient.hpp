@@ -25,17 +25,20 @@
 
 /* STL headers */
 #include <string>
+#include <utility>
 #include <vector>
 
-/* Fix architecture detection for Win32 by forcing i386 */
-#ifdef WIN32
-    #define PJ_M_I386
-#endif
+/* Boost includes */
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 
-/* PJPROJECT headers */
-#include <pjnath.h>
-#include <pjlib.h>
-#include <pjlib-util.h>
+/* WebP2P includes */
+#include "ICERuntime.hpp"
+#include "PacketBuffer.hpp"
+#include "ReliableChannel.hpp"
+#include "SessionDescriptorStreamParser.hpp"
 
 class ICEClient {
     class ServerConfiguration {
@@ -64,40 +67,103 @@ class ICEClient {
         std::string      ufrag;
         std::string      pwd;
         unsigned         comp_cnt;
-        unsigned         cand_cnt;
         std::vector<pj_sockaddr> def_addr;
         std::vector<pj_ice_sess_cand> cand;
     };
+
+    /* Collects the remote configuration line by line while the remote
+     * session description is still arriving.
+    **/
+    class RemoteDescriptionHandler :
+        public SessionDescriptorStreamParser::Handler {
+        ICEClient& client;
+        bool       hasConnectionData;
+    public:
+        RemoteDescriptionHandler(ICEClient& client);
+
+        void origin(const OriginView& origin);
+        void sessionAttribute(const AttributeView& attribute);
+        void mediaDescription(const MediaView& media);
+        void connectionData(const ConnectionDataView& c);
+        void candidate(const StringView& candidate);
+    };
+
+    /* Connects the message channel to the ICE component. Both are called
+     * with the state mutex held.
+    **/
+    class ChannelEndpoint :
+        public ReliableChannel::Link,
+        public ReliableChannel::Handler {
+        ICEClient& client;
+    public:
+        ChannelEndpoint(ICEClient& client);
+
+        void sendPacket(const char* data, size_t size);
+        void messageReceived(ReliableChannel::ChannelId channel,
+            const PacketSlice& message, bool reliable);
+        void bufferedAmountLow();
+    };
 public:
     class Callbacks {
     public:
         virtual void setLocalCandidates(const std::string& localCandidates) = 0;
         virtual void negotiationComplete() = 0;
-        virtual void dataReceived(const std::string& text) = 0;
+        /* The data stays valid for as long as the slice is kept. */
+        virtual void dataReceived(ReliableChannel::ChannelId channel,
+            const PacketSlice& data) = 0;
+        /* The messages waiting to be sent dropped to the threshold. */
+        virtual void bufferedAmountLow() = 0;
+        /* Called on the reactor thread once close() has completed. The
+         * client may not be deleted from here.
+        **/
+        virtual void closed() = 0;
     };
 private:
+    enum State { OPEN, CLOSING, CLOSED };
+
     /* PJNATH related stuff */
+    boost::shared_ptr<ICERuntime> runtime;
+    ICERuntime::Reactor*          reactor;
     pj_ice_strans_cfg ice_cfg;
     pj_ice_strans*    icest;
-    pj_caching_pool   cp;
-    pj_thread_t*      thread;
-    pj_bool_t         thread_quit_flag;
     pj_pool_t*        pool;
     
-    struct rem_info
-    {
-        std::string      ufrag;
-        std::string      pwd;
-        unsigned         comp_cnt;
-        pj_sockaddr      def_addr[PJ_ICE_MAX_COMP];
-        unsigned         cand_cnt;
-        pj_ice_sess_cand cand[PJ_ICE_ST_MAX_CAND];
-    } rem;
-    
     ServerConfiguration     serverConfiguration;
+    /* the one negotiated with, read by the reactor thread with the state
+     * mutex held
+    **/
     RemoteConfiguration     remoteConfiguration;
+    /* collected on the thread feeding the description, and swapped in
+     * under the mutex once it ends
+    **/
+    RemoteConfiguration     parsedConfiguration;
+    
+    RemoteDescriptionHandler      remoteDescriptionHandler;
+    SessionDescriptorStreamParser remoteDescriptionParser;
     
     unsigned           comp_cnt;
+
+    /* guards the state and the use of the transport against close() */
+    boost::mutex              stateMutex;
+    boost::condition_variable stateChanged;
+    volatile State            state;
+    bool                      notifyClosed;
+
+    ChannelEndpoint           channelEndpoint;
+    ReliableChannel           channel;
+    /* only ever scheduled and cancelled on the reactor thread */
+    pj_timer_entry            channelTimer;
+    bool                      channelTimerScheduled;
+    bool                      channelTimerRequested;
+    ReliableChannel::Milliseconds channelTimerDeadline;
+    /* delivered by the channel, passed on once the mutex is released */
+    std::vector<std::pair<ReliableChannel::ChannelId, PacketSlice> >
+                              receivedMessages;
+    bool                      bufferedAmountLowPending;
+    /* the jobs posted to the reactor only hold a weak reference to this,
+     * since a client deleted on the reactor thread goes before they run
+    **/
+    boost::shared_ptr<ICEClient*> selfReference;
     
 public:
     Callbacks* callbacks;
@@ -106,22 +172,83 @@ public:
     ICEClient(const std::string& server_cfg);
     ~ICEClient();
     
-    pj_bool_t handleEvents(unsigned max_msec, unsigned *p_count);
-    
     void setCallbacks(Callbacks* callbacks);
     void deliverLocalCandidates();
     void addRemoteCandidates(const std::string& remoteCandidates);
+    /* Incremental variant of addRemoteCandidates: every complete line of the
+     * chunk is processed immediately, ICE starts once the description ends.
+    **/
+    bool feedRemoteCandidates(const std::string& chunk);
+    bool endRemoteCandidates();
     
-    void sendMessage(std::string message);
+    /* Sends on one of the logical channels over the nominated pair, the
+     * way set for the channel. Reliable ordered messages arrive in order
+     * with the others of their channel or not at all, unreliable ones as
+     * single datagrams. Either is at most maxMessageSize() bytes. Reliable
+     * messages are refused while too much is buffered already.
+    **/
+    bool sendMessage(ReliableChannel::ChannelId channel,
+        const std::string& message);
+    /* RELIABLE_ORDERED unless set otherwise */
+    void setChannelDelivery(ReliableChannel::ChannelId channel,
+        ReliableChannel::Delivery delivery);
+    /* Which channel sends first when more is waiting than the path takes:
+     * a higher priority always, the same priority by the weights.
+    **/
+    void setChannelPriority(ReliableChannel::ChannelId channel,
+        SendScheduler::Priority priority, unsigned weight = 1);
+    /* how long the messages of the channel waited for the others */
+    SendScheduler::ClassStatistics getChannelStatistics(
+        ReliableChannel::ChannelId channel);
+    size_t maxMessageSize() const;
+    /* the clock the channel runs on, for the ones that read none either */
+    static ReliableChannel::Milliseconds currentTime();
+
+    /* Bytes of reliable messages not sent yet. Callbacks::bufferedAmountLow
+     * follows when they drop to the threshold again.
+    **/
+    size_t getBufferedAmount();
+    size_t getBufferedAmountLowThreshold();
+    void setBufferedAmountLowThreshold(size_t bytes);
+
+    /* LOSS_BASED by default; LEDBAT for bulk transfers that should yield
+     * to everything else.
+    **/
+    void setCongestionControl(CongestionController::Mode mode);
+    CongestionController::State getCongestionState();
+
+    /* Called on the reactor thread for every packet of the component. */
+    void packetReceived(const PacketSlice& packet);
+    void channelTimerExpired();
+    /* Called on the reactor thread once ICE negotiation ends. */
+    void negotiationComplete(bool succeeded);
+
+    /* Starts closing the client without waiting for it: the client stops
+     * sending and calling back, then destroys its transport on the reactor
+     * thread and calls Callbacks::closed(). Deleting the client closes it
+     * as well, waiting for it to finish.
+    **/
+    void close();
+    bool isOpen() const;
     
 private:
+    static SessionDescriptorParser::Limits remoteDescriptionLimits();
+
     std::string initializeClient();
     void shutdownClient();
+    void finishClose();
+    void waitUntilClosed();
+    void requestChannelTimer();
+    void startChannelTimer();
+    static void startChannelTimerOf(const boost::weak_ptr<ICEClient*>& client);
+    void scheduleChannelTimer();
+    void cancelChannelTimer();
     void initializeTransport();
     void shutdownTransport();
     void initializeSession();
     void shutdownSession();
     
     std::string getLocalCandidates();
-    void resetRemoteCandidates();
+    void addRemoteCandidate(const StringView& candidate);
+    void startNegotiation();
 };
\ No newline at end of file
@@ -0,0 +1,448 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    ICERuntime.cpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Implementation of the pjlib stack shared by all ICEClients.
+**/
+
+/* STL includes */
+#include <iostream>
+
+/* Boost includes */
+#include <boost/thread/thread.hpp>
+#include <boost/weak_ptr.hpp>
+
+/* WebP2P includes */
+#include "ICERuntime.hpp"
+
+/* Sized for many clients: every ICE stream transport registers a STUN and a
+ * TURN socket per component with the ioqueue and keeps a few timers.
+**/
+enum { MAX_TIMER_ENTRIES = 1000 };
+
+/* Bounds of the number of network events handled per wake-up. */
+enum { MIN_NET_EVENTS = 1, MAX_NET_EVENTS = 64 };
+
+/* at namespace scope, so they exist before any client can be created */
+static boost::mutex                runtimeMutex;
+static boost::weak_ptr<ICERuntime> sharedRuntime;
+static unsigned                    configuredReactorCount = 0;
+
+boost::shared_ptr<ICERuntime> ICERuntime::acquire() {
+    boost::mutex::scoped_lock lock(runtimeMutex);
+    boost::shared_ptr<ICERuntime> runtime = sharedRuntime.lock();
+    if(!runtime) {
+        unsigned reactorCount = configuredReactorCount;
+        if(reactorCount == 0)
+            reactorCount = boost::thread::hardware_concurrency();
+        if(reactorCount == 0)
+            reactorCount = 1;
+        runtime.reset(new ICERuntime(reactorCount));
+        sharedRuntime = runtime;
+    }
+    return runtime;
+}
+
+void ICERuntime::setReactorCount(unsigned count) {
+    boost::mutex::scoped_lock lock(runtimeMutex);
+    configuredReactorCount = count;
+}
+
+ICERuntime::ICERuntime(unsigned reactorCount) :
+    poolFactoryCreated(false) {
+    std::string result = initialize(reactorCount);
+    if(result != "initialize() succeeded") {
+        std::cout << "ICERuntime: " << result << "\n";
+        initializationError = result;
+    }
+}
+
+ICERuntime::~ICERuntime() {
+    shutdown();
+}
+
+const std::string& ICERuntime::error() const {
+    return initializationError;
+}
+
+ICERuntime::Reactor* ICERuntime::attach() {
+    boost::mutex::scoped_lock lock(attachMutex);
+    if(reactors.empty())
+        return NULL;
+    Reactor* leastLoaded = reactors[0];
+    for(size_t i = 1; i < reactors.size(); i++) {
+        if(reactors[i]->clients < leastLoaded->clients)
+            leastLoaded = reactors[i];
+    }
+    leastLoaded->clients++;
+    return leastLoaded;
+}
+
+void ICERuntime::detach(Reactor* reactor) {
+    boost::mutex::scoped_lock lock(attachMutex);
+    if(reactor)
+        reactor->clients--;
+}
+
+unsigned ICERuntime::getReactorCount() const {
+    return reactors.size();
+}
+
+pj_pool_factory* ICERuntime::getPoolFactory() {
+    return &cp.factory;
+}
+
+size_t ICERuntime::getUsedMemory() const {
+    return cp.used_size;
+}
+
+std::string ICERuntime::initialize(unsigned reactorCount) {
+    pj_status_t status;
+
+    /* Initialize libraries */
+    status = pj_init();
+    if(status != PJ_SUCCESS) {
+        return std::string("pj_init() failed");
+    }
+    status = pjlib_util_init();
+    if(status != PJ_SUCCESS) {
+        return std::string("pjlib_util_init() failed");
+    }
+    status = pjnath_init();
+    if(status != PJ_SUCCESS) {
+        return std::string("pjnath_init() failed");
+    }
+
+    /* Create the caching pool factory */
+    pj_caching_pool_init(&cp, NULL, 0);
+    poolFactoryCreated = true;
+
+    /* Create the reactors */
+    for(unsigned i = 0; i < reactorCount; i++) {
+        reactors.push_back(new Reactor());
+        std::string result = reactors.back()->initialize(&cp.factory);
+        if(result != "initialize() succeeded")
+            return result;
+    }
+
+    return std::string("initialize() succeeded");
+}
+
+void ICERuntime::shutdown() {
+    /* The clients closed their transports on the reactor threads, so their
+     * TURN deallocations went out already. Ask all of the threads first, so
+     * they wind down in parallel.
+    **/
+    for(size_t i = 0; i < reactors.size(); i++) {
+        reactors[i]->threadQuitFlag = PJ_TRUE;
+        reactors[i]->wakeup();
+    }
+    for(size_t i = 0; i < reactors.size(); i++) {
+        reactors[i]->stop();
+        reactors[i]->destroy();
+        delete reactors[i];
+    }
+    reactors.clear();
+
+    if(poolFactoryCreated) {
+        pj_caching_pool_destroy(&cp);
+        pj_shutdown();
+    }
+}
+
+ICERuntime::Reactor::Reactor() :
+    pool(NULL),
+    timerHeap(NULL),
+    ioqueue(NULL),
+    resolver(NULL),
+    thread(NULL),
+    threadQuitFlag(PJ_FALSE),
+    clients(0),
+    eventBudget(MIN_NET_EVENTS),
+    wakeupSocket(PJ_INVALID_SOCKET),
+    wakeupKey(NULL) {
+}
+
+ICERuntime::Reactor::Statistics::Statistics() :
+    wakeups(0),
+    networkEvents(0),
+    timerEvents(0),
+    budgetExhausted(0),
+    maxEventsPerWakeup(0),
+    eventBudget(MIN_NET_EVENTS) {
+}
+
+ICERuntime::Reactor::Statistics ICERuntime::Reactor::getStatistics() const {
+    return statistics;
+}
+
+void ICERuntime::Reactor::post(const Job& job) {
+    bool wasEmpty;
+    {
+        boost::mutex::scoped_lock lock(jobMutex);
+        wasEmpty = jobs.empty();
+        jobs.push_back(job);
+    }
+    /* one datagram wakes the thread up for all of the queued jobs */
+    if(wasEmpty)
+        wakeup();
+}
+
+bool ICERuntime::Reactor::isCurrentThread() const {
+    return pj_thread_is_registered() && pj_thread_this() == thread;
+}
+
+void ICERuntime::Reactor::wakeup() {
+    if(wakeupKey == NULL)
+        return;
+    char byte = 0;
+    pj_ssize_t size = sizeof(byte);
+    pj_sock_sendto(wakeupSocket, &byte, &size, 0,
+        &wakeupAddress, sizeof(wakeupAddress));
+}
+
+void ICERuntime::Reactor::readWakeup() {
+    pj_ssize_t size = sizeof(wakeupBuffer);
+    pj_ioqueue_recv(wakeupKey, &wakeupOp, wakeupBuffer, &size,
+        PJ_IOQUEUE_ALWAYS_ASYNC);
+}
+
+void ICERuntime::Reactor::runJobs() {
+    std::vector<Job> pending;
+    {
+        boost::mutex::scoped_lock lock(jobMutex);
+        pending.swap(jobs);
+    }
+    for(size_t i = 0; i < pending.size(); i++)
+        pending[i]();
+}
+
+void ICERuntime::Reactor::onWakeup(
+    pj_ioqueue_key_t* key,
+    pj_ioqueue_op_key_t* op,
+    pj_ssize_t bytesRead) {
+    Reactor* reactor = static_cast<Reactor*>(pj_ioqueue_get_user_data(key));
+    reactor->runJobs();
+    reactor->readWakeup();
+}
+
+pj_timer_heap_t* ICERuntime::Reactor::getTimerHeap() const {
+    return timerHeap;
+}
+
+pj_ioqueue_t* ICERuntime::Reactor::getIOQueue() const {
+    return ioqueue;
+}
+
+pj_dns_resolver* ICERuntime::Reactor::getResolver() const {
+    return resolver;
+}
+
+static int worker_thread(void *Reactor_instance) {
+    while (!static_cast<ICERuntime::Reactor*>(Reactor_instance)
+        ->handleEvents(500, NULL)) {}
+
+    return 0;
+}
+
+pj_bool_t ICERuntime::Reactor::handleEvents(
+    unsigned max_msec, unsigned *p_count) {
+    pj_time_val max_timeout = {0, 0};
+    pj_time_val timeout = {0, 0};
+    pj_time_val deadline, now;
+    unsigned count = 0, net_event_count = 0;
+    bool exhausted = false;
+    int c;
+
+    max_timeout.msec = max_msec;
+
+    /* Poll the timer to run it and also to retrieve the earliest entry. */
+    timeout.sec = timeout.msec = 0;
+    c = pj_timer_heap_poll( timerHeap, &timeout );
+    if (c > 0) {
+        count += c;
+        statistics.timerEvents += c;
+    }
+
+    /* timer_heap_poll should never ever returns negative value, or otherwise
+     * ioqueue_poll() will block forever!
+     */
+    pj_assert(timeout.sec >= 0 && timeout.msec >= 0);
+    if (timeout.msec >= 1000) timeout.msec = 999;
+
+    /* compare the value with the timeout to wait from timer, and use the
+     * minimum value.
+     */
+    if (PJ_TIME_VAL_GT(timeout, max_timeout))
+        timeout = max_timeout;
+
+    /* the earliest timer must not wait for the network events */
+    pj_gettickcount(&deadline);
+    PJ_TIME_VAL_ADD(deadline, timeout);
+
+    /* Poll ioqueue.
+     * Keep draining ready events until the budget is used up, nothing is
+     * ready or the earliest timer is due. Polling the timer heap and the
+     * ioqueue again for every packet is what limits the throughput under
+     * sustained traffic. The budget doubles while wake-ups use all of it
+     * and halves while they use less than half of it, so an idle reactor
+     * still gets to its timers quickly.
+     */
+    do {
+        c = pj_ioqueue_poll(ioqueue, &timeout);
+        if (c < 0) {
+            //pj_status_t err = pj_get_netos_error();
+            pj_thread_sleep(PJ_TIME_VAL_MSEC(timeout));
+            if (p_count)
+                *p_count = count;
+            return threadQuitFlag;
+        } else if (c == 0) {
+            break;
+        }
+
+        net_event_count += c;
+        timeout.sec = timeout.msec = 0;
+        if (net_event_count >= eventBudget) {
+            exhausted = true;
+            break;
+        }
+        pj_gettickcount(&now);
+    } while (PJ_TIME_VAL_LT(now, deadline));
+
+    if (exhausted) {
+        statistics.budgetExhausted++;
+        if (eventBudget < MAX_NET_EVENTS)
+            eventBudget *= 2;
+    } else if (net_event_count < eventBudget / 2) {
+        eventBudget /= 2;
+    }
+
+    statistics.wakeups++;
+    statistics.networkEvents += net_event_count;
+    if (net_event_count > statistics.maxEventsPerWakeup)
+        statistics.maxEventsPerWakeup = net_event_count;
+    statistics.eventBudget = eventBudget;
+
+    count += net_event_count;
+    if (p_count)
+        *p_count = count;
+
+    return threadQuitFlag;
+}
+
+std::string ICERuntime::Reactor::initialize(pj_pool_factory* factory) {
+    pj_status_t status;
+
+    /* Create memory pool */
+    pool = pj_pool_create(factory, "web_p2p_reactor", 512, 512, NULL);
+    if(pool == NULL) {
+        return std::string("pj_pool_create() failed");
+    }
+
+    /* Create timer heap */
+    status = pj_timer_heap_create(pool, MAX_TIMER_ENTRIES, &timerHeap);
+    if(status != PJ_SUCCESS) {
+        return std::string("pj_timer_heap_create() failed");
+    }
+
+    /* Create ioqueue */
+    status = pj_ioqueue_create(pool, PJ_IOQUEUE_MAX_HANDLES, &ioqueue);
+    if(status != PJ_SUCCESS) {
+        return std::string("pj_ioqueue_create() failed");
+    }
+
+    /* Create the wakeup socket, which sends to itself over loopback */
+    status = pj_sock_socket(pj_AF_INET(), pj_SOCK_DGRAM(), 0, &wakeupSocket);
+    if(status != PJ_SUCCESS) {
+        return std::string("pj_sock_socket() failed");
+    }
+    pj_str_t localhost;
+    pj_cstr(&localhost, "127.0.0.1");
+    pj_sockaddr_in_init(&wakeupAddress, &localhost, 0);
+    int addressLength = sizeof(wakeupAddress);
+    status = pj_sock_bind(wakeupSocket, &wakeupAddress, addressLength);
+    if(status != PJ_SUCCESS) {
+        return std::string("pj_sock_bind() failed");
+    }
+    status = pj_sock_getsockname(wakeupSocket, &wakeupAddress, &addressLength);
+    if(status != PJ_SUCCESS) {
+        return std::string("pj_sock_getsockname() failed");
+    }
+    pj_ioqueue_callback wakeupCallback;
+    pj_bzero(&wakeupCallback, sizeof(wakeupCallback));
+    wakeupCallback.on_read_complete = &Reactor::onWakeup;
+    status = pj_ioqueue_register_sock(
+        pool, ioqueue, wakeupSocket, this, &wakeupCallback, &wakeupKey);
+    if(status != PJ_SUCCESS) {
+        return std::string("pj_ioqueue_register_sock() failed");
+    }
+    pj_ioqueue_op_key_init(&wakeupOp, sizeof(wakeupOp));
+    readWakeup();
+
+    /* Create event polling thread */
+    status = pj_thread_create(
+        pool, "web_p2p", &worker_thread, this, 0, 0, &thread);
+    if(status != PJ_SUCCESS) {
+        return std::string("pj_thread_create() failed");
+    }
+
+    /* Create DNS resolver, its callbacks run on this reactor as well */
+    pj_str_t dnsServer;
+    pj_cstr(&dnsServer, "8.8.8.8");
+    status = pj_dns_resolver_create(
+        factory, "resolver", 0, timerHeap, ioqueue, &resolver);
+    if(status != PJ_SUCCESS) {
+        return std::string("pj_dns_resolver() failed");
+    }
+    status = pj_dns_resolver_set_ns(resolver, 1, &dnsServer, NULL);
+    if(status != PJ_SUCCESS) {
+        return std::string("pj_dns_resolver_set_ns() failed");
+    }
+
+    return std::string("initialize() succeeded");
+}
+
+void ICERuntime::Reactor::stop() {
+    threadQuitFlag = PJ_TRUE;
+    wakeup();
+    if(thread) {
+        pj_thread_join(thread);
+        pj_thread_destroy(thread);
+        thread = NULL;
+    }
+}
+
+void ICERuntime::Reactor::destroy() {
+    if(resolver)
+        pj_dns_resolver_destroy(resolver, PJ_FALSE);
+
+    /* closes the socket as well */
+    if(wakeupKey)
+        pj_ioqueue_unregister(wakeupKey);
+    else if(wakeupSocket != PJ_INVALID_SOCKET)
+        pj_sock_close(wakeupSocket);
+
+    if(ioqueue)
+        pj_ioqueue_destroy(ioqueue);
+
+    if(timerHeap)
+        pj_timer_heap_destroy(timerHeap);
+
+    if(pool)
+        pj_pool_release(pool);
+}
@@ -0,0 +1,172 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    ICERuntime.hpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Definition of the pjlib stack that is shared by every
+ *              ICEClient in the process: one caching pool and a number of
+ *              reactors, each with its own ioqueue, timer heap, DNS
+ *              resolver and event polling thread.
+**/
+
+#pragma once
+
+/* STL includes */
+#include <string>
+#include <vector>
+
+/* Boost includes */
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+/* Fix architecture detection for Win32 by forcing i386 */
+#ifdef WIN32
+    #define PJ_M_I386
+#endif
+
+/* PJPROJECT headers */
+#include <pjnath.h>
+#include <pjlib.h>
+#include <pjlib-util.h>
+
+class ICERuntime : boost::noncopyable {
+public:
+    /* An event loop polled by a thread of its own. All of the sockets and
+     * timers of a client live in the same reactor, so the callbacks of one
+     * client never run concurrently.
+    **/
+    class Reactor : boost::noncopyable {
+    public:
+        /* Written by the reactor thread only, so a copy taken from another
+         * thread may be slightly behind.
+        **/
+        struct Statistics {
+            unsigned long long wakeups;
+            unsigned long long networkEvents;
+            unsigned long long timerEvents;
+            /* wake-ups that stopped draining because of the budget */
+            unsigned long long budgetExhausted;
+            unsigned           maxEventsPerWakeup;
+            unsigned           eventBudget;
+
+            Statistics();
+        };
+
+        typedef boost::function<void()> Job;
+
+    private:
+        pj_pool_t*         pool;
+        pj_timer_heap_t*   timerHeap;
+        pj_ioqueue_t*      ioqueue;
+        pj_dns_resolver*   resolver;
+        pj_thread_t*       thread;
+        volatile pj_bool_t threadQuitFlag;
+        /* clients attached, guarded by the runtime's attachMutex */
+        unsigned           clients;
+        /* network events handled per wake-up, adapted to the load */
+        unsigned           eventBudget;
+        Statistics         statistics;
+        /* a datagram to this socket ends the wait for events */
+        pj_sock_t           wakeupSocket;
+        pj_sockaddr_in      wakeupAddress;
+        pj_ioqueue_key_t*   wakeupKey;
+        pj_ioqueue_op_key_t wakeupOp;
+        char                wakeupBuffer[16];
+        boost::mutex        jobMutex;
+        std::vector<Job>    jobs;
+
+        friend class ICERuntime;
+
+    public:
+        Reactor();
+
+        pj_timer_heap_t*  getTimerHeap() const;
+        pj_ioqueue_t*     getIOQueue() const;
+        pj_dns_resolver*  getResolver() const;
+
+        /* Runs the expired timers and the pending network events, waiting
+         * at most max_msec for them. Returns true once the reactor stops.
+        **/
+        pj_bool_t handleEvents(unsigned max_msec, unsigned *p_count);
+
+        Statistics getStatistics() const;
+
+        /* Runs the job on the reactor thread, right away if the thread is
+         * waiting for events.
+        **/
+        void post(const Job& job);
+        bool isCurrentThread() const;
+
+    private:
+        std::string initialize(pj_pool_factory* factory);
+        void stop();
+        void destroy();
+
+        void wakeup();
+        void readWakeup();
+        void runJobs();
+        static void onWakeup(
+            pj_ioqueue_key_t* key,
+            pj_ioqueue_op_key_t* op,
+            pj_ssize_t bytesRead);
+    };
+
+private:
+    pj_caching_pool       cp;
+    bool                  poolFactoryCreated;
+    std::vector<Reactor*> reactors;
+    boost::mutex          attachMutex;
+    /* empty unless initialization failed */
+    std::string           initializationError;
+
+    ICERuntime(unsigned reactorCount);
+
+public:
+    /* The runtime is created by the first client that acquires it and torn
+     * down when the last reference to it goes away.
+    **/
+    static boost::shared_ptr<ICERuntime> acquire();
+
+    /* Number of reactors of the runtimes created after the call, 0 for one
+     * per processor core, which is the default.
+    **/
+    static void setReactorCount(unsigned count);
+
+    ~ICERuntime();
+
+    /* Why the runtime could not be initialized, empty if it was. */
+    const std::string& error() const;
+
+    /* The reactor with the fewest clients. Every attach() is matched by a
+     * detach() once the client has destroyed its sockets.
+    **/
+    Reactor* attach();
+    void detach(Reactor* reactor);
+
+    unsigned getReactorCount() const;
+
+    pj_pool_factory* getPoolFactory();
+
+    /* Bytes currently allocated from the caching pool by all clients. */
+    size_t getUsedMemory() const;
+
+private:
+    std::string initialize(unsigned reactorCount);
+    void shutdown();
+};
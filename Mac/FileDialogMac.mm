@@ -0,0 +1,50 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    FileDialogMac.mm
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: The file dialogs on the Mac, an NSOpenPanel for both.
+**/
+
+/* Cocoa includes */
+#import <Cocoa/Cocoa.h>
+
+/* WebP2P includes */
+#include "../FileDialog.hpp"
+
+static bool runPanel(bool directories, NSString* title, std::string& path) {
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    NSOpenPanel* panel = [NSOpenPanel openPanel];
+    [panel setTitle:title];
+    [panel setCanChooseFiles:!directories];
+    [panel setCanChooseDirectories:directories];
+    [panel setAllowsMultipleSelection:NO];
+    bool chosen = [panel runModal] == NSOKButton;
+    if(chosen)
+        path = [[[[panel URLs] objectAtIndex:0] path]
+            fileSystemRepresentation];
+    [pool release];
+    return chosen;
+}
+
+bool FileDialog::chooseFile(std::string& path) {
+    return runPanel(false, @"Send a file", path);
+}
+
+bool FileDialog::chooseDirectory(std::string& path) {
+    return runPanel(true, @"Save received files in", path);
+}
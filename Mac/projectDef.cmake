@@ -9,6 +9,7 @@
 # remember that the current source dir is the project root; this file is in Mac/
 file (GLOB PLATFORM RELATIVE ${CMAKE_CURRENT_SOURCE_DIR}
     Mac/[^.]*.cpp
+    Mac/[^.]*.mm
     Mac/[^.]*.h
     Mac/[^.]*.cmake
     )
@@ -51,12 +52,16 @@ find_library(PJ_NATH pjnath-i386-x86_64-apple-darwin10.4.0 /usr/local/lib)
 if(NOT PJ_NATH)
   message(FATAL_ERROR "Could not find pjnath-i386-x86_64-apple-darwin10.4.0")
 endif()
+# the file dialogs
+find_library(COCOA_FRAMEWORK Cocoa)
 
 target_link_libraries(${PROJNAME}
     ${PLUGIN_INTERNAL_DEPS}
+    webp2p_core
     ${PJ_LIB}
     ${PJ_LIB_UTIL}
     ${PJ_NATH}
+    ${COCOA_FRAMEWORK}
     )
 
 
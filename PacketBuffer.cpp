@@ -0,0 +1,173 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    PacketBuffer.cpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Implementation of the reference counted packet buffers and of
+ *              the pool that recycles them.
+**/
+
+/* STL includes */
+#include <algorithm>
+#include <cstring>
+
+/* Boost includes */
+#include <boost/thread/once.hpp>
+
+/* WebP2P includes */
+#include "PacketBuffer.hpp"
+
+PacketBuffer::PacketBuffer(PacketBufferPool* pool, size_t capacity) :
+    references(0),
+    pool(pool),
+    storage(new char[capacity]),
+    capacity(capacity) {
+}
+
+char* PacketBuffer::data() {
+    return storage.get();
+}
+
+const char* PacketBuffer::data() const {
+    return storage.get();
+}
+
+size_t PacketBuffer::getCapacity() const {
+    return capacity;
+}
+
+void intrusive_ptr_add_ref(PacketBuffer* buffer) {
+    ++buffer->references;
+}
+
+void intrusive_ptr_release(PacketBuffer* buffer) {
+    if(--buffer->references != 0)
+        return;
+    if(buffer->pool)
+        buffer->pool->recycle(buffer);
+    else
+        delete buffer;
+}
+
+PacketSlice::PacketSlice() :
+    offset(0),
+    length(0) {
+}
+
+PacketSlice::PacketSlice(
+    const PacketBufferPtr& buffer, size_t offset, size_t length) :
+    buffer(buffer),
+    offset(offset),
+    length(length) {
+}
+
+const char* PacketSlice::data() const {
+    return buffer ? buffer->data() + offset : NULL;
+}
+
+size_t PacketSlice::size() const {
+    return length;
+}
+
+bool PacketSlice::empty() const {
+    return length == 0;
+}
+
+PacketSlice PacketSlice::slice(size_t offset, size_t length) const {
+    offset = std::min(offset, this->length);
+    length = std::min(length, this->length - offset);
+    return PacketSlice(buffer, this->offset + offset, length);
+}
+
+std::string PacketSlice::toString() const {
+    return std::string(data() ? data() : "", length);
+}
+
+PacketBufferPool::Statistics::Statistics() :
+    allocated(0),
+    reused(0),
+    free(0) {
+}
+
+PacketBufferPool::PacketBufferPool(size_t bufferSize, size_t maxFree) :
+    bufferSize(bufferSize),
+    maxFree(maxFree) {
+}
+
+PacketBufferPool::~PacketBufferPool() {
+    for(size_t i = 0; i < freeBuffers.size(); i++)
+        delete freeBuffers[i];
+}
+
+PacketBufferPtr PacketBufferPool::acquire(size_t size) {
+    if(size > bufferSize) {
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            statistics.allocated++;
+        }
+        return PacketBufferPtr(new PacketBuffer(NULL, size));
+    }
+
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if(!freeBuffers.empty()) {
+            PacketBuffer* buffer = freeBuffers.back();
+            freeBuffers.pop_back();
+            statistics.reused++;
+            return PacketBufferPtr(buffer);
+        }
+        statistics.allocated++;
+    }
+    return PacketBufferPtr(new PacketBuffer(this, bufferSize));
+}
+
+PacketSlice PacketBufferPool::copy(const void* data, size_t size) {
+    PacketBufferPtr buffer = acquire(size);
+    if(size > 0)
+        std::memcpy(buffer->data(), data, size);
+    return PacketSlice(buffer, 0, size);
+}
+
+void PacketBufferPool::recycle(PacketBuffer* buffer) {
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if(freeBuffers.size() < maxFree) {
+            freeBuffers.push_back(buffer);
+            return;
+        }
+    }
+    delete buffer;
+}
+
+PacketBufferPool::Statistics PacketBufferPool::getStatistics() const {
+    boost::mutex::scoped_lock lock(mutex);
+    Statistics result = statistics;
+    result.free = freeBuffers.size();
+    return result;
+}
+
+static PacketBufferPool* sharedPool = NULL;
+static boost::once_flag  sharedPoolCreated = BOOST_ONCE_INIT;
+
+static void createSharedPool() {
+    sharedPool = new PacketBufferPool();
+}
+
+PacketBufferPool& PacketBufferPool::shared() {
+    boost::call_once(sharedPoolCreated, &createSharedPool);
+    return *sharedPool;
+}
@@ -0,0 +1,140 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    PacketBuffer.hpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Definition of the reference counted packet buffers and of the
+ *              pool that recycles them. Received data is handed out as
+ *              slices of these buffers, which can be kept and passed around
+ *              without copying the data.
+**/
+
+#pragma once
+
+/* STL includes */
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/* Boost includes */
+#include <boost/detail/atomic_count.hpp>
+#include <boost/intrusive_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread/mutex.hpp>
+
+class PacketBufferPool;
+
+class PacketBuffer : boost::noncopyable {
+    boost::detail::atomic_count references;
+    /* NULL for buffers too large for their pool, which are not recycled */
+    PacketBufferPool*           pool;
+    boost::scoped_array<char>   storage;
+    size_t                      capacity;
+
+    PacketBuffer(PacketBufferPool* pool, size_t capacity);
+
+    friend class PacketBufferPool;
+    friend void intrusive_ptr_add_ref(PacketBuffer* buffer);
+    friend void intrusive_ptr_release(PacketBuffer* buffer);
+
+public:
+    char*       data();
+    const char* data() const;
+    size_t      getCapacity() const;
+};
+
+void intrusive_ptr_add_ref(PacketBuffer* buffer);
+void intrusive_ptr_release(PacketBuffer* buffer);
+
+typedef boost::intrusive_ptr<PacketBuffer> PacketBufferPtr;
+
+/* A range of bytes in a packet buffer. Copying a slice only copies the
+ * reference, the buffer goes back to its pool with the last slice of it.
+**/
+class PacketSlice {
+    PacketBufferPtr buffer;
+    size_t          offset;
+    size_t          length;
+
+public:
+    PacketSlice();
+    PacketSlice(const PacketBufferPtr& buffer, size_t offset, size_t length);
+
+    const char* data() const;
+    size_t      size() const;
+    bool        empty() const;
+
+    /* Part of this slice, sharing its buffer. The range is clipped to the
+     * slice.
+    **/
+    PacketSlice slice(size_t offset, size_t length) const;
+
+    /* Copies the bytes, for the consumers that need a string after all. */
+    std::string toString() const;
+};
+
+/* Hands out buffers of one size and keeps the released ones for reuse. It
+ * is safe to use from several threads, and it has to outlive its buffers.
+**/
+class PacketBufferPool : boost::noncopyable {
+public:
+    /* Enough for any datagram over an Ethernet path */
+    enum { DEFAULT_BUFFER_SIZE = 2048, DEFAULT_MAX_FREE = 256 };
+
+    struct Statistics {
+        /* buffers taken from the heap, including the oversized ones */
+        unsigned long long allocated;
+        /* buffers handed out again instead of being allocated */
+        unsigned long long reused;
+        size_t             free;
+
+        Statistics();
+    };
+
+private:
+    size_t                     bufferSize;
+    size_t                     maxFree;
+    mutable boost::mutex       mutex;
+    std::vector<PacketBuffer*> freeBuffers;
+    Statistics                 statistics;
+
+    void recycle(PacketBuffer* buffer);
+
+    friend void intrusive_ptr_release(PacketBuffer* buffer);
+
+public:
+    PacketBufferPool(
+        size_t bufferSize = DEFAULT_BUFFER_SIZE,
+        size_t maxFree = DEFAULT_MAX_FREE);
+    ~PacketBufferPool();
+
+    /* A buffer of at least size bytes. Larger ones than the pool's buffer
+     * size are allocated for the occasion and freed when released.
+    **/
+    PacketBufferPtr acquire(size_t size);
+
+    /* A slice of a buffer holding a copy of the data. */
+    PacketSlice copy(const void* data, size_t size);
+
+    Statistics getStatistics() const;
+
+    /* The pool of the received packets. It is never destroyed, so slices
+     * can be released at any time, even during static destruction.
+    **/
+    static PacketBufferPool& shared();
+};
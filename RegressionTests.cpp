@@ -22,12 +22,20 @@
 **/
 
 /* STL includes */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sstream>
 #include <vector>
 #include <utility>
 
 /* Boost includes */
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/thread/thread.hpp>
-#include <boost/spirit/home/phoenix/container.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/spirit/include/phoenix_container.hpp>
 #include <boost/spirit/include/karma.hpp>
 
 /* Firebreath includes */
@@ -37,8 +45,20 @@
 #include "RegressionTests.hpp"
 
 /* Test includes */
+#include "Benchmarks.hpp"
 #include "AddrSpecGrammar.hpp"
+#include "BitmapTransfer.hpp"
+#include "FileTransfer.hpp"
+#include "ICEClient.hpp"
+#include "ICERuntime.hpp"
+#include "PacketBuffer.hpp"
+#include "ReliableChannel.hpp"
+#include "SendScheduler.hpp"
 #include "SessionDescriptorGrammar.hpp"
+#include "SessionDescriptorParser.hpp"
+#include "SessionDescriptorStreamParser.hpp"
+#include "SessionDescriptorViewGrammar.hpp"
+#include "SessionDescriptorWriter.hpp"
 #include "URIReferenceGrammar.hpp"
 
 enum TestResult { TEST_FAILED, TEST_SUCCEEDED };
@@ -54,7 +74,7 @@ struct GrammarTests {
         
         std::string::const_iterator f = s.begin();
         std::string::const_iterator l = s.end();
-        phrase_parse(f, l, r, !byte_);
+        parse(f, l, r);
         
         TestResult res;
         if(shouldMatch) {
@@ -72,6 +92,7 @@ struct GrammarTests {
         runSessionDescriptorGenericGrammarTests(callback);
         runURIReferenceGrammarTests(callback);
         runSessionDescriptorGrammarTests(callback);
+        runSessionDescriptorViewGrammarTests(callback);
     }
     
     template<typename F> static void runAddrSpecTests(F callback) {
@@ -178,6 +199,1856 @@ struct GrammarTests {
         grammarTest("connection-address", "FE80::D69A:20FF:FE71:B84C", sdg.connection_address, callback, true);
         grammarTest("connection-address", "www.g00-gl3.com", sdg.connection_address, callback, true);
     }
+
+    template<typename F> static void runSessionDescriptorViewGrammarTests(F callback) {
+        SessionDescriptorViewGrammar sdvg;
+
+        grammarTest("view media-field", "m=audio 50016 RTP/AVP 0\r\n", sdvg.media_field, callback, true);
+        grammarTest("view connection-field", "c=IN IP4 218.186.177.16\r\n", sdvg.connection_field, callback, true);
+        grammarTest("view attribute", "ice-ufrag:3f6a2b1c", sdvg.attribute, callback, true);
+        grammarTest("view attribute", "recvonly", sdvg.attribute, callback, true);
+        grammarTest("!view attribute", ":novalue", sdvg.attribute, callback, false);
+        grammarTest("view session-description", GrammarBenchmarks::localCandidatesSDP(), sdvg.session_description, callback, true);
+    }
+};
+
+struct SessionDescriptorParserTests {
+    /* the ids and indexes are left out of the data, compared apart */
+    static bool sameAttributes(
+        const std::vector<AttributeView>& a, const AttributeIndex& aIndex,
+        const std::vector<AttributeView>& b, const AttributeIndex& bIndex) {
+        if(a.size() != b.size())
+            return false;
+        for(size_t i = 0; i < a.size(); i++)
+            if(a[i].id != b[i].id)
+                return false;
+        for(unsigned n = 1; n < ATTRIBUTE_NAME_COUNT; n++) {
+            AttributeName name = static_cast<AttributeName>(n);
+            const AttributeView* x = aIndex.find(a, name);
+            const AttributeView* y = bIndex.find(b, name);
+            if((x ? x - &a[0] : -1) != (y ? y - &b[0] : -1))
+                return false;
+        }
+        return true;
+    }
+
+    static bool sameAttributes(const SessionDescriptorView& a,
+        const SessionDescriptorView& b) {
+        if(!sameAttributes(a.sessionAttributes, a.sessionAttributeIndex,
+            b.sessionAttributes, b.sessionAttributeIndex)
+            || a.mediaDescriptions.size() != b.mediaDescriptions.size())
+            return false;
+        for(size_t i = 0; i < a.mediaDescriptions.size(); i++) {
+            const MediaDescriptionView& x = a.mediaDescriptions[i];
+            const MediaDescriptionView& y = b.mediaDescriptions[i];
+            if(!sameAttributes(x.mediaAttributes, x.mediaAttributeIndex,
+                y.mediaAttributes, y.mediaAttributeIndex))
+                return false;
+        }
+        return true;
+    }
+
+    /* Runs SessionDescriptorParser and SessionDescriptorViewGrammar on the
+     * same input; both must agree on whether it matches and on the data they
+     * produce. Whenever the stricter SessionDescriptorGrammar accepts the
+     * input its data has to be the same as well.
+    **/
+    template<typename F> static void differentialTest(
+        const std::string& n,
+        const std::string& s,
+        F callback,
+        bool shouldMatch = true) {
+        using namespace boost::spirit::qi;
+
+        SessionDescriptorView fast, reference;
+        bool fastMatch = SessionDescriptorParser::parse(s, fast);
+
+        std::string::const_iterator f = s.begin();
+        std::string::const_iterator l = s.end();
+        bool referenceMatch = parse(f, l,
+            SessionDescriptorViewGrammar::instance(), reference) && f == l;
+
+        TestResult res = (fastMatch == referenceMatch
+            && fastMatch == shouldMatch) ? TEST_SUCCEEDED : TEST_FAILED;
+        if(res == TEST_SUCCEEDED && fastMatch) {
+            SessionDescriptorData fastData, referenceData, strictData;
+            fast.materialize(fastData);
+            reference.materialize(referenceData);
+            if(!(fastData == referenceData)
+                || !sameAttributes(fast, reference))
+                res = TEST_FAILED;
+
+            f = s.begin();
+            if(parse(f, l, SessionDescriptorGrammar::instance(),
+                strictData) && f == l && !(strictData == fastData))
+                res = TEST_FAILED;
+        }
+
+        std::string testName = "Differential test: " + n + " (" + s + ")";
+        std::string testResult = (res == TEST_SUCCEEDED) ? "SUCCEEDED" : "FAILED";
+        callback(testName, testResult);
+    }
+
+    /* Both the single-pass and the stream parser must report the same
+     * error for a rejected message.
+    **/
+    template<typename F> static void errorTest(
+        const std::string& n,
+        const std::string& s,
+        F callback,
+        SessionDescriptorParser::Error::Code code,
+        size_t offset,
+        const std::string& expected) {
+        SessionDescriptorView view;
+        SessionDescriptorParser::Error error;
+        bool match = SessionDescriptorParser::parse(s, view, error);
+
+        SessionDescriptorStreamParser::Handler handler;
+        SessionDescriptorStreamParser parser(handler);
+        bool streamMatch = parser.feed(s) && parser.finish();
+        const SessionDescriptorParser::Error& streamError = parser.error();
+
+        bool success = !match && !streamMatch
+            && error.code == code && streamError.code == code
+            && error.offset == offset && streamError.offset == offset
+            && error.expected == expected && streamError.expected == expected;
+
+        std::string testName = "Error test: " + n + " (" + s + ")";
+        std::string testResult = success ? "SUCCEEDED" : "FAILED";
+        callback(testName, testResult);
+    }
+
+    /* Both parsers must accept input at the limit and reject input beyond
+     * it with LIMIT_EXCEEDED.
+    **/
+    template<typename F> static void limitTest(
+        const std::string& n,
+        const std::string& atLimit,
+        const std::string& overLimit,
+        const SessionDescriptorParser::Limits& limits,
+        F callback,
+        const std::string& limitName) {
+        typedef SessionDescriptorParser::Error E;
+        SessionDescriptorView view;
+        SessionDescriptorStreamParser::Handler handler;
+        SessionDescriptorStreamParser parser(handler, limits);
+        E error;
+
+        bool success = SessionDescriptorParser::parse(
+            atLimit, view, error, limits);
+        success = success && parser.feed(atLimit) && parser.finish();
+
+        parser.reset();
+        success = success
+            && !SessionDescriptorParser::parse(overLimit, view, error, limits)
+            && error.code == E::LIMIT_EXCEEDED && error.expected == limitName
+            && !(parser.feed(overLimit) && parser.finish())
+            && parser.error().code == E::LIMIT_EXCEEDED
+            && parser.error().expected == limitName
+            && parser.error().offset == error.offset;
+
+        std::string testName = "Limit test: " + n;
+        std::string testResult = success ? "SUCCEEDED" : "FAILED";
+        callback(testName, testResult);
+    }
+
+    /* Every well-known name must get its own perfect hash slot, and the
+     * per-section index must find the first attribute with a name.
+    **/
+    template<typename F> static void attributeNameTests(F callback) {
+        using boost::algorithm::equals;
+
+        bool perfect = true;
+        for(unsigned i = 1; i < ATTRIBUTE_NAME_COUNT; i++) {
+            const std::string& name
+                = AttributeNames::toString(static_cast<AttributeName>(i));
+            if(AttributeNames::lookup(name.data(), name.size()) != i)
+                perfect = false;
+        }
+        callback("Attribute name test: perfect hash",
+            perfect ? "SUCCEEDED" : "FAILED");
+
+        bool unknown = AttributeNames::lookup("candidatf", 9) == ATTRIBUTE_UNKNOWN
+            && AttributeNames::lookup("ice-ufraG", 9) == ATTRIBUTE_UNKNOWN
+            && AttributeNames::lookup("x", 1) == ATTRIBUTE_UNKNOWN;
+        callback("Attribute name test: unknown names",
+            unknown ? "SUCCEEDED" : "FAILED");
+
+        const std::string s = "v=0\no=- 1 1 IN IP4 h\ns=-\nt=0 0\n"
+            "a=ice-pwd:first\na=x-foo\na=ice-pwd:second\n"
+            "m=audio 1 RTP/AVP 0\na=candidate:1\na=rtcp:2\n";
+        SessionDescriptorView view;
+        bool indexed = view.parse(s)
+            && view.findSessionAttribute(ATTRIBUTE_ICE_PWD) != NULL
+            && equals(view.findSessionAttribute(ATTRIBUTE_ICE_PWD)->value, "first")
+            && view.findSessionAttribute(ATTRIBUTE_ICE_UFRAG) == NULL
+            && view.findSessionAttribute(ATTRIBUTE_RTCP) == NULL
+            && view.mediaDescriptions[0].findAttribute(ATTRIBUTE_RTCP) != NULL
+            && equals(view.mediaDescriptions[0].findAttribute(ATTRIBUTE_RTCP)->value, "2");
+        callback("Attribute name test: section index (" + s + ")",
+            indexed ? "SUCCEEDED" : "FAILED");
+    }
+
+    template<typename F> static void candidateTest(
+        const std::string& n,
+        const std::string& s,
+        F callback,
+        bool shouldMatch = true) {
+        CandidateView candidate;
+        bool match = SessionDescriptorParser::parseCandidate(
+            s.begin(), s.end(), candidate);
+
+        std::string testName = "Candidate test: " + n + " (" + s + ")";
+        std::string testResult = (match == shouldMatch) ? "SUCCEEDED" : "FAILED";
+        callback(testName, testResult);
+    }
+
+    /* Checks every field of a candidate with related address and
+     * extension attributes.
+    **/
+    template<typename F> static void candidateFieldsTest(F callback) {
+        using boost::algorithm::equals;
+
+        const std::string s = "S1 1 UDP 1694498815 218.186.177.16 50016 "
+            "typ srflx raddr 192.168.1.100 rport 50017 generation 0";
+        CandidateView c;
+        bool success = SessionDescriptorParser::parseCandidate(
+            s.begin(), s.end(), c)
+            && equals(c.foundation, "S1")
+            && c.componentID == 1
+            && equals(c.transport, "UDP")
+            && c.priority == 1694498815u
+            && equals(c.connectionAddress, "218.186.177.16")
+            && c.port == 50016
+            && equals(c.type, "srflx")
+            && equals(c.relatedAddress, "192.168.1.100")
+            && c.relatedPort == 50017
+            && c.extensions.size() == 1
+            && equals(c.extensions[0].name, "generation")
+            && equals(c.extensions[0].value, "0");
+
+        callback("Candidate test: all fields (" + s + ")",
+            success ? "SUCCEEDED" : "FAILED");
+    }
+
+    template<typename F> static void runTests(F callback) {
+        const std::string sdp = GrammarBenchmarks::localCandidatesSDP();
+        const std::string head = "v=0\no=- 1 1 IN IP4 host.example.com\ns=-\n";
+
+        differentialTest("local candidates", sdp, callback, true);
+        differentialTest("CRLF", "v=0\r\no=- 1 2 IN IP4 127.0.0.1\r\ns=-\r\nt=0 0\r\n", callback, true);
+        differentialTest("CR", "v=0\ro=- 1 2 IN IP4 127.0.0.1\rs=-\rt=0 0\r", callback, true);
+        differentialTest("multiple t=", head + "t=0 0\nt=1 2\n", callback, true);
+        differentialTest("property attribute", head + "t=0 0\na=recvonly\n", callback, true);
+        differentialTest("multiple media", head + "t=0 0\nm=audio 1 RTP/AVP 0 8\nm=video 2 RTP/AVP 31\nc=IN IP4 10.0.0.1\nc=IN IP4 10.0.0.2\na=rtcp:3\n", callback, true);
+        differentialTest("IPv6 origin", "v=0\no=- 1 1 IN IP6 FE80::D69A:20FF:FE71:B84C\ns=-\nt=0 0\n", callback, true);
+        /* a byte-string holds no NUL */
+        differentialTest("NUL in session name", "v=0\no=- 1 1 IN IP4 host.example.com\ns=a" + std::string(1, '\0') + "b\nt=0 0\n", callback, false);
+        differentialTest("NUL in attribute value", head + "t=0 0\na=tool:a" + std::string(1, '\0') + "b\n", callback, false);
+
+        differentialTest("!empty", "", callback, false);
+        differentialTest("!missing terminator", head + "t=0 0", callback, false);
+        differentialTest("!missing t=", head, callback, false);
+        differentialTest("!unsupported field", head + "i=info\nt=0 0\n", callback, false);
+        differentialTest("!session c=", head + "t=0 0\nc=IN IP4 10.0.0.1\n", callback, false);
+        differentialTest("!c= after a=", head + "t=0 0\nm=audio 1 RTP/AVP 0\na=x\nc=IN IP4 10.0.0.1\n", callback, false);
+        differentialTest("!empty attribute value", head + "t=0 0\na=ice-pwd:\n", callback, false);
+        differentialTest("!port overflow", head + "t=0 0\nm=audio 65536 RTP/AVP 0\n", callback, false);
+        differentialTest("!session id overflow", "v=0\no=- 18446744073709551616 1 IN IP4 h.com\ns=-\nt=0 0\n", callback, false);
+        differentialTest("!double space", head + "t=0  0\n", callback, false);
+        differentialTest("!missing format", head + "t=0 0\nm=audio 1 RTP/AVP\n", callback, false);
+        differentialTest("!trailing slash in proto", head + "t=0 0\nm=audio 1 RTP/ 0\n", callback, false);
+        differentialTest("!version twice", "v=0\n" + head + "t=0 0\n", callback, false);
+
+        typedef SessionDescriptorParser::Error E;
+        errorTest("empty", "", callback, E::INCOMPLETE, 0, "proto-version");
+        errorTest("missing terminator", head + "t=0 0", callback, E::MISSING_LINE_TERMINATOR, head.size() + 5, "eol");
+        errorTest("malformed line", head + "t0 0\n", callback, E::MALFORMED_LINE, head.size(), "time-fields");
+        errorTest("unexpected line", head + "c=IN IP4 10.0.0.1\n", callback, E::UNEXPECTED_LINE, head.size(), "time-fields");
+        errorTest("invalid value", head + "t=0 0\nm=audio x RTP/AVP 0\n", callback, E::INVALID_VALUE, head.size() + 8, "media-field");
+        errorTest("NUL in attribute value", head + "t=0 0\na=tool:" + std::string(1, '\0') + "\n", callback, E::INVALID_VALUE, head.size() + 8, "attribute");
+        errorTest("incomplete", head, callback, E::INCOMPLETE, head.size(), "time-fields");
+
+        SessionDescriptorParser::Limits limits;
+        limits.maxLineLength = 16;
+        limits.maxLines = 6;
+        limits.maxAttributes = 1;
+        limits.maxMediaDescriptions = 1;
+        limits.maxCandidates = 1;
+        const std::string small = "v=0\no=- 1 1 IN IP4 h\ns=-\nt=0 0\n";
+        limitTest("line length", small + "a=" + std::string(14, 'x') + "\r\n", small + "a=" + std::string(15, 'x') + "\r\n", limits, callback, "maxLineLength");
+        limitTest("lines", small + "t=0 0\nt=0 0\n", small + "t=0 0\nt=0 0\nt=0 0\n", limits, callback, "maxLines");
+        limitTest("attributes", small + "a=x\n", small + "a=x\na=y\n", limits, callback, "maxAttributes");
+        limitTest("media", small + "m=audio 1 RTP 0\n", small + "m=audio 1 RTP 0\nm=audio 1 RTP 0\n", limits, callback, "maxMediaDescriptions");
+        limits.maxLines = 8;
+        limits.maxAttributes = 2;
+        limitTest("candidates", small + "m=audio 1 RTP 0\na=candidate:x\n", small + "m=audio 1 RTP 0\na=candidate:x\na=candidate:y\n", limits, callback, "maxCandidates");
+
+        attributeNameTests(callback);
+        candidateFieldsTest(callback);
+        candidateTest("host", "H1 1 UDP 2130706431 192.168.1.100 50016 typ host", callback, true);
+        candidateTest("IPv6 host", "1 1 udp 2130706431 FE80::D69A:20FF:FE71:B84C 9 typ host", callback, true);
+        candidateTest("related address only", "R1 1 UDP 16777215 216.146.46.55 49170 typ relay raddr 10.0.0.5", callback, true);
+        candidateTest("!missing type", "H1 1 UDP 2130706431 192.168.1.100 50016", callback, false);
+        candidateTest("!long foundation", std::string(33, 'a') + " 1 UDP 1 10.0.0.1 1 typ host", callback, false);
+        candidateTest("!priority overflow", "H1 1 UDP 4294967296 10.0.0.1 1 typ host", callback, false);
+        candidateTest("!dangling extension", "H1 1 UDP 1 10.0.0.1 1 typ host generation", callback, false);
+    }
+};
+
+struct SessionDescriptorStreamParserTests {
+    /* Writes every event to a string so runs can be compared. */
+    class EventLog : public SessionDescriptorStreamParser::Handler {
+    public:
+        std::string log;
+
+        void origin(const OriginView& o) {
+            log += "o " + std::string(o.unicastAddress.begin(),
+                o.unicastAddress.end()) + "\n";
+        }
+        void sessionAttribute(const AttributeView& a) {
+            log += "session a " + std::string(a.name.begin(), a.name.end())
+                + "=" + std::string(a.value.begin(), a.value.end()) + "\n";
+        }
+        void mediaDescription(const MediaView& m) {
+            log += "m " + std::string(m.mediaName.begin(), m.mediaName.end())
+                + "\n";
+        }
+        void connectionData(const ConnectionDataView& c) {
+            log += "c " + std::string(c.connectionAddress.begin(),
+                c.connectionAddress.end()) + "\n";
+        }
+        void mediaAttribute(const AttributeView& a) {
+            log += "media a " + std::string(a.name.begin(), a.name.end())
+                + "=" + std::string(a.value.begin(), a.value.end()) + "\n";
+        }
+        void candidate(const StringView& c) {
+            log += "candidate " + std::string(c.begin(), c.end()) + "\n";
+        }
+    };
+
+    static bool feed(const std::string& s, size_t split, EventLog& events) {
+        SessionDescriptorStreamParser parser(events);
+        parser.feed(s.substr(0, split));
+        parser.feed(s.substr(split));
+        return parser.finish();
+    }
+
+    /* Splitting the input at any position, or feeding it one byte at a time,
+     * must give the same events and the same result as SessionDescriptorParser.
+    **/
+    template<typename F> static void chunkTest(
+        const std::string& n,
+        const std::string& s,
+        F callback,
+        bool shouldMatch = true) {
+        SessionDescriptorView view;
+        EventLog whole;
+        bool match = feed(s, s.size(), whole);
+        TestResult res = (match == shouldMatch
+            && match == SessionDescriptorParser::parse(s, view))
+            ? TEST_SUCCEEDED : TEST_FAILED;
+
+        for(size_t split = 0; split < s.size(); split++) {
+            EventLog events;
+            if(feed(s, split, events) != match || events.log != whole.log)
+                res = TEST_FAILED;
+        }
+
+        EventLog bytewise;
+        SessionDescriptorStreamParser parser(bytewise);
+        for(size_t i = 0; i < s.size(); i++)
+            parser.feed(&s[i], 1);
+        if(parser.finish() != match || bytewise.log != whole.log)
+            res = TEST_FAILED;
+
+        std::string testName = "Stream parser test: " + n + " (" + s + ")";
+        std::string testResult = (res == TEST_SUCCEEDED) ? "SUCCEEDED" : "FAILED";
+        callback(testName, testResult);
+    }
+
+    template<typename F> static void runTests(F callback) {
+        const std::string head = "v=0\no=- 1 1 IN IP4 host.example.com\ns=-\n";
+
+        chunkTest("local candidates", GrammarBenchmarks::localCandidatesSDP(), callback, true);
+        chunkTest("CRLF", "v=0\r\no=- 1 2 IN IP4 127.0.0.1\r\ns=-\r\nt=0 0\r\na=ice-ufrag:x\r\n", callback, true);
+        chunkTest("CR", "v=0\ro=- 1 2 IN IP4 127.0.0.1\rs=-\rt=0 0\ra=ice-ufrag:x\r", callback, true);
+        chunkTest("multiple media", head + "t=0 0\nm=audio 1 RTP/AVP 0\na=candidate:1 1 UDP 1 10.0.0.1 1 typ host\nm=video 2 RTP/AVP 31\nc=IN IP4 10.0.0.2\na=rtcp:3\n", callback, true);
+
+        chunkTest("!missing terminator", head + "t=0 0", callback, false);
+        chunkTest("!missing t=", head, callback, false);
+        chunkTest("!session c=", head + "t=0 0\na=x\nc=IN IP4 10.0.0.1\nm=audio 1 RTP/AVP 0\n", callback, false);
+    }
+};
+
+struct SessionDescriptorWriterTests {
+    /* parse(serialize(x)) == x for the owning data structure, and the view
+     * serializes to the same text as the data it materializes to.
+    **/
+    template<typename F> static void roundTripTest(
+        const std::string& n,
+        const std::string& s,
+        F callback) {
+        SessionDescriptorView view, reparsedView;
+        SessionDescriptorData data, reparsed;
+        std::string fromData, fromView;
+
+        bool success = view.parse(s);
+        if(success) {
+            view.materialize(data);
+            StringBuffer dataBuffer(fromData);
+            SessionDescriptorWriter<StringBuffer>(dataBuffer).write(data);
+            StringBuffer viewBuffer(fromView);
+            SessionDescriptorWriter<StringBuffer>(viewBuffer).write(view);
+
+            success = fromData == fromView && reparsedView.parse(fromData);
+        }
+        if(success) {
+            reparsedView.materialize(reparsed);
+            success = reparsed == data;
+        }
+
+        std::string testName = "Round trip test: " + n + " (" + s + ")";
+        std::string testResult = success ? "SUCCEEDED" : "FAILED";
+        callback(testName, testResult);
+    }
+
+    template<typename F> static void runTests(F callback) {
+        const std::string head = "v=0\no=- 1 1 IN IP4 host.example.com\ns=-\n";
+
+        roundTripTest("local candidates", GrammarBenchmarks::localCandidatesSDP(), callback);
+        roundTripTest("CRLF", "v=0\r\no=- 1 2 IN IP4 127.0.0.1\r\ns=-\r\nt=0 0\r\n", callback);
+        roundTripTest("multiple media", head + "t=0 0\nt=1 2\na=recvonly\nm=audio 1 RTP/AVP 0 8\nm=video 2 RTP/AVP 31\nc=IN IP4 10.0.0.1\nc=IN IP4 10.0.0.2\na=rtcp:3\n", callback);
+        roundTripTest("large numbers", "v=18446744073709551615\no=- 18446744073709551615 0 IN IP4 h.com\ns=-\nt=4294967296 0\nm=audio 65535 RTP/AVP 0\n", callback);
+
+        FixedBuffer<8> fixed;
+        SessionDescriptorWriter<FixedBuffer<8> > w(fixed);
+        w.number(1234567).character(' ');
+        bool fits = !fixed.overflowed()
+            && std::string(fixed.data(), fixed.size()) == "1234567 ";
+        w.character('x');
+        callback("Fixed buffer test: overflow",
+            (fits && fixed.overflowed() && fixed.size() == 8)
+            ? "SUCCEEDED" : "FAILED");
+    }
+};
+
+struct PacketBufferTests {
+    template<typename F> static void runTests(F callback) {
+        PacketBufferPool pool(64, 2);
+
+        /* a slice keeps its buffer, the buffer is recycled with the last */
+        const char* first;
+        {
+            PacketSlice a = pool.copy("hello world", 11);
+            PacketSlice b = a.slice(6, 100);
+            first = a.data();
+            a = PacketSlice();
+            callback("Packet buffer test: slice outlives the original",
+                b.toString() == "world" && b.data() == first + 6
+                    ? "SUCCEEDED" : "FAILED");
+        }
+        {
+            PacketSlice c = pool.copy("again", 5);
+            PacketBufferPool::Statistics statistics = pool.getStatistics();
+            callback("Packet buffer test: released buffer is reused",
+                c.data() == first && statistics.allocated == 1
+                    && statistics.reused == 1 ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* oversized buffers are not kept, and neither are too many */
+        {
+            PacketSlice large = pool.copy(std::string(100, 'x').data(), 100);
+            PacketSlice s1 = pool.copy("1", 1);
+            PacketSlice s2 = pool.copy("2", 1);
+            PacketSlice s3 = pool.copy("3", 1);
+            large = s1 = s2 = s3 = PacketSlice();
+        }
+        callback("Packet buffer test: free list is bounded",
+            pool.getStatistics().free == 2 ? "SUCCEEDED" : "FAILED");
+
+        PacketSlice empty = pool.copy(NULL, 0);
+        callback("Packet buffer test: empty slice",
+            empty.empty() && empty.toString().empty()
+                && PacketSlice().toString().empty() ? "SUCCEEDED" : "FAILED");
+    }
+};
+
+struct ReliableChannelTests {
+    /* Keeps what a single channel sends and delivers. */
+    struct Capture : ReliableChannel::Link, ReliableChannel::Handler {
+        std::vector<std::string> packets;
+        std::vector<std::string> messages;
+        std::vector<ReliableChannel::ChannelId> channels;
+
+        void sendPacket(const char* data, size_t size) {
+            packets.push_back(std::string(data, size));
+        }
+        void messageReceived(ReliableChannel::ChannelId channel,
+            const PacketSlice& message, bool reliable) {
+            messages.push_back(message.toString());
+            channels.push_back(channel);
+        }
+    };
+
+    static std::string number(unsigned i) {
+        std::stringstream ss;
+        ss << "message " << i;
+        return ss.str();
+    }
+
+    /* a message that differs from the others all along */
+    static std::string large(unsigned i, size_t size) {
+        std::string message(size, '\0');
+        for(size_t j = 0; j < size; j++)
+            message[j] = static_cast<char>('a' + (i + j) % 26);
+        return message;
+    }
+
+    static void feed(ReliableChannel& channel, const std::string& packet,
+        ReliableChannel::Milliseconds now) {
+        channel.packetReceived(
+            PacketBufferPool::shared().copy(packet.data(), packet.size()), now);
+    }
+
+    template<typename F> static void runTests(F callback) {
+        /* everything arrives, in order, despite the loss */
+        {
+            SimulatedPath path(20, 10, 100);
+            for(unsigned i = 0; i < 500; i++) {
+                std::string m = number(i);
+                path.a.channel.send(m.data(), m.size(), true, path.now);
+                path.runUntil(path.now + 1);
+            }
+            path.run();
+            bool inOrder = path.b.messages.size() == 500;
+            for(unsigned i = 0; inOrder && i < 500; i++)
+                inOrder = path.b.messages[i] == number(i);
+            callback("Reliable channel test: ordered delivery with 10% loss",
+                inOrder && path.packetsLost > 0
+                    && path.a.channel.getUnacknowledgedCount() == 0
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* unreliable messages are neither acknowledged nor retransmitted */
+        {
+            SimulatedPath path(20, 10, 0);
+            path.a.channel.send("datagram", 8, false, path.now);
+            bool idle = path.a.channel.nextTimeout() == ReliableChannel::NEVER;
+            path.run();
+            callback("Reliable channel test: unreliable pass-through",
+                idle && path.b.messages.size() == 1
+                    && path.b.messages[0] == "datagram"
+                    && path.b.channel.getStatistics().acknowledgementsSent == 0
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* a retransmission that crossed the acknowledgement */
+        {
+            Capture capture;
+            ReliableChannel channel(capture, capture);
+            std::string data("\x01\0\0\0\0\0\0\0\0hello", 14);
+            PacketBufferPool pool;
+            channel.packetReceived(pool.copy(data.data(), data.size()), 0);
+            channel.packetReceived(pool.copy(data.data(), data.size()), 0);
+            callback("Reliable channel test: duplicates delivered once",
+                capture.messages.size() == 1 && capture.messages[0] == "hello"
+                    && channel.getStatistics().duplicatesReceived == 1
+                    && capture.packets.size() == 2 ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* no more than the window in flight, and a timeout resends the oldest */
+        {
+            Capture capture;
+            ReliableChannel::Configuration configuration;
+            configuration.sendWindow = 4;
+            ReliableChannel channel(capture, capture, configuration);
+            for(unsigned i = 0; i < 10; i++)
+                channel.send("x", 1, true, 0);
+            bool windowed = capture.packets.size() == 4;
+            channel.timerExpired(configuration.initialRTO);
+            callback("Reliable channel test: send window",
+                windowed ? "SUCCEEDED" : "FAILED");
+            callback("Reliable channel test: retransmission on timeout",
+                capture.packets.size() == 5
+                    && channel.nextTimeout() == 2 * configuration.initialRTO
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* sent before the path existed, resent as soon as it does */
+        {
+            Capture capture;
+            ReliableChannel::Configuration configuration;
+            configuration.sendWindow = 4;
+            ReliableChannel channel(capture, capture, configuration);
+            for(unsigned i = 0; i < 3; i++)
+                channel.send("x", 1, true, 0);
+            ReliableChannel::Milliseconds now = 0;
+            for(unsigned i = 0; i < 3; i++) {
+                now = channel.nextTimeout();
+                channel.timerExpired(now);
+            }
+            size_t before = capture.packets.size();
+            channel.linkEstablished(now + 1);
+            callback("Reliable channel test: resent once the link is up",
+                capture.packets.size() == before + 3
+                    && channel.getStatistics().rto == configuration.initialRTO
+                    && channel.nextTimeout()
+                        == now + 1 + configuration.initialRTO
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        {
+            Capture capture;
+            ReliableChannel::Configuration configuration;
+            configuration.maxMessageSize = 10000;
+            ReliableChannel channel(capture, capture, configuration);
+            std::string large(channel.maxMessageSize() + 1, 'x');
+            callback("Reliable channel test: oversized message rejected",
+                !channel.send(large.data(), large.size(), true, 0)
+                    && capture.packets.empty() ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* large messages are split up and put together again */
+        {
+            SimulatedPath path(20, 10, 50);
+            for(unsigned i = 0; i < 3; i++) {
+                std::string m = large(i, 100000);
+                path.a.channel.send(m.data(), m.size(), true, path.now);
+            }
+            path.a.channel.send("end", 3, true, path.now);
+            path.run();
+            bool intact = path.b.messages.size() == 4
+                && path.b.messages[3] == "end";
+            for(unsigned i = 0; intact && i < 3; i++)
+                intact = path.b.messages[i] == large(i, 100000);
+            callback("Reliable channel test: fragmented reliable messages",
+                intact && path.packetsLost > 0
+                    && path.a.channel.getStatistics().fragmentsSent > 200
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        {
+            SimulatedPath path(20, 10, 0);
+            std::string m = large(7, 20000);
+            path.a.channel.send(m.data(), m.size(), false, path.now);
+            path.run();
+            callback("Reliable channel test: fragmented unreliable message",
+                path.b.messages.size() == 1 && path.b.messages[0] == m
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* a fragment short, the rest is dropped after the timeout */
+        {
+            Capture sender, receiver;
+            ReliableChannel a(sender, sender);
+            ReliableChannel b(receiver, receiver);
+            std::string m = large(1, 5000);
+            a.send(m.data(), m.size(), false, 0);
+            for(size_t i = 1; i < sender.packets.size(); i++)
+                feed(b, sender.packets[i], 0);
+            ReliableChannel::Milliseconds late
+                = ReliableChannel::Configuration().reassemblyTimeout;
+            bool scheduled = b.nextTimeout() == late;
+            b.timerExpired(late);
+            scheduled = scheduled && b.nextTimeout() == ReliableChannel::NEVER;
+            feed(b, sender.packets[0], late);
+            callback("Reliable channel test: reassembly timeout",
+                scheduled && sender.packets.size() > 2
+                    && receiver.messages.empty()
+                    && b.getStatistics().messagesDiscarded == 1
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* partial messages make room for newer ones */
+        {
+            Capture sender, receiver;
+            ReliableChannel::Configuration configuration;
+            configuration.reassemblyMemory = 10000;
+            ReliableChannel a(sender, sender);
+            ReliableChannel b(receiver, receiver, configuration);
+            std::vector<size_t> firsts;
+            for(unsigned i = 0; i < 3; i++) {
+                std::string m = large(i, 6000);
+                firsts.push_back(sender.packets.size());
+                a.send(m.data(), m.size(), false, 0);
+                feed(b, sender.packets[firsts.back()], 0);
+            }
+            for(size_t i = firsts.back() + 1; i < sender.packets.size(); i++)
+                feed(b, sender.packets[i], 0);
+            callback("Reliable channel test: bounded reassembly memory",
+                receiver.messages.size() == 1
+                    && receiver.messages[0] == large(2, 6000)
+                    && b.getStatistics().messagesDiscarded == 2
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* what waits for the windows is buffered, up to a limit */
+        {
+            Capture capture;
+            ReliableChannel::Configuration configuration;
+            configuration.maxBufferedAmount = 50000;
+            ReliableChannel channel(capture, capture, configuration);
+            std::string message(1000, 'x');
+            unsigned accepted = 0;
+            while(accepted < 1000
+                && channel.send(message.data(), message.size(), true, 0))
+                accepted++;
+            callback("Reliable channel test: bounded buffered amount",
+                channel.getBufferedAmount() == 50000
+                    && accepted == 50 + capture.packets.size()
+                    && channel.send("x", 1, false, 0)
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* the low water event follows once the backlog is sent */
+        {
+            SimulatedPath path(20, 10, 0);
+            std::string message(1000, 'x');
+            path.a.channel.setLowWaterMark(10000);
+            for(unsigned i = 0; i < 200; i++)
+                path.a.channel.send(
+                    message.data(), message.size(), true, path.now);
+            bool buffered = path.a.channel.getBufferedAmount() > 10000;
+            path.run();
+            callback("Reliable channel test: low water event",
+                buffered && path.a.bufferedAmountLowEvents == 1
+                    && path.a.channel.getBufferedAmount() == 0
+                    && path.b.messages.size() == 200
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* a reliable message too large for the receiver is skipped */
+        {
+            Capture sender, receiver;
+            ReliableChannel::Configuration configuration;
+            configuration.maxMessageSize = 2000;
+            ReliableChannel a(sender, sender);
+            ReliableChannel b(receiver, receiver, configuration);
+            std::string m = large(3, 5000);
+            a.send(m.data(), m.size(), true, 0);
+            a.send("after", 5, true, 0);
+            for(size_t i = 0; i < sender.packets.size(); i++)
+                feed(b, sender.packets[i], 0);
+            callback("Reliable channel test: oversized message skipped",
+                receiver.messages.size() == 1
+                    && receiver.messages[0] == "after"
+                    && b.getStatistics().messagesDiscarded == 1
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* reliable messages being put together take the reassembly memory
+         * from partial unreliable ones, and one that does not fit in it is
+         * skipped
+        **/
+        {
+            Capture sender, receiver;
+            ReliableChannel::Configuration configuration;
+            configuration.reassemblyMemory = 8000;
+            ReliableChannel a(sender, sender);
+            ReliableChannel b(receiver, receiver, configuration);
+            std::string partial = large(1, 5000);
+            a.send(partial.data(), partial.size(), false, 0);
+            feed(b, sender.packets[0], 0);
+            size_t sent = sender.packets.size(), acknowledged = 0;
+            std::string fits = large(2, 6000);
+            std::string tooMuch = large(3, 9000);
+            a.send(fits.data(), fits.size(), true, 0);
+            a.send(tooMuch.data(), tooMuch.size(), true, 0);
+            a.send("after", 5, true, 0);
+            while(sent < sender.packets.size()) {
+                for(; sent < sender.packets.size(); sent++)
+                    feed(b, sender.packets[sent], 0);
+                for(; acknowledged < receiver.packets.size(); acknowledged++)
+                    feed(a, receiver.packets[acknowledged], 0);
+            }
+            callback("Reliable channel test: shared reassembly memory",
+                receiver.messages.size() == 2
+                    && receiver.messages[0] == fits
+                    && receiver.messages[1] == "after"
+                    && b.getStatistics().messagesDiscarded == 2
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* the peer opens no more than maxChannels */
+        {
+            Capture sender, receiver;
+            ReliableChannel::Configuration configuration;
+            configuration.maxChannels = 2;
+            ReliableChannel a(sender, sender);
+            ReliableChannel b(receiver, receiver, configuration);
+            a.send(1, "one", 3, 0);
+            a.send(2, "two", 3, 0);
+            a.send(3, "three", 5, 0);
+            a.send(1, "four", 4, 0);
+            for(size_t i = 0; i < sender.packets.size(); i++)
+                feed(b, sender.packets[i], 0);
+            callback("Reliable channel test: bounded channels",
+                receiver.messages.size() == 3
+                    && receiver.messages[2] == "four"
+                    && b.getStatistics().messagesDiscarded == 1
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* a packet missing on one channel holds up that channel only */
+        {
+            Capture sender, receiver;
+            ReliableChannel a(sender, sender);
+            ReliableChannel b(receiver, receiver);
+            a.send(1, "one", 3, 0);
+            a.send(2, "two", 3, 0);
+            a.send(1, "three", 5, 0);
+            feed(b, sender.packets[1], 0);
+            feed(b, sender.packets[2], 0);
+            bool notBlocked = receiver.messages.size() == 1
+                && receiver.messages[0] == "two";
+            feed(b, sender.packets[0], 0);
+            callback("Reliable channel test: independent channels",
+                notBlocked && receiver.messages.size() == 3
+                    && receiver.messages[1] == "one"
+                    && receiver.messages[2] == "three"
+                    && receiver.channels[0] == 2 && receiver.channels[1] == 1
+                    && receiver.channels[2] == 1 ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* unordered messages are delivered as they come in, still once */
+        {
+            Capture sender, receiver;
+            ReliableChannel a(sender, sender);
+            ReliableChannel b(receiver, receiver);
+            a.setDelivery(3, ReliableChannel::RELIABLE_UNORDERED);
+            a.send(3, "x", 1, 0);
+            a.send(3, "y", 1, 0);
+            a.send(3, "z", 1, 0);
+            feed(b, sender.packets[2], 0);
+            feed(b, sender.packets[1], 0);
+            feed(b, sender.packets[1], 0);
+            feed(b, sender.packets[0], 0);
+            callback("Reliable channel test: unordered channel",
+                a.getDelivery(3) == ReliableChannel::RELIABLE_UNORDERED
+                    && receiver.messages.size() == 3
+                    && receiver.messages[0] == "z"
+                    && receiver.messages[1] == "y"
+                    && receiver.messages[2] == "x"
+                    && b.getStatistics().duplicatesReceived == 1
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        {
+            SimulatedPath path(20, 10, 0);
+            path.a.channel.setDelivery(4, ReliableChannel::UNRELIABLE);
+            std::string m = large(5, 5000);
+            path.a.channel.send(4, "datagram", 8, path.now);
+            path.a.channel.send(4, m.data(), m.size(), path.now);
+            path.run();
+            callback("Reliable channel test: unreliable channel",
+                path.b.messages.size() == 2
+                    && path.b.messages[0] == "datagram"
+                    && path.b.messages[1] == m
+                    && path.b.channels[0] == 4 && path.b.channels[1] == 4
+                    && path.b.channel.getStatistics().acknowledgementsSent == 0
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* each ordered channel in order, fragmented messages between the
+         * others, over a lossy path
+        **/
+        {
+            SimulatedPath path(20, 10, 100);
+            path.a.channel.setDelivery(4, ReliableChannel::RELIABLE_UNORDERED);
+            std::vector<std::vector<std::string> > sent(5);
+            for(unsigned i = 0; i < 400; i++) {
+                ReliableChannel::ChannelId c
+                    = static_cast<ReliableChannel::ChannelId>(1 + i % 4);
+                std::string m = c == 2 && i % 3 == 0
+                    ? large(i, 5000) : number(i);
+                path.a.channel.send(c, m.data(), m.size(), path.now);
+                sent[c].push_back(m);
+                path.runUntil(path.now + 1);
+            }
+            path.run();
+            std::vector<std::vector<std::string> > received(5);
+            for(size_t i = 0; i < path.b.messages.size(); i++)
+                received[path.b.channels[i]].push_back(path.b.messages[i]);
+            std::sort(sent[4].begin(), sent[4].end());
+            std::sort(received[4].begin(), received[4].end());
+            callback("Reliable channel test: channels over a lossy path",
+                received == sent && path.packetsLost > 0
+                    ? "SUCCEEDED" : "FAILED");
+        }
+    }
+};
+
+struct CongestionControllerTests {
+    template<typename F> static void runTests(F callback) {
+        const size_t mss = 1000;
+        const CongestionController::Milliseconds none
+            = ReliableChannel::NEVER;
+
+        /* doubles per round trip in slow start, halves on loss */
+        {
+            LossBasedController controller(mss);
+            size_t initial = controller.getCongestionWindow();
+            for(size_t acked = 0; acked < initial; acked += mss)
+                controller.acknowledged(mss, initial, 20, 0);
+            bool doubled = controller.getCongestionWindow() == 2 * initial;
+            controller.congestionEvent();
+            bool halved = controller.getCongestionWindow() == initial;
+            controller.timeout();
+            callback("Congestion controller test: loss based windows",
+                doubled && halved && controller.getCongestionWindow() == mss
+                    && controller.getState().congestionEvents == 1
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* a growing RTT ends slow start before the queue overflows */
+        {
+            LossBasedController controller(mss);
+            controller.acknowledged(mss, 100 * mss, 20, 0);
+            size_t window = controller.getCongestionWindow();
+            controller.acknowledged(mss, 100 * mss, 40, 20);
+            CongestionController::State state = controller.getState();
+            callback("Congestion controller test: delay ends slow start",
+                state.slowStartThreshold == window
+                    && state.congestionWindow < window + mss
+                    && state.minimumRTT == 20 ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* an application that does not use the window does not grow it */
+        {
+            LossBasedController controller(mss);
+            size_t initial = controller.getCongestionWindow();
+            controller.acknowledged(mss, mss, none, 0);
+            callback("Congestion controller test: application limited",
+                controller.getCongestionWindow() == initial
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* LEDBAT grows below its target delay and shrinks above it */
+        {
+            LedbatController controller(mss, 50);
+            controller.congestionEvent();
+            size_t base = controller.getCongestionWindow();
+            controller.acknowledged(mss, base, 20, 0);
+            bool grew = controller.getCongestionWindow() > base;
+            size_t grown = controller.getCongestionWindow();
+            for(unsigned i = 1; i <= 100; i++)
+                controller.acknowledged(mss, grown, 120, i);
+            /* but not below two packets */
+            callback("Congestion controller test: LEDBAT target delay",
+                grew && controller.getState().queueingDelay == 100
+                    && controller.getCongestionWindow() == 2 * mss
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* the channel keeps no more than the window in flight */
+        {
+            ReliableChannelTests::Capture capture;
+            ReliableChannel channel(capture, capture);
+            std::string message(1000, 'x');
+            for(unsigned i = 0; i < 100; i++)
+                channel.send(message.data(), message.size(), true, 0);
+            CongestionController::State state = channel.getCongestionState();
+            size_t inFlight = channel.getStatistics().bytesInFlight;
+            callback("Congestion controller test: window limits the channel",
+                inFlight <= state.congestionWindow
+                    && capture.packets.size() > 1
+                    && capture.packets.size() < 100
+                    && inFlight == capture.packets.size()
+                        * (message.size() + 9) ? "SUCCEEDED" : "FAILED");
+        }
+    }
+};
+
+struct SendSchedulerTests {
+    /* a packet of the given size, the class in its first byte */
+    static void enqueue(SendScheduler& scheduler, SendScheduler::ClassId id,
+        size_t size, bool last = true, SendScheduler::Milliseconds now = 0) {
+        PacketBufferPtr buffer = PacketBufferPool::shared().acquire(size);
+        buffer->data()[0] = static_cast<char>(id);
+        scheduler.enqueue(id, buffer, size, last, now);
+    }
+
+    static SendScheduler::ClassId pop(SendScheduler& scheduler,
+        SendScheduler::Milliseconds now = 0) {
+        size_t size;
+        return static_cast<unsigned char>(scheduler.pop(size, now)->data()[0]);
+    }
+
+    template<typename F> static void runTests(F callback) {
+        /* a higher priority goes first, whatever waited before it */
+        {
+            SendScheduler scheduler(1000);
+            scheduler.setPriority(2, SendScheduler::PRIORITY_HIGH);
+            scheduler.setPriority(3, SendScheduler::PRIORITY_BACKGROUND);
+            for(unsigned i = 0; i < 3; i++)
+                enqueue(scheduler, 3, 100);
+            for(unsigned i = 0; i < 3; i++)
+                enqueue(scheduler, 1, 100);
+            enqueue(scheduler, 2, 100);
+            std::string order;
+            while(!scheduler.empty())
+                order += static_cast<char>('0' + pop(scheduler));
+            callback("Send scheduler test: strict priority",
+                order == "2111333" ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* the same priority shares by weight */
+        {
+            SendScheduler scheduler(100);
+            scheduler.setWeight(1, 3);
+            for(unsigned i = 0; i < 100; i++) {
+                enqueue(scheduler, 1, 100);
+                enqueue(scheduler, 2, 100);
+            }
+            unsigned first = 0;
+            for(unsigned i = 0; i < 80; i++)
+                first += pop(scheduler) == 1;
+            callback("Send scheduler test: weighted sharing",
+                first == 60 && scheduler.size() == 120
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* shares are in bytes, not in packets */
+        {
+            SendScheduler scheduler(1000);
+            for(unsigned i = 0; i < 100; i++)
+                enqueue(scheduler, 1, 1000);
+            for(unsigned i = 0; i < 1000; i++)
+                enqueue(scheduler, 2, 100);
+            size_t bytes[3] = { 0, 0, 0 };
+            for(unsigned i = 0; i < 220; i++) {
+                size_t size;
+                PacketBufferPtr buffer = scheduler.pop(size, 0);
+                bytes[static_cast<unsigned char>(buffer->data()[0])] += size;
+            }
+            callback("Send scheduler test: byte fairness",
+                bytes[1] == 20000 && bytes[2] == 20000
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* the turn passes on inside pop(), without nextSize() first */
+        {
+            SendScheduler scheduler(1000);
+            enqueue(scheduler, 1, 800);
+            enqueue(scheduler, 1, 800);
+            enqueue(scheduler, 2, 800);
+            std::string order;
+            while(!scheduler.empty())
+                order += static_cast<char>('0' + pop(scheduler));
+            enqueue(scheduler, 1, 800);
+            callback("Send scheduler test: pop passes the turn",
+                order == "121" && scheduler.size() == 1
+                    && pop(scheduler) == 1 && scheduler.empty()
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* a class moves along when its priority changes while it waits */
+        {
+            SendScheduler scheduler(1000);
+            enqueue(scheduler, 1, 100);
+            enqueue(scheduler, 2, 100);
+            enqueue(scheduler, 2, 100);
+            scheduler.setPriority(2, SendScheduler::PRIORITY_URGENT);
+            SendScheduler::ClassId a = pop(scheduler);
+            SendScheduler::ClassId b = pop(scheduler);
+            callback("Send scheduler test: priority change",
+                a == 2 && b == 2 && pop(scheduler) == 1 && scheduler.empty()
+                    && scheduler.getPriority(2)
+                        == SendScheduler::PRIORITY_URGENT
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* a message counts as sent when its last packet leaves */
+        {
+            SendScheduler scheduler(1000);
+            enqueue(scheduler, 1, 500, false, 0);
+            enqueue(scheduler, 1, 500, true, 0);
+            enqueue(scheduler, 1, 100, true, 20);
+            SendScheduler::ClassStatistics waiting
+                = scheduler.getStatistics(1);
+            pop(scheduler, 5);
+            pop(scheduler, 10);
+            pop(scheduler, 50);
+            SendScheduler::ClassStatistics s = scheduler.getStatistics(1);
+            callback("Send scheduler test: queueing delay",
+                waiting.packetsWaiting == 3 && waiting.bytesWaiting == 1100
+                    && waiting.messagesQueued == 2 && s.messagesSent == 2
+                    && s.bytesSent == 1100 && s.maxDelay == 30
+                    && s.averageDelay() == 20 && s.packetsWaiting == 0
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* text sent after a backlog of bulk data gets through first */
+        {
+            SimulatedPath path(20, 1, 0);
+            path.a.channel.setPriority(1, SendScheduler::PRIORITY_HIGH);
+            std::string bulk(1000, 'x');
+            for(unsigned i = 0; i < 500; i++)
+                path.a.channel.send(2, bulk.data(), bulk.size(), path.now);
+            path.runUntil(100);
+            path.a.channel.send(1, "text", 4, path.now);
+            path.run();
+            size_t position = std::find(path.b.messages.begin(),
+                path.b.messages.end(), "text") - path.b.messages.begin();
+            SendScheduler::ClassStatistics text
+                = path.a.channel.getChannelStatistics(1);
+            callback("Send scheduler test: priority over a channel",
+                path.b.messages.size() == 501 && position < 100
+                    && text.messagesSent == 1 && text.maxDelay < 50
+                    && path.a.channel.getChannelStatistics(2).messagesSent
+                        == 500 ? "SUCCEEDED" : "FAILED");
+        }
+    }
+};
+
+struct FileTransferTests {
+    static std::string content(size_t size) {
+        std::string s(size, '\0');
+        for(size_t i = 0; i < size; i++)
+            s[i] = static_cast<char>(i * 7 + i / 251);
+        return s;
+    }
+
+    static boost::shared_ptr<FileSource> source(const std::string& s) {
+        return boost::shared_ptr<FileSource>(new MemoryFileSource(s));
+    }
+
+    template<typename F> static void runTests(F callback) {
+        FileTransfer::Configuration small;
+        small.chunkSize = 1000;
+        small.pipeline = 4;
+
+        /* a file that is not a multiple of the chunk size */
+        {
+            FileTransferLoopback loopback(small);
+            boost::shared_ptr<MemoryFileSink> sink(new MemoryFileSink());
+            loopback.b.nextSink = sink;
+            std::string file = content(10500);
+            FileTransfer::Id id = loopback.a.transfer.sendFile("a", source(file));
+            loopback.run();
+            callback("File transfer test: chunked transfer",
+                sink->content == file
+                    && loopback.a.sent == std::vector<FileTransfer::Id>(1, id)
+                    && loopback.b.received.size() == 1
+                    && loopback.b.transfer.getStatistics().chunksReceived == 11
+                    && loopback.a.transfer.getActiveCount() == 0
+                    && loopback.b.transfer.getActiveCount() == 0
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* a link that refuses messages holds the transfer up, no more */
+        {
+            FileTransferLoopback loopback(small);
+            loopback.queueLimit = 1;
+            boost::shared_ptr<MemoryFileSink> sink(new MemoryFileSink());
+            loopback.b.nextSink = sink;
+            std::string file = content(20000);
+            loopback.a.transfer.sendFile("a", source(file));
+            loopback.run();
+            callback("File transfer test: link backpressure",
+                sink->content == file && loopback.a.sent.size() == 1
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* what the receiver has already is not sent again */
+        {
+            FileTransferLoopback loopback(small);
+            std::string file = content(10500);
+            boost::shared_ptr<MemoryFileSink> sink(
+                new MemoryFileSink(file.substr(0, 4200)));
+            loopback.b.nextSink = sink;
+            loopback.a.transfer.sendFile("a", source(file));
+            loopback.run();
+            FileTransfer::Statistics sent = loopback.a.transfer.getStatistics();
+            FileTransfer::Statistics received
+                = loopback.b.transfer.getStatistics();
+            callback("File transfer test: resume",
+                sink->content == file && sent.bytesSent == 10500 - 4200
+                    && received.bytesResumed == 4200
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* a corrupt chunk is sent again */
+        {
+            FileTransferLoopback loopback(small);
+            loopback.corruptMessage = 3;
+            boost::shared_ptr<MemoryFileSink> sink(new MemoryFileSink());
+            loopback.b.nextSink = sink;
+            std::string file = content(10500);
+            loopback.a.transfer.sendFile("a", source(file));
+            loopback.run();
+            FileTransfer::Statistics received
+                = loopback.b.transfer.getStatistics();
+            callback("File transfer test: corrupt chunk",
+                sink->content == file && received.corruptChunks == 1
+                    && received.chunksOutOfOrder > 0
+                    && loopback.a.transfer.getStatistics().chunksSent == 12
+                    && loopback.a.sent.size() == 1 ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* a refused file fails on the side that sent it */
+        {
+            FileTransferLoopback loopback(small);
+            FileTransfer::Id id
+                = loopback.a.transfer.sendFile("a", source(content(5000)));
+            loopback.run();
+            callback("File transfer test: refused",
+                loopback.a.failed == std::vector<FileTransfer::Id>(1, id)
+                    && loopback.a.sent.empty() && loopback.b.failed.empty()
+                    && loopback.a.transfer.getActiveCount() == 0
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* an offer larger than the receiver takes never reaches a sink */
+        {
+            FileTransfer::Configuration limited = small;
+            limited.maxFileSize = 5000;
+            FileTransferLoopback loopback(limited);
+            boost::shared_ptr<MemoryFileSink> sink(new MemoryFileSink());
+            loopback.b.nextSink = sink;
+            FileTransfer::Id id
+                = loopback.a.transfer.sendFile("a", source(content(5001)));
+            loopback.run();
+            callback("File transfer test: oversized offer",
+                loopback.a.failed == std::vector<FileTransfer::Id>(1, id)
+                    && loopback.b.failed.empty() && sink->content.empty()
+                    && loopback.b.transfer.getActiveCount() == 0
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* several files at once, one of them empty */
+        {
+            FileTransferLoopback loopback(small);
+            boost::shared_ptr<MemoryFileSink> sink(new MemoryFileSink());
+            loopback.b.nextSink = sink;
+            loopback.a.transfer.sendFile("empty", source(""));
+            loopback.run();
+            bool empty = loopback.a.sent.size() == 1
+                && loopback.b.received.size() == 1 && sink->content.empty();
+
+            boost::shared_ptr<MemoryFileSink> first(new MemoryFileSink());
+            boost::shared_ptr<MemoryFileSink> second(new MemoryFileSink());
+            loopback.b.sinks["first"] = first;
+            loopback.b.sinks["second"] = second;
+            loopback.a.transfer.sendFile("first", source(content(7000)));
+            loopback.a.transfer.sendFile("second", source(content(3000)));
+            loopback.run();
+            callback("File transfer test: several files",
+                empty && first->content == content(7000)
+                    && second->content == content(3000)
+                    && loopback.a.sent.size() == 3 ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* from a file on disk to a file on disk, reading ahead in blocks
+         * smaller than the file
+        **/
+        {
+            const char* from = "FileTransferTest.source";
+            const char* to = "FileTransferTest.copy";
+            std::string file = content(300000);
+            {
+                std::ofstream out(from, std::ios::out | std::ios::binary);
+                out.write(file.data(), file.size());
+            }
+            std::remove(to);
+
+            FileTransferLoopback loopback;
+            bool complete;
+            {
+                boost::shared_ptr<FileReader> reader(
+                    new FileReader(from, 100000));
+                boost::shared_ptr<FileWriter> writer(new FileWriter(to));
+                loopback.b.nextSink = writer;
+                loopback.a.transfer.sendFile("source", reader);
+                loopback.run();
+                loopback.b.nextSink.reset();
+                complete = reader->isOpen() && writer->isOpen()
+                    && loopback.b.received.size() == 1;
+            }
+            std::ifstream in(to, std::ios::in | std::ios::binary);
+            std::string copy((std::istreambuf_iterator<char>(in)),
+                std::istreambuf_iterator<char>());
+            in.close();
+            std::remove(from);
+            std::remove(to);
+            callback("File transfer test: disk to disk",
+                complete && copy == file ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* blocks written in any order, the file appears when complete and
+         * an unfinished one resumes after its first gap
+        **/
+        {
+            const char* path = "SparseFileWriterTest";
+            std::string file = content(10500);
+            std::remove(path);
+            bool hidden, resumable, complete;
+            {
+                SparseFileWriter writer(path, 1000);
+                writer.allocate(file.size(), 1);
+                writer.write(3000, &file[3000], 2000);
+                writer.write(0, &file[0], 1000);
+                writer.write(10000, &file[10000], 500);
+                writer.write(1000, &file[1000], 1500);
+                hidden = !std::ifstream(path).is_open()
+                    && writer.size() == 2000 && !writer.isComplete();
+            }
+            {
+                SparseFileWriter writer(path, 1000);
+                writer.allocate(file.size(), 1);
+                /* half of a block, and the rest of it */
+                resumable = writer.size() == 2000;
+                writer.write(2500, &file[2500], 500);
+                writer.write(2000, &file[2000], 500);
+                writer.write(5000, &file[5000], 5000);
+                complete = writer.size() == file.size()
+                    && writer.finish();
+            }
+            std::ifstream in(path, std::ios::in | std::ios::binary);
+            std::string copy((std::istreambuf_iterator<char>(in)),
+                std::istreambuf_iterator<char>());
+            in.close();
+            bool cleaned = !std::ifstream("SparseFileWriterTest.part")
+                .is_open() && !std::ifstream("SparseFileWriterTest.part.map")
+                .is_open();
+            std::remove(path);
+            callback("File transfer test: sparse file writer",
+                hidden && resumable && complete && cleaned && copy == file
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* another version of the file starts over, and a file by the name
+         * is kept rather than replaced
+        **/
+        {
+            const char* path = "SparseFileWriterTest";
+            const char* numbered = "SparseFileWriterTest (1)";
+            std::string file = content(3000);
+            std::remove(path);
+            std::remove(numbered);
+            {
+                std::ofstream out(path, std::ios::out | std::ios::binary);
+                out << "kept";
+            }
+            bool restarted, published;
+            {
+                SparseFileWriter writer(path, 1000);
+                writer.allocate(file.size(), 1);
+                writer.write(0, &file[0], 1000);
+            }
+            {
+                SparseFileWriter writer(path, 1000);
+                writer.allocate(file.size(), 2);
+                restarted = writer.size() == 0;
+                writer.write(0, &file[0], file.size());
+                published = writer.finish() && writer.getPath() == numbered;
+            }
+            std::ifstream kept(path);
+            std::string original((std::istreambuf_iterator<char>(kept)),
+                std::istreambuf_iterator<char>());
+            kept.close();
+            std::ifstream in(numbered, std::ios::in | std::ios::binary);
+            std::string copy((std::istreambuf_iterator<char>(in)),
+                std::istreambuf_iterator<char>());
+            in.close();
+            std::remove(path);
+            std::remove(numbered);
+            callback("File transfer test: sparse file writer keeps files",
+                restarted && published && original == "kept" && copy == file
+                    ? "SUCCEEDED" : "FAILED");
+        }
+    }
+};
+
+struct BitmapTransferTests {
+    static Bitmap picture(unsigned width, unsigned height, unsigned seed) {
+        Bitmap bitmap(width, height, 0xff336699);
+        for(unsigned y = 0; y < height; y += 3)
+            for(unsigned x = y % 5; x < width; x += 7)
+                bitmap.at(x, y) = (x * 131 + y * 31 + seed) | 0xff000000;
+        return bitmap;
+    }
+
+    template<typename F> static void runTests(F callback) {
+        BitmapTransfer::Configuration configuration;
+        configuration.tileSize = 16;
+
+        /* the first frame whole, and of the next only what changed */
+        {
+            BitmapLoopback loopback(configuration);
+            Bitmap first = picture(100, 70, 0);
+            loopback.a.transfer.sendBitmap(first, loopback.now);
+            loopback.run();
+            Bitmap second = first;
+            second.at(50, 20) = 0xff000000;
+            loopback.a.transfer.sendBitmap(second, loopback.now);
+            loopback.run();
+            BitmapEncoder::Statistics statistics
+                = loopback.a.transfer.getStatistics().encoder;
+            callback("Bitmap transfer test: delta",
+                loopback.b.received.size() == 2
+                    && loopback.b.received[0] == first
+                    && loopback.b.received[1] == second
+                    && statistics.keyFrames == 1
+                    && statistics.tilesSent == 7 * 5 + 1
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* deltas from the acknowledged frame while others are in flight,
+         * and the newest bitmap replaces the one waiting
+        **/
+        {
+            configuration.maxFramesInFlight = 2;
+            BitmapLoopback loopback(configuration);
+            loopback.a.transfer.sendBitmap(picture(64, 64, 0), loopback.now);
+            loopback.run();
+            for(unsigned i = 1; i <= 4; i++)
+                loopback.a.transfer.sendBitmap(picture(64, 64, i),
+                    loopback.now);
+            loopback.run();
+            BitmapTransfer::Statistics statistics
+                = loopback.a.transfer.getStatistics();
+            callback("Bitmap transfer test: frames in flight",
+                loopback.b.received.size() == 4
+                    && loopback.b.received[1] == picture(64, 64, 1)
+                    && loopback.b.received[2] == picture(64, 64, 2)
+                    && loopback.b.received[3] == picture(64, 64, 4)
+                    && statistics.framesReplaced == 1
+                    && statistics.encoder.keyFrames == 1
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* frames sent before the key frame arrives wait for it */
+        {
+            BitmapLoopback loopback(configuration);
+            for(unsigned i = 0; i < 5; i++)
+                loopback.a.transfer.sendBitmap(picture(64, 64, i),
+                    loopback.now);
+            size_t inFlight = loopback.a.transfer.getStatistics().framesSent;
+            loopback.run();
+            BitmapTransfer::Statistics statistics
+                = loopback.a.transfer.getStatistics();
+            callback("Bitmap transfer test: frames behind a key frame",
+                inFlight == 1 && loopback.b.received.size() == 2
+                    && loopback.b.received[1] == picture(64, 64, 4)
+                    && statistics.framesReplaced == 3
+                    && statistics.encoder.keyFrames == 1
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* a new size is sent whole */
+        {
+            BitmapLoopback loopback(configuration);
+            loopback.a.transfer.sendBitmap(picture(40, 30, 0), loopback.now);
+            loopback.run();
+            loopback.a.transfer.sendBitmap(picture(30, 40, 0), loopback.now);
+            loopback.run();
+            callback("Bitmap transfer test: resize",
+                loopback.b.received.size() == 2
+                    && loopback.b.received[1] == picture(30, 40, 0)
+                    && loopback.a.transfer.getStatistics().encoder.keyFrames
+                        == 2 ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* damaged frames and frames without their base are refused */
+        {
+            BitmapEncoder encoder(16);
+            BitmapDecoder decoder;
+            std::string key = encoder.encode(picture(40, 30, 0));
+            encoder.acknowledged(0);
+            std::string delta = encoder.encode(picture(40, 30, 1));
+            Bitmap bitmap;
+            FrameNumber number;
+            bool withoutBase = !decoder.decode(delta.data(), delta.size(),
+                bitmap, number);
+            bool truncated = !decoder.decode(key.data(), key.size() - 1,
+                bitmap, number);
+            bool decoded = decoder.decode(key.data(), key.size(),
+                bitmap, number)
+                && decoder.decode(delta.data(), delta.size(), bitmap, number)
+                && bitmap == picture(40, 30, 1) && number == 1;
+            callback("Bitmap transfer test: damaged frames",
+                withoutBase && truncated && decoded ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* frames too large, or claiming more than their tiles hold, are
+         * refused before anything is allocated for them
+        **/
+        {
+            BitmapDecoder decoder(100 * 100);
+            Bitmap bitmap;
+            FrameNumber number;
+            std::string huge("\x01\0\0\0\0\xff\xff\xff\xff"
+                "\0\0\x40\0\0\0\x40\0\0\x40\0\0\0\0", 23);
+            BitmapEncoder encoder(16);
+            std::string large = encoder.encode(picture(101, 100, 0));
+            std::string whole = BitmapEncoder(16).encode(picture(40, 30, 0));
+            /* the tile count says one tile less */
+            std::string missing = whole;
+            missing[22] = static_cast<char>(missing[22] - 1);
+            Bitmap tooLarge(200, 200);
+            BitmapTransfer::Configuration small;
+            small.maxPixels = 100 * 100;
+            BitmapLoopback loopback(small);
+            callback("Bitmap transfer test: oversized frames",
+                !decoder.decode(huge.data(), huge.size(), bitmap, number)
+                    && !decoder.decode(large.data(), large.size(),
+                        bitmap, number)
+                    && !decoder.decode(missing.data(), missing.size(),
+                        bitmap, number)
+                    && decoder.decode(whole.data(), whole.size(),
+                        bitmap, number)
+                    && !loopback.a.transfer.sendBitmap(tooLarge, loopback.now)
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* frames longer than the link takes go in parts, and a part that
+         * claims a frame longer than maxPixels can make is refused
+        **/
+        {
+            BitmapTransfer::Configuration parts = configuration;
+            parts.maxMessageSize = 1000;
+            BitmapLoopback loopback(parts);
+            Bitmap noise(100, 70);
+            for(size_t i = 0; i < noise.pixels.size(); i++)
+                noise.pixels[i] = static_cast<Bitmap::Pixel>(
+                    i * 2654435761u);
+            loopback.a.transfer.sendBitmap(noise, loopback.now);
+            loopback.run();
+            Bitmap changed = noise;
+            changed.at(50, 20) = 0xff000000;
+            loopback.a.transfer.sendBitmap(changed, loopback.now);
+            loopback.run();
+
+            std::string claim("\x03\0\0\0\0\x7f\xff\xff\xff\0\0\0\0x", 14);
+            loopback.b.transfer.messageReceived(PacketBufferPool::shared()
+                .copy(claim.data(), claim.size()), loopback.now);
+            BitmapTransfer::Statistics statistics
+                = loopback.b.transfer.getStatistics();
+            callback("Bitmap transfer test: frames in parts",
+                loopback.b.received.size() == 2
+                    && loopback.b.received[0] == noise
+                    && loopback.b.received[1] == changed
+                    && loopback.largestMessage <= 1000
+                    && loopback.a.transfer.getStatistics().framesSent == 2
+                    && statistics.framesDiscarded == 1
+                    ? "SUCCEEDED" : "FAILED");
+        }
+
+        /* a frame that is never acknowledged is given up on after the
+         * timeout, and a key frame follows
+        **/
+        {
+            BitmapLoopback loopback(configuration);
+            loopback.losing = true;
+            loopback.a.transfer.sendBitmap(picture(64, 64, 0), loopback.now);
+            loopback.losing = false;
+            loopback.now += 100;
+            loopback.a.transfer.sendBitmap(picture(64, 64, 1), loopback.now);
+            size_t waiting = loopback.b.received.size()
+                + loopback.a.transfer.getStatistics().framesSent;
+            loopback.now += configuration.acknowledgementTimeout;
+            loopback.a.transfer.pump(loopback.now);
+            loopback.run();
+            BitmapTransfer::Statistics statistics
+                = loopback.a.transfer.getStatistics();
+            callback("Bitmap transfer test: lost frames",
+                waiting == 1 && loopback.b.received.size() == 1
+                    && loopback.b.received[0] == picture(64, 64, 1)
+                    && statistics.timeouts == 1
+                    && statistics.encoder.keyFrames == 2
+                    ? "SUCCEEDED" : "FAILED");
+        }
+    }
+};
+
+struct ICERuntimeTests {
+    /* Every thread that calls into pjlib has to be known to it. */
+    struct RegisteredThread {
+        pj_thread_desc desc;
+        pj_thread_t*   thread;
+
+        RegisteredThread() : thread(NULL) {
+            if(!pj_thread_is_registered())
+                pj_thread_register("tests", desc, &thread);
+        }
+    };
+
+    /* Does nothing, the clients are only created to be measured. */
+    struct IgnoreCallbacks : ICEClient::Callbacks {
+        void setLocalCandidates(const std::string& localCandidates) {}
+        void negotiationComplete() {}
+        void dataReceived(ReliableChannel::ChannelId channel,
+            const PacketSlice& data) {}
+        void bufferedAmountLow() {}
+        void closed() {}
+    };
+
+    /* Signals the thread that waits for the client to close. */
+    struct CloseCallbacks : IgnoreCallbacks {
+        boost::mutex              mutex;
+        boost::condition_variable changed;
+        bool                      isClosed;
+
+        CloseCallbacks() : isClosed(false) {}
+
+        void closed() {
+            boost::mutex::scoped_lock lock(mutex);
+            isClosed = true;
+            changed.notify_all();
+        }
+
+        bool waitUntilClosed() {
+            boost::mutex::scoped_lock lock(mutex);
+            while(!isClosed) {
+                if(!changed.timed_wait(lock,
+                    boost::posix_time::seconds(1)))
+                    return isClosed;
+            }
+            return true;
+        }
+    };
+
+    /* Clients share one runtime, which goes away with the last of them. */
+    template<typename F> static void runTests(F callback) {
+        boost::shared_ptr<ICERuntime> a = ICERuntime::acquire();
+        RegisteredThread registered;
+        boost::shared_ptr<ICERuntime> b = ICERuntime::acquire();
+        callback("ICE runtime test: shared by all clients",
+            a == b && a->error().empty() ? "SUCCEEDED" : "FAILED");
+
+        /* as many clients as reactors get a reactor each */
+        std::vector<ICERuntime::Reactor*> attached;
+        for(unsigned i = 0; i < a->getReactorCount(); i++)
+            attached.push_back(a->attach());
+        bool spread = true;
+        for(size_t i = 0; i < attached.size(); i++) {
+            if(attached[i] == NULL || std::count(attached.begin(),
+                attached.end(), attached[i]) != 1)
+                spread = false;
+            a->detach(attached[i]);
+        }
+        callback("ICE runtime test: clients spread over reactors",
+            spread && a->getReactorCount() > 0 ? "SUCCEEDED" : "FAILED");
+
+        boost::weak_ptr<ICERuntime> weak(a);
+        a.reset();
+        b.reset();
+        callback("ICE runtime test: released with the last client",
+            weak.expired() ? "SUCCEEDED" : "FAILED");
+
+        testClose(callback);
+    }
+
+    /* Closing a client wakes its reactor instead of waiting for the next
+     * poll timeout, and so does stopping the reactors with the last client.
+    **/
+    template<typename F> static void testClose(F callback) {
+        const long long limit = 5000000; /* 5 ms */
+        boost::shared_ptr<ICERuntime> runtime = ICERuntime::acquire();
+        RegisteredThread registered;
+        CloseCallbacks callbacks;
+        ICEClient* client = new ICEClient("");
+        client->setCallbacks(&callbacks);
+
+        BenchmarkTimer closing;
+        client->close();
+        bool closed = callbacks.waitUntilClosed();
+        long long closeTime = closing.elapsedNanoseconds();
+        callback("ICE client test: close completes within 5 ms",
+            closed && !client->isOpen() && closeTime < limit
+                ? "SUCCEEDED" : "FAILED");
+
+        BenchmarkTimer teardown;
+        delete client;
+        runtime.reset();
+        callback("ICE client test: runtime stops within 5 ms",
+            teardown.elapsedNanoseconds() < limit ? "SUCCEEDED" : "FAILED");
+    }
+
+    /* Counts the datagrams that arrive on a socket of a reactor. */
+    struct LoopbackReceiver {
+        pj_ioqueue_key_t*   key;
+        pj_ioqueue_op_key_t readOp;
+        char                buffer[1500];
+        volatile unsigned   received;
+
+        LoopbackReceiver() : key(NULL), received(0) {
+            pj_ioqueue_op_key_init(&readOp, sizeof(readOp));
+        }
+
+        void read() {
+            pj_ssize_t size = sizeof(buffer);
+            pj_ioqueue_recv(key, &readOp, buffer, &size,
+                PJ_IOQUEUE_ALWAYS_ASYNC);
+        }
+
+        static void onReadComplete(
+            pj_ioqueue_key_t* key,
+            pj_ioqueue_op_key_t* op,
+            pj_ssize_t bytesRead) {
+            LoopbackReceiver* receiver = static_cast<LoopbackReceiver*>(
+                pj_ioqueue_get_user_data(key));
+            if(bytesRead > 0)
+                receiver->received++;
+            receiver->read();
+        }
+    };
+
+    template<typename F> static void runBenchmarks(F callback) {
+        benchmarkMemory(callback);
+        benchmarkLoopback(callback);
+    }
+
+    /* Threads of the process where the system tells, 0 elsewhere. */
+    static unsigned processThreads() {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while(std::getline(status, line)) {
+            if(boost::algorithm::starts_with(line, "Threads:"))
+                return static_cast<unsigned>(
+                    std::atoi(line.c_str() + 8));
+        }
+        return 0;
+    }
+
+    /* Memory and threads a peer adds to the shared runtime, and what the
+     * same peers took when each had a pjlib stack of its own: the memory
+     * of a reactor, which is such a stack, and a thread each.
+    **/
+    template<typename F> static void benchmarkMemory(F callback) {
+        enum { CLIENTS = 20 };
+        unsigned threadsBefore = processThreads();
+        boost::shared_ptr<ICERuntime> runtime = ICERuntime::acquire();
+        RegisteredThread registered;
+        IgnoreCallbacks callbacks;
+        unsigned reactors = runtime->getReactorCount();
+        size_t stack = reactors > 0 ? runtime->getUsedMemory() / reactors : 0;
+
+        size_t before = runtime->getUsedMemory();
+        std::vector<ICEClient*> clients;
+        for(unsigned i = 0; i < CLIENTS; i++) {
+            clients.push_back(new ICEClient(""));
+            clients.back()->setCallbacks(&callbacks);
+        }
+        size_t after = runtime->getUsedMemory();
+        unsigned threadsAfter = processThreads();
+        for(unsigned i = 0; i < CLIENTS; i++)
+            delete clients[i];
+        /* while this thread is still registered */
+        runtime.reset();
+
+        size_t perClient = (after - before) / CLIENTS;
+        std::stringstream result;
+        result << "shared: " << perClient << " bytes/client, ";
+        if(threadsBefore > 0 && threadsAfter >= threadsBefore)
+            result << threadsAfter - threadsBefore << " threads";
+        else
+            result << "threads not measured";
+        result << " for " << CLIENTS << " clients on " << reactors
+               << " reactors; a stack per client: "
+               << perClient + stack << " bytes/client, " << CLIENTS
+               << " threads";
+        callback("Benchmark: ICE runtime memory per client", result.str());
+    }
+
+    /* Datagrams a reactor receives per second over loopback, and how many
+     * of them it handles per wake-up. The sender keeps at most WINDOW of them
+     * in flight, so the socket buffer does not overflow.
+    **/
+    template<typename F> static void benchmarkLoopback(F callback) {
+        enum { DATAGRAMS = 20000, DATAGRAM_SIZE = 1200, WINDOW = 64 };
+        boost::shared_ptr<ICERuntime> runtime = ICERuntime::acquire();
+        RegisteredThread registered;
+        ICERuntime::Reactor* reactor = runtime->attach();
+        if(!reactor) {
+            callback("Benchmark: ICE reactor loopback throughput",
+                "no reactor: " + runtime->error());
+            return;
+        }
+
+        pj_pool_t* pool = pj_pool_create(
+            runtime->getPoolFactory(), "loopback", 512, 512, NULL);
+        pj_sock_t sender = PJ_INVALID_SOCKET;
+        pj_sock_t receiverSocket = PJ_INVALID_SOCKET;
+        pj_sockaddr_in address;
+        int addressLength = sizeof(address);
+        pj_str_t localhost;
+        pj_cstr(&localhost, "127.0.0.1");
+        pj_sockaddr_in_init(&address, &localhost, 0);
+
+        pj_ioqueue_callback ioqueueCallback;
+        pj_bzero(&ioqueueCallback, sizeof(ioqueueCallback));
+        ioqueueCallback.on_read_complete = &LoopbackReceiver::onReadComplete;
+        LoopbackReceiver receiver;
+
+        if(pj_sock_socket(pj_AF_INET(), pj_SOCK_DGRAM(), 0, &sender)
+                != PJ_SUCCESS ||
+            pj_sock_socket(pj_AF_INET(), pj_SOCK_DGRAM(), 0, &receiverSocket)
+                != PJ_SUCCESS ||
+            pj_sock_bind(receiverSocket, &address, sizeof(address))
+                != PJ_SUCCESS ||
+            pj_sock_getsockname(receiverSocket, &address, &addressLength)
+                != PJ_SUCCESS ||
+            pj_ioqueue_register_sock(pool, reactor->getIOQueue(),
+                receiverSocket, &receiver, &ioqueueCallback, &receiver.key)
+                != PJ_SUCCESS) {
+            if(sender != PJ_INVALID_SOCKET)
+                pj_sock_close(sender);
+            if(receiverSocket != PJ_INVALID_SOCKET)
+                pj_sock_close(receiverSocket);
+            pj_pool_release(pool);
+            runtime->detach(reactor);
+            callback("Benchmark: ICE reactor loopback throughput",
+                "could not set up the sockets");
+            return;
+        }
+        receiver.read();
+
+        char datagram[DATAGRAM_SIZE];
+        pj_bzero(datagram, sizeof(datagram));
+        ICERuntime::Reactor::Statistics before = reactor->getStatistics();
+        BenchmarkTimer t;
+        unsigned sent = 0;
+        bool stalled = false;
+        while(sent < DATAGRAMS && !stalled) {
+            BenchmarkTimer wait;
+            while(sent - receiver.received >= WINDOW && !stalled) {
+                /* a lost datagram would keep the window full forever */
+                stalled = wait.elapsedNanoseconds() > 1000000000LL;
+                pj_thread_sleep(0);
+            }
+            pj_ssize_t size = sizeof(datagram);
+            if(pj_sock_sendto(sender, datagram, &size, 0,
+                &address, sizeof(address)) == PJ_SUCCESS)
+                sent++;
+        }
+        BenchmarkTimer drain;
+        while(receiver.received < sent &&
+            drain.elapsedNanoseconds() < 1000000000LL)
+            pj_thread_sleep(0);
+        long long ns = t.elapsedNanoseconds();
+        ICERuntime::Reactor::Statistics after = reactor->getStatistics();
+
+        /* closes the socket as well */
+        pj_ioqueue_unregister(receiver.key);
+        pj_sock_close(sender);
+        pj_pool_release(pool);
+        runtime->detach(reactor);
+        runtime.reset();
+
+        unsigned long long wakeups = after.wakeups - before.wakeups;
+        unsigned long long events = after.networkEvents - before.networkEvents;
+        std::stringstream result;
+        result << (ns > 0 ? receiver.received * 1000000000LL / ns : 0)
+               << " datagrams/s, "
+               << (wakeups > 0 ? static_cast<double>(events) / wakeups : 0.0)
+               << " events/wakeup, at most "
+               << after.maxEventsPerWakeup << ", "
+               << receiver.received << " of " << DATAGRAMS << " received";
+        callback("Benchmark: ICE reactor loopback throughput", result.str());
+    }
 };
 
 class TestRunner {
@@ -191,6 +2062,26 @@ public:
 
         GrammarTests::runTests(
             boost::phoenix::bind(&TestRunner::reportTestResult, *this, arg1, arg2));
+        SessionDescriptorParserTests::runTests(
+            boost::phoenix::bind(&TestRunner::reportTestResult, *this, arg1, arg2));
+        SessionDescriptorStreamParserTests::runTests(
+            boost::phoenix::bind(&TestRunner::reportTestResult, *this, arg1, arg2));
+        SessionDescriptorWriterTests::runTests(
+            boost::phoenix::bind(&TestRunner::reportTestResult, *this, arg1, arg2));
+        PacketBufferTests::runTests(
+            boost::phoenix::bind(&TestRunner::reportTestResult, *this, arg1, arg2));
+        ReliableChannelTests::runTests(
+            boost::phoenix::bind(&TestRunner::reportTestResult, *this, arg1, arg2));
+        CongestionControllerTests::runTests(
+            boost::phoenix::bind(&TestRunner::reportTestResult, *this, arg1, arg2));
+        SendSchedulerTests::runTests(
+            boost::phoenix::bind(&TestRunner::reportTestResult, *this, arg1, arg2));
+        FileTransferTests::runTests(
+            boost::phoenix::bind(&TestRunner::reportTestResult, *this, arg1, arg2));
+        BitmapTransferTests::runTests(
+            boost::phoenix::bind(&TestRunner::reportTestResult, *this, arg1, arg2));
+        ICERuntimeTests::runTests(
+            boost::phoenix::bind(&TestRunner::reportTestResult, *this, arg1, arg2));
     }
 
     void reportTestResult(
@@ -200,9 +2091,44 @@ public:
     }
 };
 
+class BenchmarkRunner {
+    FB::JSObjectPtr jscb;
+public:
+    BenchmarkRunner(const FB::JSObjectPtr& jscb) : jscb(jscb) {}
+
+    void operator()() {
+        using namespace boost::phoenix;
+        using namespace boost::phoenix::arg_names;
+
+        GrammarBenchmarks::runBenchmarks(
+            boost::phoenix::bind(
+                &BenchmarkRunner::reportBenchmarkResult, *this, arg1, arg2));
+        ChannelBenchmarks::runBenchmarks(
+            boost::phoenix::bind(
+                &BenchmarkRunner::reportBenchmarkResult, *this, arg1, arg2));
+        FileTransferBenchmarks::runBenchmarks(
+            boost::phoenix::bind(
+                &BenchmarkRunner::reportBenchmarkResult, *this, arg1, arg2));
+        BitmapBenchmarks::runBenchmarks(
+            boost::phoenix::bind(
+                &BenchmarkRunner::reportBenchmarkResult, *this, arg1, arg2));
+        ICERuntimeTests::runBenchmarks(
+            boost::phoenix::bind(
+                &BenchmarkRunner::reportBenchmarkResult, *this, arg1, arg2));
+    }
+
+    void reportBenchmarkResult(
+        const std::string& benchmarkName,
+        const std::string& benchmarkResult) {
+        jscb->Invoke("", FB::variant_list_of(benchmarkName)(benchmarkResult));
+    }
+};
+
 RegressionTests::RegressionTests() {
     registerMethod("runTests",
     	FB::make_method(this, &RegressionTests::runTests));
+    registerMethod("runBenchmarks",
+    	FB::make_method(this, &RegressionTests::runBenchmarks));
 }
 
 RegressionTests::~RegressionTests() {
@@ -211,4 +2137,9 @@ RegressionTests::~RegressionTests() {
 void RegressionTests::runTests(const FB::JSObjectPtr& callback) {
     TestRunner tr(callback);
     boost::thread t(tr);
+}
+
+void RegressionTests::runBenchmarks(const FB::JSObjectPtr& callback) {
+    BenchmarkRunner br(callback);
+    boost::thread t(br);
 }
\ No newline at end of file
@@ -35,4 +35,5 @@ private:
     ~RegressionTests();
     
     void runTests(const FB::JSObjectPtr& callback);
+    void runBenchmarks(const FB::JSObjectPtr& callback);
 };
\ No newline at end of file
@@ -0,0 +1,899 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    ReliableChannel.cpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Implementation of the message channel on top of the datagrams
+ *              of an ICE component.
+**/
+
+/* STL includes */
+#include <algorithm>
+#include <cstring>
+
+/* WebP2P includes */
+#include "ReliableChannel.hpp"
+
+/* Packet layout, all numbers in network byte order:
+ *
+ *   unreliable:       type (1)  channel (2)  payload
+ *   unreliable fragment:
+ *                     type (1)  channel (2)  message (4)  offset (4)
+ *                     length (4)  payload
+ *   data:             type (1)  sequence (4)  channel (2)
+ *                     channel sequence (2)  payload
+ *   first fragment:   as data, then length (4)  payload
+ *   next fragment:    as data
+ *   acknowledgement:  type (1)  next expected sequence (4)  window (2)
+ *                     block count (1)  blocks of first (4) and last (4)
+ *                     sequence received out of order
+ *
+ * Reliable packets are acknowledged by their sequence, which all channels
+ * share, and delivered by their channel sequence, so a channel waits only
+ * for its own packets. The fragments of a reliable message follow each
+ * other on their channel, so only the first needs to say how long the
+ * message is. Those of an unreliable one can go missing and arrive in any
+ * order. Packets of unordered channels have PACKET_UNORDERED in the type.
+**/
+enum PacketType {
+    PACKET_UNRELIABLE          = 0,
+    PACKET_DATA                = 1,
+    PACKET_ACKNOWLEDGEMENT     = 2,
+    PACKET_FIRST_FRAGMENT      = 3,
+    PACKET_NEXT_FRAGMENT       = 4,
+    PACKET_UNRELIABLE_FRAGMENT = 5,
+    PACKET_UNORDERED           = 0x80,
+    PACKET_TYPE_MASK           = 0x7f
+};
+
+enum {
+    UNRELIABLE_HEADER_SIZE = 3,
+    FRAGMENT_HEADER_SIZE = 15,
+    DATA_HEADER_SIZE = 9,
+    FIRST_FRAGMENT_HEADER_SIZE = 13,
+    ACK_HEADER_SIZE  = 8,
+    ACK_BLOCK_SIZE   = 8,
+    /* enough to describe the holes of a lossy path with a full window, a
+     * range left out looks lost to the sender and is sent again for nothing
+    **/
+    MAX_ACK_BLOCKS   = 64,
+    /* packets sent after a packet that have to arrive before it is taken
+     * for lost rather than reordered
+    **/
+    FAST_RETRANSMIT_THRESHOLD = 3
+};
+
+const ReliableChannel::Milliseconds ReliableChannel::NEVER
+    = static_cast<ReliableChannel::Milliseconds>(-1);
+
+static void write16(char* p, boost::uint16_t value) {
+    p[0] = static_cast<char>(value >> 8);
+    p[1] = static_cast<char>(value);
+}
+
+static void write32(char* p, boost::uint32_t value) {
+    p[0] = static_cast<char>(value >> 24);
+    p[1] = static_cast<char>(value >> 16);
+    p[2] = static_cast<char>(value >> 8);
+    p[3] = static_cast<char>(value);
+}
+
+static boost::uint16_t read16(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<boost::uint16_t>((u[0] << 8) | u[1]);
+}
+
+static boost::uint32_t read32(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return (static_cast<boost::uint32_t>(u[0]) << 24)
+        | (static_cast<boost::uint32_t>(u[1]) << 16)
+        | (static_cast<boost::uint32_t>(u[2]) << 8)
+        | static_cast<boost::uint32_t>(u[3]);
+}
+
+ReliableChannel::Configuration::Configuration() :
+    maxPacketSize(1200),
+    sendWindow(1024),
+    receiveWindow(1024),
+    initialRTO(1000),
+    minRTO(200),
+    maxRTO(10000),
+    congestionControl(CongestionController::LOSS_BASED),
+    maxMessageSize(4 * 1024 * 1024),
+    reassemblyMemory(16 * 1024 * 1024),
+    reassemblyTimeout(5000),
+    maxChannels(256),
+    maxBufferedAmount(16 * 1024 * 1024) {
+}
+
+ReliableChannel::Statistics::Statistics() :
+    messagesSent(0),
+    messagesDelivered(0),
+    packetsSent(0),
+    retransmissions(0),
+    fastRetransmissions(0),
+    timeouts(0),
+    duplicatesReceived(0),
+    acknowledgementsSent(0),
+    fragmentsSent(0),
+    messagesDiscarded(0),
+    bytesInFlight(0),
+    smoothedRTT(0),
+    rto(0) {
+}
+
+ReliableChannel::Outgoing::Outgoing(const PacketSlice& packet) :
+    packet(packet),
+    sentAt(0),
+    transmissions(0),
+    transmitOrder(0),
+    selectivelyAcknowledged(false) {
+}
+
+ReliableChannel::PartialMessage::PartialMessage() :
+    channel(0),
+    length(0),
+    received(0),
+    startedAt(0) {
+}
+
+bool ReliableChannel::SequenceLess::operator()(
+    boost::uint32_t a, boost::uint32_t b) const {
+    return static_cast<boost::int32_t>(a - b) < 0;
+}
+
+bool ReliableChannel::ChannelSequenceLess::operator()(
+    boost::uint16_t a, boost::uint16_t b) const {
+    return static_cast<boost::int16_t>(a - b) < 0;
+}
+
+ReliableChannel::SendingChannel::SendingChannel() :
+    delivery(RELIABLE_ORDERED),
+    sequence(0) {
+}
+
+ReliableChannel::ReceivingChannel::ReceivingChannel() :
+    next(0),
+    skipping(false),
+    assembledLength(0),
+    assembledSize(0) {
+}
+
+ReliableChannel::ReliableChannel(
+    Link& link,
+    Handler& handler,
+    const Configuration& configuration) :
+    link(link),
+    handler(handler),
+    configuration(configuration),
+    sendBase(0),
+    sendNext(0),
+    peerWindow(configuration.sendWindow),
+    transmitCounter(0),
+    highestDeliveredOrder(0),
+    congestionController(CongestionController::create(
+        configuration.congestionControl, configuration.maxPacketSize)),
+    bytesInFlight(0),
+    recoveryPoint(0),
+    bufferedAmount(0),
+    lowWaterMark(0),
+    aboveLowWaterMark(false),
+    smoothedRTT(0),
+    rttVariation(0),
+    rto(configuration.initialRTO),
+    hasRTTSample(false),
+    scheduler(configuration.maxPacketSize),
+    receiveNext(0),
+    nextMessageNumber(0),
+    partialMessageMemory(0),
+    assembledMemory(0) {
+}
+
+size_t ReliableChannel::maxMessageSize() const {
+    return configuration.maxMessageSize;
+}
+
+size_t ReliableChannel::getUnacknowledgedCount() const {
+    return outgoing.size() + scheduler.size();
+}
+
+size_t ReliableChannel::getBufferedAmount() const {
+    return bufferedAmount;
+}
+
+void ReliableChannel::setLowWaterMark(size_t bytes) {
+    lowWaterMark = bytes;
+    aboveLowWaterMark = bufferedAmount > lowWaterMark;
+}
+
+size_t ReliableChannel::getLowWaterMark() const {
+    return lowWaterMark;
+}
+
+ReliableChannel::Statistics ReliableChannel::getStatistics() const {
+    Statistics result = statistics;
+    result.bytesInFlight = bytesInFlight;
+    result.smoothedRTT = smoothedRTT;
+    result.rto = rto;
+    return result;
+}
+
+void ReliableChannel::setCongestionControl(CongestionController::Mode mode) {
+    congestionController
+        = CongestionController::create(mode, configuration.maxPacketSize);
+}
+
+void ReliableChannel::setCongestionController(
+    const boost::shared_ptr<CongestionController>& controller) {
+    congestionController = controller;
+}
+
+CongestionController::State ReliableChannel::getCongestionState() const {
+    return congestionController->getState();
+}
+
+void ReliableChannel::setDelivery(ChannelId channel, Delivery delivery) {
+    sendingChannels[channel].delivery = delivery;
+}
+
+ReliableChannel::Delivery ReliableChannel::getDelivery(
+    ChannelId channel) const {
+    std::map<ChannelId, SendingChannel>::const_iterator i
+        = sendingChannels.find(channel);
+    return i == sendingChannels.end() ? RELIABLE_ORDERED : i->second.delivery;
+}
+
+void ReliableChannel::setPriority(
+    ChannelId channel, SendScheduler::Priority priority) {
+    scheduler.setPriority(channel, priority);
+}
+
+SendScheduler::Priority ReliableChannel::getPriority(ChannelId channel) const {
+    return scheduler.getPriority(channel);
+}
+
+void ReliableChannel::setWeight(ChannelId channel, unsigned weight) {
+    scheduler.setWeight(channel, weight);
+}
+
+unsigned ReliableChannel::getWeight(ChannelId channel) const {
+    return scheduler.getWeight(channel);
+}
+
+SendScheduler::ClassStatistics ReliableChannel::getChannelStatistics(
+    ChannelId channel) const {
+    return scheduler.getStatistics(channel);
+}
+
+bool ReliableChannel::send(
+    ChannelId channel, const char* data, size_t size, Milliseconds now) {
+    return sendMessage(channel, getDelivery(channel), data, size, now);
+}
+
+bool ReliableChannel::send(
+    const char* data, size_t size, bool reliable, Milliseconds now) {
+    return sendMessage(0, reliable ? RELIABLE_ORDERED : UNRELIABLE,
+        data, size, now);
+}
+
+bool ReliableChannel::sendMessage(ChannelId channel, Delivery delivery,
+    const char* data, size_t size, Milliseconds now) {
+    bool reliable = delivery != UNRELIABLE;
+    if(size > maxMessageSize())
+        return false;
+    if(reliable && size > configuration.maxBufferedAmount - std::min(
+        bufferedAmount, configuration.maxBufferedAmount))
+        return false;
+    statistics.messagesSent++;
+
+    size_t packetSize = configuration.maxPacketSize;
+    if(!reliable) {
+        char header[FRAGMENT_HEADER_SIZE - 1];
+        write16(header, channel);
+        if(size + UNRELIABLE_HEADER_SIZE <= packetSize) {
+            sendUnreliable(PACKET_UNRELIABLE, header, 2, data, size);
+            return true;
+        }
+        write32(header + 2, nextMessageNumber++);
+        write32(header + 10, static_cast<boost::uint32_t>(size));
+        size_t fragment = packetSize - FRAGMENT_HEADER_SIZE;
+        for(size_t offset = 0; offset < size; offset += fragment) {
+            write32(header + 6, static_cast<boost::uint32_t>(offset));
+            sendUnreliable(PACKET_UNRELIABLE_FRAGMENT, header, sizeof(header),
+                data + offset, std::min(fragment, size - offset));
+            statistics.fragmentsSent++;
+        }
+        return true;
+    }
+
+    /* queued now, numbered once the scheduler and the windows let it out */
+    unsigned char unordered = static_cast<unsigned char>(
+        delivery == RELIABLE_UNORDERED ? PACKET_UNORDERED : 0);
+    bufferedAmount += size;
+    if(size + DATA_HEADER_SIZE <= packetSize) {
+        queueData(PACKET_DATA | unordered, channel, NULL, 0,
+            data, size, true, now);
+    } else {
+        char length[FIRST_FRAGMENT_HEADER_SIZE - DATA_HEADER_SIZE];
+        write32(length, static_cast<boost::uint32_t>(size));
+        size_t first = packetSize - FIRST_FRAGMENT_HEADER_SIZE;
+        queueData(PACKET_FIRST_FRAGMENT | unordered, channel,
+            length, sizeof(length), data, first, false, now);
+        statistics.fragmentsSent++;
+        size_t fragment = packetSize - DATA_HEADER_SIZE;
+        for(size_t offset = first; offset < size; offset += fragment) {
+            size_t part = std::min(fragment, size - offset);
+            queueData(PACKET_NEXT_FRAGMENT | unordered, channel, NULL, 0,
+                data + offset, part, offset + part == size, now);
+            statistics.fragmentsSent++;
+        }
+    }
+
+    transmitPending(now);
+    /* the event is for what the window let through later */
+    if(bufferedAmount > lowWaterMark)
+        aboveLowWaterMark = true;
+    return true;
+}
+
+void ReliableChannel::sendUnreliable(unsigned char type,
+    const char* header, size_t headerSize, const char* data, size_t size) {
+    PacketBufferPtr buffer
+        = PacketBufferPool::shared().acquire(1 + headerSize + size);
+    buffer->data()[0] = static_cast<char>(type);
+    if(headerSize > 0)
+        std::memcpy(buffer->data() + 1, header, headerSize);
+    if(size > 0)
+        std::memcpy(buffer->data() + 1 + headerSize, data, size);
+    link.sendPacket(buffer->data(), 1 + headerSize + size);
+    statistics.packetsSent++;
+}
+
+void ReliableChannel::queueData(unsigned char type, ChannelId channel,
+    const char* header, size_t headerSize, const char* data, size_t size,
+    bool last, Milliseconds now) {
+    size_t packetSize = DATA_HEADER_SIZE + headerSize + size;
+    PacketBufferPtr buffer = PacketBufferPool::shared().acquire(packetSize);
+    buffer->data()[0] = static_cast<char>(type);
+    /* the sequence is written once the packet leaves the scheduler */
+    write16(buffer->data() + 5, channel);
+    write16(buffer->data() + 7, sendingChannels[channel].sequence++);
+    if(headerSize > 0)
+        std::memcpy(buffer->data() + DATA_HEADER_SIZE, header, headerSize);
+    if(size > 0) {
+        std::memcpy(buffer->data() + DATA_HEADER_SIZE + headerSize,
+            data, size);
+    }
+    scheduler.enqueue(channel, buffer, packetSize, last, now);
+}
+
+void ReliableChannel::transmitPending(Milliseconds now) {
+    unsigned window = std::min(configuration.sendWindow, peerWindow);
+    size_t congestionWindow = congestionController->getCongestionWindow();
+    while(!scheduler.empty() && outgoing.size() < window) {
+        /* retransmissions are not held back, they replace lost packets */
+        if(bytesInFlight > 0
+            && bytesInFlight + scheduler.nextSize() > congestionWindow)
+            break;
+        size_t size;
+        PacketBufferPtr buffer = scheduler.pop(size, now);
+        write32(buffer->data() + 1, sendNext);
+        bufferedAmount -= size - ((buffer->data()[0] & PACKET_TYPE_MASK)
+            == PACKET_FIRST_FRAGMENT
+            ? FIRST_FRAGMENT_HEADER_SIZE : DATA_HEADER_SIZE);
+        outgoing.push_back(Outgoing(PacketSlice(buffer, 0, size)));
+        transmit(outgoing.back(), now);
+        sendNext++;
+    }
+}
+
+void ReliableChannel::transmit(Outgoing& o, Milliseconds now) {
+    if(o.transmissions == 0)
+        bytesInFlight += o.packet.size();
+    o.sentAt = now;
+    o.transmissions++;
+    o.transmitOrder = ++transmitCounter;
+    link.sendPacket(o.packet.data(), o.packet.size());
+    statistics.packetsSent++;
+    if(o.transmissions > 1)
+        statistics.retransmissions++;
+}
+
+void ReliableChannel::packetReceived(
+    const PacketSlice& packet, Milliseconds now) {
+    if(packet.empty())
+        return;
+
+    switch(packet.data()[0] & PACKET_TYPE_MASK) {
+    case PACKET_UNRELIABLE:
+        if(packet.size() < UNRELIABLE_HEADER_SIZE)
+            break;
+        statistics.messagesDelivered++;
+        handler.messageReceived(read16(packet.data() + 1),
+            packet.slice(UNRELIABLE_HEADER_SIZE, packet.size()), false);
+        break;
+    case PACKET_UNRELIABLE_FRAGMENT:
+        fragmentReceived(packet, now);
+        break;
+    case PACKET_DATA:
+    case PACKET_FIRST_FRAGMENT:
+    case PACKET_NEXT_FRAGMENT:
+        dataReceived(packet);
+        break;
+    case PACKET_ACKNOWLEDGEMENT:
+        acknowledgementReceived(packet, now);
+        break;
+    default:
+        break;
+    }
+}
+
+void ReliableChannel::dataReceived(const PacketSlice& packet) {
+    if(packet.size() < DATA_HEADER_SIZE)
+        return;
+    boost::uint32_t sequence = read32(packet.data() + 1);
+    SequenceLess less;
+
+    if(less(sequence, receiveNext)) {
+        /* the acknowledgement of it was lost, send another one */
+        statistics.duplicatesReceived++;
+    } else if(sequence - receiveNext >= configuration.receiveWindow) {
+        /* beyond the window the peer was told about */
+    } else if(sequence != receiveNext
+        && !outOfOrder.insert(sequence).second) {
+        statistics.duplicatesReceived++;
+    } else {
+        /* whatever was waiting for it is acknowledged along with it */
+        if(sequence == receiveNext) {
+            receiveNext++;
+            std::set<boost::uint32_t, SequenceLess>::iterator i;
+            while((i = outOfOrder.begin()) != outOfOrder.end()
+                && *i == receiveNext) {
+                outOfOrder.erase(i);
+                receiveNext++;
+            }
+        }
+        channelDataReceived(packet);
+    }
+
+    sendAcknowledgement(sequence);
+}
+
+void ReliableChannel::channelDataReceived(const PacketSlice& packet) {
+    unsigned char type = static_cast<unsigned char>(packet.data()[0]);
+    ChannelId channel = read16(packet.data() + 5);
+    boost::uint16_t sequence = read16(packet.data() + 7);
+    std::map<ChannelId, ReceivingChannel>::iterator r
+        = receivingChannels.find(channel);
+    if(r == receivingChannels.end()) {
+        if(receivingChannels.size() >= configuration.maxChannels) {
+            statistics.messagesDiscarded++;
+            return;
+        }
+        r = receivingChannels.insert(
+            std::make_pair(channel, ReceivingChannel())).first;
+    }
+    ReceivingChannel& receiving = r->second;
+    if(ChannelSequenceLess()(sequence, receiving.next))
+        return;
+
+    PacketSlice waiting = packet;
+    if(type == (PACKET_DATA | PACKET_UNORDERED)) {
+        deliver(channel, receiving, packet);
+        /* the channel sequence still has to pass it */
+        waiting = PacketSlice();
+    }
+    if(sequence != receiving.next) {
+        receiving.waiting.insert(std::make_pair(sequence, waiting));
+        return;
+    }
+
+    receiving.next++;
+    if(!waiting.empty())
+        deliver(channel, receiving, waiting);
+
+    std::map<boost::uint16_t, PacketSlice, ChannelSequenceLess>::iterator i;
+    while((i = receiving.waiting.begin()) != receiving.waiting.end()
+        && i->first == receiving.next) {
+        PacketSlice next = i->second;
+        receiving.waiting.erase(i);
+        receiving.next++;
+        if(!next.empty())
+            deliver(channel, receiving, next);
+    }
+}
+
+void ReliableChannel::deliver(ChannelId channel, ReceivingChannel& receiving,
+    const PacketSlice& packet) {
+    unsigned char type = static_cast<unsigned char>(
+        packet.data()[0] & PACKET_TYPE_MASK);
+    size_t headerSize = type == PACKET_FIRST_FRAGMENT
+        ? FIRST_FRAGMENT_HEADER_SIZE : DATA_HEADER_SIZE;
+    if(packet.size() < headerSize) {
+        abandonAssembly(receiving);
+        return;
+    }
+    PacketSlice payload = packet.slice(headerSize, packet.size());
+
+    /* a message that starts before the last one ended, unordered ones
+     * come in between
+    **/
+    bool unordered = (packet.data()[0] & PACKET_UNORDERED) != 0;
+    if(type != PACKET_NEXT_FRAGMENT && receiving.assembledLength > 0
+        && !(unordered && type == PACKET_DATA))
+        abandonAssembly(receiving);
+
+    if(type == PACKET_DATA) {
+        statistics.messagesDelivered++;
+        handler.messageReceived(channel, payload, true);
+        return;
+    }
+
+    if(type == PACKET_FIRST_FRAGMENT) {
+        receiving.assembledLength = read32(packet.data() + DATA_HEADER_SIZE);
+        receiving.assembledSize = 0;
+        /* a message too large is skipped, its fragments still count */
+        receiving.skipping
+            = receiving.assembledLength > configuration.maxMessageSize;
+    }
+
+    if(receiving.assembledLength - receiving.assembledSize < payload.size()) {
+        abandonAssembly(receiving);
+        return;
+    }
+    /* The fragments are kept as they arrive rather than a buffer taken for
+     * the length the first one claims, and what they hold is charged to
+     * the reassembly memory.
+    **/
+    if(!receiving.skipping && !payload.empty()) {
+        if(reserveReassemblyMemory(payload.size())) {
+            assembledMemory += payload.size();
+            receiving.fragments.push_back(payload);
+        } else {
+            /* the rest of it still counts, as for one too large */
+            assembledMemory -= receiving.assembledSize;
+            std::vector<PacketSlice>().swap(receiving.fragments);
+            receiving.skipping = true;
+        }
+    }
+    receiving.assembledSize += payload.size();
+
+    if(receiving.assembledSize == receiving.assembledLength) {
+        bool complete = !receiving.skipping;
+        PacketSlice message;
+        if(complete) {
+            PacketBufferPtr buffer = PacketBufferPool::shared().acquire(
+                receiving.assembledLength);
+            size_t offset = 0;
+            for(size_t i = 0; i < receiving.fragments.size(); i++) {
+                std::memcpy(buffer->data() + offset,
+                    receiving.fragments[i].data(),
+                    receiving.fragments[i].size());
+                offset += receiving.fragments[i].size();
+            }
+            message = PacketSlice(buffer, 0, receiving.assembledLength);
+        }
+        releaseAssembly(receiving);
+        if(!complete) {
+            statistics.messagesDiscarded++;
+            return;
+        }
+        statistics.messagesDelivered++;
+        handler.messageReceived(channel, message, true);
+    }
+}
+
+void ReliableChannel::abandonAssembly(ReceivingChannel& receiving) {
+    if(receiving.assembledLength > 0)
+        statistics.messagesDiscarded++;
+    releaseAssembly(receiving);
+}
+
+void ReliableChannel::releaseAssembly(ReceivingChannel& receiving) {
+    if(!receiving.skipping)
+        assembledMemory -= receiving.assembledSize;
+    std::vector<PacketSlice>().swap(receiving.fragments);
+    receiving.skipping = false;
+    receiving.assembledLength = 0;
+    receiving.assembledSize = 0;
+}
+
+/* Room for more of the messages being put together. Partial unreliable
+ * messages make it, the oldest first, reliable ones never do.
+**/
+bool ReliableChannel::reserveReassemblyMemory(size_t size) {
+    if(size > configuration.reassemblyMemory - assembledMemory)
+        return false;
+    while(partialMessageMemory + assembledMemory + size
+        > configuration.reassemblyMemory)
+        discardPartialMessage(partialMessages.begin());
+    return true;
+}
+
+void ReliableChannel::fragmentReceived(
+    const PacketSlice& packet, Milliseconds now) {
+    if(packet.size() < FRAGMENT_HEADER_SIZE)
+        return;
+    ChannelId channel = read16(packet.data() + 1);
+    boost::uint32_t number = read32(packet.data() + 3);
+    size_t offset = read32(packet.data() + 7);
+    size_t length = read32(packet.data() + 11);
+    PacketSlice payload = packet.slice(FRAGMENT_HEADER_SIZE, packet.size());
+    if(length == 0 || length > configuration.maxMessageSize
+        || offset > length || payload.size() > length - offset)
+        return;
+
+    expirePartialMessages(now);
+
+    std::map<boost::uint32_t, PartialMessage, SequenceLess>::iterator i
+        = partialMessages.find(number);
+    if(i == partialMessages.end()) {
+        /* the oldest messages make room for the new one */
+        if(!reserveReassemblyMemory(length))
+            return;
+        partialMessageMemory += length;
+        i = partialMessages.insert(
+            std::make_pair(number, PartialMessage())).first;
+        i->second.channel = channel;
+        i->second.buffer = PacketBufferPool::shared().acquire(length);
+        i->second.length = length;
+        i->second.startedAt = now;
+    }
+
+    PartialMessage& message = i->second;
+    if(message.length != length)
+        return;
+    if(!message.offsets.insert(static_cast<boost::uint32_t>(offset)).second) {
+        statistics.duplicatesReceived++;
+        return;
+    }
+    if(!payload.empty()) {
+        std::memcpy(message.buffer->data() + offset,
+            payload.data(), payload.size());
+    }
+    message.received += payload.size();
+
+    if(message.received >= message.length) {
+        PacketSlice complete(message.buffer, 0, message.length);
+        ChannelId channel = message.channel;
+        partialMessageMemory -= message.length;
+        partialMessages.erase(i);
+        statistics.messagesDelivered++;
+        handler.messageReceived(channel, complete, false);
+    }
+}
+
+void ReliableChannel::expirePartialMessages(Milliseconds now) {
+    std::map<boost::uint32_t, PartialMessage, SequenceLess>::iterator i
+        = partialMessages.begin();
+    while(i != partialMessages.end()) {
+        std::map<boost::uint32_t, PartialMessage, SequenceLess>::iterator
+            current = i++;
+        if(current->second.startedAt + configuration.reassemblyTimeout <= now)
+            discardPartialMessage(current);
+    }
+}
+
+void ReliableChannel::discardPartialMessage(
+    std::map<boost::uint32_t, PartialMessage, SequenceLess>::iterator i) {
+    partialMessageMemory -= i->second.length;
+    partialMessages.erase(i);
+    statistics.messagesDiscarded++;
+}
+
+void ReliableChannel::sendAcknowledgement(boost::uint32_t received) {
+    char packet[ACK_HEADER_SIZE + MAX_ACK_BLOCKS * ACK_BLOCK_SIZE];
+    packet[0] = PACKET_ACKNOWLEDGEMENT;
+    write32(packet + 1, receiveNext);
+    write16(packet + 5, static_cast<boost::uint16_t>(
+        std::min<unsigned>(configuration.receiveWindow, 0xffff)));
+
+    /* The ranges received beyond the first hole. As in RFC 2018 the range
+     * of the packet that just came in goes first and then the most recent
+     * ones; the peer remembers the ones it was told about before.
+    **/
+    std::vector<std::pair<boost::uint32_t, boost::uint32_t> > ranges;
+    std::set<boost::uint32_t, SequenceLess>::const_iterator i
+        = outOfOrder.begin();
+    while(i != outOfOrder.end()) {
+        boost::uint32_t first = *i;
+        boost::uint32_t last = first;
+        for(++i; i != outOfOrder.end() && *i == last + 1; ++i)
+            last++;
+        ranges.push_back(std::make_pair(first, last));
+    }
+
+    SequenceLess less;
+    unsigned blocks = 0;
+    size_t current = ranges.size();
+    for(size_t r = 0; r < ranges.size(); r++) {
+        if(!less(received, ranges[r].first)
+            && !less(ranges[r].second, received))
+            current = r;
+    }
+    for(size_t r = 0; r <= ranges.size() && blocks < MAX_ACK_BLOCKS; r++) {
+        /* current first, then from the highest down */
+        size_t index = r == 0 ? current : ranges.size() - r;
+        if(index == ranges.size() || (r > 0 && index == current))
+            continue;
+        char* block = packet + ACK_HEADER_SIZE + blocks * ACK_BLOCK_SIZE;
+        write32(block, ranges[index].first);
+        write32(block + 4, ranges[index].second);
+        blocks++;
+    }
+    packet[7] = static_cast<char>(blocks);
+
+    link.sendPacket(packet, ACK_HEADER_SIZE + blocks * ACK_BLOCK_SIZE);
+    statistics.acknowledgementsSent++;
+}
+
+void ReliableChannel::acknowledgementReceived(
+    const PacketSlice& packet, Milliseconds now) {
+    if(packet.size() < ACK_HEADER_SIZE)
+        return;
+    const char* p = packet.data();
+    boost::uint32_t cumulative = read32(p + 1);
+    unsigned window = read16(p + 5);
+    unsigned blocks = static_cast<unsigned char>(p[7]);
+    if(packet.size() < ACK_HEADER_SIZE + blocks * ACK_BLOCK_SIZE)
+        return;
+
+    /* acknowledges something that was never sent */
+    SequenceLess less;
+    if(less(cumulative, sendBase) || less(sendNext, cumulative))
+        return;
+
+    peerWindow = window;
+
+    /* RTT samples only from packets sent once, see Karn's algorithm */
+    Milliseconds rttSample = NEVER;
+    size_t acknowledgedBytes = 0;
+    while(sendBase != cumulative) {
+        Outgoing& o = outgoing.front();
+        if(!o.selectivelyAcknowledged) {
+            acknowledgedBytes += o.packet.size();
+            if(o.transmissions == 1)
+                rttSample = now - o.sentAt;
+            highestDeliveredOrder
+                = std::max(highestDeliveredOrder, o.transmitOrder);
+        }
+        outgoing.pop_front();
+        sendBase++;
+    }
+
+    for(unsigned b = 0; b < blocks; b++) {
+        const char* block = p + ACK_HEADER_SIZE + b * ACK_BLOCK_SIZE;
+        boost::uint32_t first = read32(block);
+        boost::uint32_t last = read32(block + 4);
+        if(less(last, first) || less(first, sendBase)
+            || !less(last, sendNext))
+            continue;
+        for(boost::uint32_t s = first; s != last + 1; s++) {
+            Outgoing& o = outgoing[s - sendBase];
+            if(o.selectivelyAcknowledged)
+                continue;
+            acknowledgedBytes += o.packet.size();
+            if(o.transmissions == 1)
+                rttSample = now - o.sentAt;
+            highestDeliveredOrder
+                = std::max(highestDeliveredOrder, o.transmitOrder);
+            o.selectivelyAcknowledged = true;
+        }
+    }
+
+    if(rttSample != NEVER)
+        sampleRTT(rttSample);
+    if(acknowledgedBytes > 0) {
+        congestionController->acknowledged(
+            acknowledgedBytes, bytesInFlight, rttSample, now);
+        bytesInFlight -= acknowledgedBytes;
+    }
+
+    /* A packet is lost once enough of the packets transmitted after it
+     * have arrived. This goes by the order of transmission rather than by
+     * sequence number, so a lost retransmission is found the same way.
+    **/
+    for(boost::uint32_t s = sendBase; s != sendNext; s++) {
+        Outgoing& o = outgoing[s - sendBase];
+        if(!o.selectivelyAcknowledged && o.transmitOrder
+            + FAST_RETRANSMIT_THRESHOLD <= highestDeliveredOrder) {
+            /* one window reduction for all the losses of a window */
+            if(o.transmitOrder > recoveryPoint) {
+                congestionController->congestionEvent();
+                recoveryPoint = transmitCounter;
+            }
+            transmit(o, now);
+            statistics.fastRetransmissions++;
+        }
+    }
+
+    transmitPending(now);
+
+    if(aboveLowWaterMark && bufferedAmount <= lowWaterMark) {
+        aboveLowWaterMark = false;
+        handler.bufferedAmountLow();
+    }
+}
+
+void ReliableChannel::sampleRTT(Milliseconds rtt) {
+    /* RFC 6298 with a clock granularity of 1 ms */
+    if(!hasRTTSample) {
+        smoothedRTT = rtt;
+        rttVariation = rtt / 2;
+        hasRTTSample = true;
+    } else {
+        Milliseconds difference = smoothedRTT > rtt
+            ? smoothedRTT - rtt : rtt - smoothedRTT;
+        rttVariation = (3 * rttVariation + difference) / 4;
+        smoothedRTT = (7 * smoothedRTT + rtt) / 8;
+    }
+    rto = smoothedRTT + std::max<Milliseconds>(1, 4 * rttVariation);
+    rto = std::max(configuration.minRTO, std::min(configuration.maxRTO, rto));
+}
+
+ReliableChannel::Milliseconds ReliableChannel::nextTimeout() const {
+    Milliseconds earliest = NEVER;
+    for(boost::uint32_t s = sendBase; s != sendNext; s++) {
+        const Outgoing& o = outgoing[s - sendBase];
+        if(!o.selectivelyAcknowledged)
+            earliest = std::min(earliest, o.sentAt);
+    }
+    Milliseconds timeout = earliest == NEVER ? NEVER : earliest + rto;
+
+    /* partial messages expire too, or their memory stays taken */
+    std::map<boost::uint32_t, PartialMessage, SequenceLess>::const_iterator i;
+    for(i = partialMessages.begin(); i != partialMessages.end(); ++i)
+        timeout = std::min(timeout,
+            i->second.startedAt + configuration.reassemblyTimeout);
+    return timeout;
+}
+
+void ReliableChannel::timerExpired(Milliseconds now) {
+    expirePartialMessages(now);
+
+    /* Only the oldest packet that timed out goes again. Once it arrives the
+     * later ones still missing are taken for lost by the acknowledgement,
+     * resending all of them here would flood a path that is merely slow.
+    **/
+    Outgoing* oldest = NULL;
+    for(boost::uint32_t s = sendBase; s != sendNext; s++) {
+        Outgoing& o = outgoing[s - sendBase];
+        if(!o.selectivelyAcknowledged && (!oldest || o.sentAt < oldest->sentAt))
+            oldest = &o;
+    }
+    if(!oldest || oldest->sentAt + rto > now)
+        return;
+
+    statistics.timeouts++;
+    congestionController->timeout();
+    recoveryPoint = transmitCounter;
+    transmit(*oldest, now);
+    /* back off until a new sample comes in */
+    rto = std::min(configuration.maxRTO, rto * 2);
+}
+
+void ReliableChannel::linkEstablished(Milliseconds now) {
+    /* the timeouts so far backed off from a path that did not exist */
+    rto = configuration.initialRTO;
+    for(boost::uint32_t s = sendBase; s != sendNext; s++) {
+        Outgoing& o = outgoing[s - sendBase];
+        if(!o.selectivelyAcknowledged)
+            transmit(o, now);
+    }
+    recoveryPoint = transmitCounter;
+    transmitPending(now);
+}
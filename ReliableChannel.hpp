@@ -0,0 +1,340 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    ReliableChannel.hpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Definition of the message channel on top of the datagrams of
+ *              an ICE component. Reliable messages are numbered, acknowledged
+ *              with selective acknowledgements, retransmitted and delivered
+ *              in order; unreliable ones are passed through as they are.
+ *              Messages larger than a packet are split into fragments and
+ *              put together again on the other side.
+ *              Messages are sent on numbered logical channels, each of them
+ *              reliable and ordered, reliable and unordered or unreliable.
+ *              Ordering holds within a channel only, so a lost packet of
+ *              one channel does not hold up the others. Reliable messages
+ *              wait per channel until a scheduler lets them out, by the
+ *              priorities and weights of the channels.
+ *              The channel does no I/O and reads no clock itself, so it can
+ *              be driven by a simulated path as well as by an ICEClient. A
+ *              congestion controller limits the bytes in flight.
+**/
+
+#pragma once
+
+/* STL includes */
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+
+/* Boost includes */
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+/* WebP2P includes */
+#include "CongestionController.hpp"
+#include "PacketBuffer.hpp"
+#include "SendScheduler.hpp"
+
+class ReliableChannel : boost::noncopyable {
+public:
+    typedef unsigned long long Milliseconds;
+    typedef boost::uint16_t    ChannelId;
+
+    enum Delivery {
+        RELIABLE_ORDERED,
+        /* Delivered as soon as they arrive. Messages of several packets
+         * still wait for the ones sent on the channel before them.
+        **/
+        RELIABLE_UNORDERED,
+        UNRELIABLE
+    };
+
+    /* nextTimeout() when nothing is waiting for a timer */
+    static const Milliseconds NEVER;
+
+    /* Carries the packets of the channel to the peer. */
+    class Link {
+    public:
+        virtual ~Link() {}
+        virtual void sendPacket(const char* data, size_t size) = 0;
+    };
+
+    /* Receives the messages of the peer. The slices point into the received
+     * packets and may be kept.
+    **/
+    class Handler {
+    public:
+        virtual ~Handler() {}
+        virtual void messageReceived(ChannelId channel,
+            const PacketSlice& message, bool reliable) = 0;
+        /* The buffered amount dropped to the low water mark, after send()
+         * left it above. Never called from within send().
+        **/
+        virtual void bufferedAmountLow() {}
+    };
+
+    struct Configuration {
+        /* largest packet handed to the link, headers included */
+        size_t       maxPacketSize;
+        /* reliable packets in flight, and accepted out of order */
+        unsigned     sendWindow;
+        unsigned     receiveWindow;
+        /* retransmission timeout bounds, see RFC 6298 */
+        Milliseconds initialRTO;
+        Milliseconds minRTO;
+        Milliseconds maxRTO;
+        CongestionController::Mode congestionControl;
+        /* largest message that is sent or put together from fragments */
+        size_t       maxMessageSize;
+        /* Shared by the messages being put together from fragments.
+         * Unreliable ones missing fragments are given up after the
+         * timeout, or when later ones need the memory. Reliable ones
+         * take it first, one that no longer fits is skipped.
+        **/
+        size_t       reassemblyMemory;
+        Milliseconds reassemblyTimeout;
+        /* channels the peer can send reliable messages on, each keeps
+         * state for as long as the connection lasts
+        **/
+        unsigned     maxChannels;
+        /* send() refuses reliable messages that would buffer more */
+        size_t       maxBufferedAmount;
+
+        Configuration();
+    };
+
+    struct Statistics {
+        unsigned long long messagesSent;
+        unsigned long long messagesDelivered;
+        unsigned long long packetsSent;
+        unsigned long long retransmissions;
+        unsigned long long fastRetransmissions;
+        unsigned long long timeouts;
+        unsigned long long duplicatesReceived;
+        unsigned long long acknowledgementsSent;
+        unsigned long long fragmentsSent;
+        /* too large, fragments missing, or on too many channels */
+        unsigned long long messagesDiscarded;
+        size_t             bytesInFlight;
+        Milliseconds       smoothedRTT;
+        Milliseconds       rto;
+
+        Statistics();
+    };
+
+private:
+    /* a reliable message, from the moment it is sent until it is
+     * acknowledged
+    **/
+    struct Outgoing {
+        PacketSlice  packet;
+        Milliseconds sentAt;
+        unsigned     transmissions;
+        /* position of the last transmission among all transmissions */
+        unsigned long long transmitOrder;
+        bool         selectivelyAcknowledged;
+
+        Outgoing(const PacketSlice& packet);
+    };
+
+    /* an unreliable message of which some fragments arrived */
+    struct PartialMessage {
+        ChannelId                channel;
+        PacketBufferPtr          buffer;
+        size_t                   length;
+        size_t                   received;
+        std::set<boost::uint32_t> offsets;
+        Milliseconds             startedAt;
+
+        PartialMessage();
+    };
+
+    /* orders sequence numbers across the wrap around */
+    struct SequenceLess {
+        bool operator()(boost::uint32_t a, boost::uint32_t b) const;
+    };
+    struct ChannelSequenceLess {
+        bool operator()(boost::uint16_t a, boost::uint16_t b) const;
+    };
+
+    struct SendingChannel {
+        Delivery        delivery;
+        /* each reliable packet of the channel has the next number */
+        boost::uint16_t sequence;
+
+        SendingChannel();
+    };
+
+    struct ReceivingChannel {
+        /* reliable packets of the channel, numbered by the channel */
+        boost::uint16_t next;
+        /* the ones after a gap, empty if delivered already */
+        std::map<boost::uint16_t, PacketSlice, ChannelSequenceLess> waiting;
+        /* the fragments of the reliable message being put together,
+         * none while one that does not fit is skipped
+        **/
+        std::vector<PacketSlice> fragments;
+        bool            skipping;
+        size_t          assembledLength;
+        size_t          assembledSize;
+
+        ReceivingChannel();
+    };
+
+    Link&          link;
+    Handler&       handler;
+    Configuration  configuration;
+    Statistics     statistics;
+
+    /* the packets numbered and transmitted, and the sequence number of
+     * outgoing.front() and of the next one
+    **/
+    std::deque<Outgoing> outgoing;
+    boost::uint32_t      sendBase;
+    boost::uint32_t      sendNext;
+    unsigned             peerWindow;
+    unsigned long long   transmitCounter;
+    /* transmitOrder of the latest transmission known to have arrived */
+    unsigned long long   highestDeliveredOrder;
+
+    boost::shared_ptr<CongestionController> congestionController;
+    /* bytes transmitted and neither acknowledged nor selectively so */
+    size_t               bytesInFlight;
+    /* losses of transmissions up to here belong to the last congestion
+     * event already
+    **/
+    unsigned long long   recoveryPoint;
+    /* bytes of reliable messages not transmitted yet */
+    size_t               bufferedAmount;
+    size_t               lowWaterMark;
+    bool                 aboveLowWaterMark;
+
+    Milliseconds smoothedRTT;
+    Milliseconds rttVariation;
+    Milliseconds rto;
+    bool         hasRTTSample;
+
+    std::map<ChannelId, SendingChannel> sendingChannels;
+    /* reliable packets not transmitted yet, numbered as they leave */
+    SendScheduler   scheduler;
+
+    /* everything before receiveNext arrived, and these after it */
+    boost::uint32_t receiveNext;
+    std::set<boost::uint32_t, SequenceLess> outOfOrder;
+    std::map<ChannelId, ReceivingChannel> receivingChannels;
+
+    boost::uint32_t nextMessageNumber;
+    std::map<boost::uint32_t, PartialMessage, SequenceLess> partialMessages;
+    size_t          partialMessageMemory;
+    /* of the reliable messages being put together, the same budget */
+    size_t          assembledMemory;
+
+public:
+    ReliableChannel(
+        Link& link,
+        Handler& handler,
+        const Configuration& configuration = Configuration());
+
+    /* Sends one message on a channel, the way set for it, which is
+     * RELIABLE_ORDERED until set otherwise. A message is at most
+     * maxMessageSize() bytes. Reliable messages wait for the windows to
+     * open if they are full.
+    **/
+    bool send(ChannelId channel, const char* data, size_t size,
+        Milliseconds now);
+    /* on channel 0, reliable and ordered or unreliable */
+    bool send(const char* data, size_t size, bool reliable, Milliseconds now);
+
+    /* Only the sender needs to know, the packets say how to deliver them. */
+    void setDelivery(ChannelId channel, Delivery delivery);
+    Delivery getDelivery(ChannelId channel) const;
+
+    /* Which reliable packets go first when the windows are full. Unreliable
+     * messages never wait, they are sent right away.
+    **/
+    void setPriority(ChannelId channel, SendScheduler::Priority priority);
+    SendScheduler::Priority getPriority(ChannelId channel) const;
+    void setWeight(ChannelId channel, unsigned weight);
+    unsigned getWeight(ChannelId channel) const;
+    /* the queueing delay of the channel among others */
+    SendScheduler::ClassStatistics getChannelStatistics(
+        ChannelId channel) const;
+
+    void packetReceived(const PacketSlice& packet, Milliseconds now);
+
+    /* Retransmits what timed out and drops the partial messages that did.
+     * Call it at nextTimeout(), calling it earlier does no harm.
+    **/
+    void timerExpired(Milliseconds now);
+    Milliseconds nextTimeout() const;
+
+    /* The link carries packets from now on, whatever was sent before went
+     * nowhere. Starts the RTO over and sends the outstanding packets again
+     * rather than waiting for it to time out.
+    **/
+    void linkEstablished(Milliseconds now);
+
+    size_t maxMessageSize() const;
+
+    /* reliable packets sent and not acknowledged yet */
+    size_t getUnacknowledgedCount() const;
+
+    /* Bytes of reliable messages that wait for the windows to open, like
+     * the bufferedAmount of a WebSocket.
+    **/
+    size_t getBufferedAmount() const;
+    void setLowWaterMark(size_t bytes);
+    size_t getLowWaterMark() const;
+
+    Statistics getStatistics() const;
+
+    /* Replace the controller made for Configuration::congestionControl,
+     * the new one starts from scratch.
+    **/
+    void setCongestionControl(CongestionController::Mode mode);
+    void setCongestionController(
+        const boost::shared_ptr<CongestionController>& controller);
+    CongestionController::State getCongestionState() const;
+
+private:
+    bool sendMessage(ChannelId channel, Delivery delivery, const char* data,
+        size_t size, Milliseconds now);
+    void sendUnreliable(unsigned char type, const char* header,
+        size_t headerSize, const char* data, size_t size);
+    void queueData(unsigned char type, ChannelId channel, const char* header,
+        size_t headerSize, const char* data, size_t size, bool last,
+        Milliseconds now);
+    void transmitPending(Milliseconds now);
+    void transmit(Outgoing& o, Milliseconds now);
+    void dataReceived(const PacketSlice& packet);
+    void channelDataReceived(const PacketSlice& packet);
+    void deliver(ChannelId channel, ReceivingChannel& receiving,
+        const PacketSlice& packet);
+    void abandonAssembly(ReceivingChannel& receiving);
+    void releaseAssembly(ReceivingChannel& receiving);
+    bool reserveReassemblyMemory(size_t size);
+    void fragmentReceived(const PacketSlice& packet, Milliseconds now);
+    void expirePartialMessages(Milliseconds now);
+    void discardPartialMessage(std::map<boost::uint32_t, PartialMessage,
+        SequenceLess>::iterator i);
+    void acknowledgementReceived(const PacketSlice& packet, Milliseconds now);
+    void sendAcknowledgement(boost::uint32_t received);
+    void sampleRTT(Milliseconds rtt);
+};
@@ -0,0 +1,184 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    SendScheduler.cpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Implementation of the scheduler of the reliable channel.
+**/
+
+/* STL includes */
+#include <algorithm>
+
+/* WebP2P includes */
+#include "SendScheduler.hpp"
+
+SendScheduler::ClassStatistics::ClassStatistics() :
+    messagesQueued(0),
+    messagesSent(0),
+    bytesSent(0),
+    packetsWaiting(0),
+    bytesWaiting(0),
+    totalDelay(0),
+    maxDelay(0) {
+}
+
+SendScheduler::Milliseconds SendScheduler::ClassStatistics::averageDelay()
+    const {
+    return messagesSent > 0 ? totalDelay / messagesSent : 0;
+}
+
+SendScheduler::Class::Class() :
+    priority(PRIORITY_NORMAL),
+    weight(1),
+    deficit(0) {
+}
+
+SendScheduler::SendScheduler(size_t quantum) :
+    quantum(std::max<size_t>(quantum, 1)),
+    packets(0) {
+}
+
+void SendScheduler::setPriority(ClassId id, Priority priority) {
+    Class& c = classes[id];
+    if(c.priority == priority)
+        return;
+    /* a class with packets waiting moves to the turns of its new priority */
+    bool waiting = !c.queue.empty();
+    if(waiting)
+        deactivate(id, c);
+    c.priority = priority;
+    if(waiting)
+        activate(id, c);
+}
+
+SendScheduler::Priority SendScheduler::getPriority(ClassId id) const {
+    std::map<ClassId, Class>::const_iterator i = classes.find(id);
+    return i == classes.end() ? PRIORITY_NORMAL : i->second.priority;
+}
+
+void SendScheduler::setWeight(ClassId id, unsigned weight) {
+    classes[id].weight = std::max(weight, 1u);
+}
+
+unsigned SendScheduler::getWeight(ClassId id) const {
+    std::map<ClassId, Class>::const_iterator i = classes.find(id);
+    return i == classes.end() ? 1 : i->second.weight;
+}
+
+void SendScheduler::enqueue(ClassId id, const PacketBufferPtr& buffer,
+    size_t size, bool lastOfMessage, Milliseconds now) {
+    Class& c = classes[id];
+    if(c.queue.empty())
+        activate(id, c);
+    Queued queued;
+    queued.buffer = buffer;
+    queued.size = size;
+    queued.last = lastOfMessage;
+    queued.queuedAt = now;
+    c.queue.push_back(queued);
+    c.statistics.packetsWaiting++;
+    c.statistics.bytesWaiting += size;
+    if(lastOfMessage)
+        c.statistics.messagesQueued++;
+    packets++;
+}
+
+bool SendScheduler::empty() const {
+    return packets == 0;
+}
+
+size_t SendScheduler::size() const {
+    return packets;
+}
+
+size_t SendScheduler::nextSize() {
+    return current().queue.front().size;
+}
+
+PacketBufferPtr SendScheduler::pop(size_t& size, Milliseconds now) {
+    /* current() may pass the turn on, the class is the one it settles on */
+    Class& c = current();
+    ClassId id = currentTurns().front();
+    Queued queued = c.queue.front();
+    c.queue.pop_front();
+    packets--;
+    c.deficit -= queued.size;
+
+    ClassStatistics& s = c.statistics;
+    s.packetsWaiting--;
+    s.bytesWaiting -= queued.size;
+    s.bytesSent += queued.size;
+    if(queued.last) {
+        Milliseconds delay = now - queued.queuedAt;
+        s.messagesSent++;
+        s.totalDelay += delay;
+        s.maxDelay = std::max(s.maxDelay, delay);
+    }
+
+    if(c.queue.empty())
+        deactivate(id, c);
+    size = queued.size;
+    return queued.buffer;
+}
+
+SendScheduler::ClassStatistics SendScheduler::getStatistics(ClassId id) const {
+    std::map<ClassId, Class>::const_iterator i = classes.find(id);
+    return i == classes.end() ? ClassStatistics() : i->second.statistics;
+}
+
+std::deque<SendScheduler::ClassId>& SendScheduler::currentTurns() {
+    /* the highest priority with packets waiting */
+    return active.rbegin()->second;
+}
+
+void SendScheduler::activate(ClassId id, Class& c) {
+    std::deque<ClassId>& turns = active[c.priority];
+    /* the only one has its turn right away, the others wait for theirs */
+    c.deficit = turns.empty() ? quantum * c.weight : 0;
+    turns.push_back(id);
+}
+
+void SendScheduler::deactivate(ClassId id, Class& c) {
+    std::map<Priority, std::deque<ClassId> >::iterator level
+        = active.find(c.priority);
+    std::deque<ClassId>& turns = level->second;
+    bool hadTurn = turns.front() == id;
+    turns.erase(std::find(turns.begin(), turns.end(), id));
+    c.deficit = 0;
+    if(turns.empty()) {
+        active.erase(level);
+    } else if(hadTurn) {
+        Class& next = classes[turns.front()];
+        next.deficit += quantum * next.weight;
+    }
+}
+
+SendScheduler::Class& SendScheduler::current() {
+    /* The class whose turn it is while it has the bytes for its next
+     * packet, then the next one gets a quantum more for its turn.
+    **/
+    std::deque<ClassId>& turns = currentTurns();
+    for(;;) {
+        Class& c = classes[turns.front()];
+        if(c.deficit >= c.queue.front().size)
+            return c;
+        turns.push_back(turns.front());
+        turns.pop_front();
+        Class& next = classes[turns.front()];
+        next.deficit += quantum * next.weight;
+    }
+}
@@ -0,0 +1,124 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    SendScheduler.hpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Definition of the scheduler that decides which channel of the
+ *              reliable channel sends next once the windows let a packet
+ *              out. Higher priorities always go first; channels of the same
+ *              priority share what is left by their weights.
+**/
+
+#pragma once
+
+/* STL includes */
+#include <deque>
+#include <map>
+
+/* Boost includes */
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+/* WebP2P includes */
+#include "PacketBuffer.hpp"
+
+/* Packets wait in a queue per class. Within a priority the classes take
+ * turns by deficit round robin (Shreedhar and Varghese), counted in bytes,
+ * so a class of large packets gets no more than its weight worth.
+**/
+class SendScheduler : boost::noncopyable {
+public:
+    typedef unsigned long long Milliseconds;
+    typedef boost::uint16_t    ClassId;
+
+    enum Priority {
+        PRIORITY_BACKGROUND,
+        PRIORITY_NORMAL,
+        PRIORITY_HIGH,
+        PRIORITY_URGENT
+    };
+
+    struct ClassStatistics {
+        unsigned long long messagesQueued;
+        unsigned long long messagesSent;
+        unsigned long long bytesSent;
+        size_t             packetsWaiting;
+        size_t             bytesWaiting;
+        /* from enqueue() until the last packet of a message left */
+        Milliseconds       totalDelay;
+        Milliseconds       maxDelay;
+
+        ClassStatistics();
+        Milliseconds averageDelay() const;
+    };
+
+private:
+    struct Queued {
+        PacketBufferPtr buffer;
+        size_t          size;
+        bool            last;
+        Milliseconds    queuedAt;
+    };
+
+    struct Class {
+        Priority           priority;
+        unsigned           weight;
+        /* bytes the class may still send in its turn */
+        size_t             deficit;
+        std::deque<Queued> queue;
+        ClassStatistics    statistics;
+
+        Class();
+    };
+
+    /* bytes of a turn for a weight of one */
+    size_t                   quantum;
+    std::map<ClassId, Class> classes;
+    /* the classes with packets waiting, the one whose turn it is first */
+    std::map<Priority, std::deque<ClassId> > active;
+    size_t                   packets;
+
+    std::deque<ClassId>& currentTurns();
+    void activate(ClassId id, Class& c);
+    void deactivate(ClassId id, Class& c);
+    Class& current();
+
+public:
+    SendScheduler(size_t quantum);
+
+    /* PRIORITY_NORMAL and a weight of one until set otherwise */
+    void setPriority(ClassId id, Priority priority);
+    Priority getPriority(ClassId id) const;
+    void setWeight(ClassId id, unsigned weight);
+    unsigned getWeight(ClassId id) const;
+
+    /* the packets of a message go in one after the other, the last one
+     * marked as such
+    **/
+    void enqueue(ClassId id, const PacketBufferPtr& buffer, size_t size,
+        bool lastOfMessage, Milliseconds now);
+
+    bool empty() const;
+    size_t size() const;
+    /* The size of the packet that goes next, pop() takes it. Neither may
+     * be called while empty().
+    **/
+    size_t nextSize();
+    PacketBufferPtr pop(size_t& size, Milliseconds now);
+
+    ClassStatistics getStatistics(ClassId id) const;
+};
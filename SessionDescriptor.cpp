@@ -22,31 +22,43 @@
  * See also:    http://tools.ietf.org/html/rfc4566
 **/
 
-/* Boost includes */
-#include <boost/variant/get.hpp>
-
 /* WebP2P includes */
 #include "SessionDescriptor.hpp"
 #include "SessionDescriptorGrammar.hpp"
+#include "SessionDescriptorParser.hpp"
+#include "SessionDescriptorView.hpp"
+#include "SessionDescriptorWriter.hpp"
 
 SessionDescriptor::SessionDescriptor() {
 }
 
-SessionDescriptor::SessionDescriptor(const std::string& sdpString)
-    throw(std::exception) {
+SessionDescriptor::SessionDescriptor(
+    const std::string& sdpString,
+    ParseMode mode) throw(std::exception) {
     using namespace boost::spirit::qi;
 
+    if(mode == PARSE_FAST) {
+        SessionDescriptorView view;
+        SessionDescriptorParser::Error error;
+        if(SessionDescriptorParser::parse(sdpString, view, error))
+            view.materialize(data);
+        else
+            std::cout << "No match found: " << error.toString() << "\n";
+        return;
+    }
+
     std::string::const_iterator begin = sdpString.begin();
     std::string::const_iterator end   = sdpString.end();
-    SessionDescriptorGrammar sdpGrammar;
-    bool success;
+    const SessionDescriptorGrammar& sdpGrammar
+        = SessionDescriptorGrammar::instance();
+    bool success = false;
     
     std::cout << "Attempting to parse the following SDP string:\n"
               << sdpString;
 
     try {
-        success = phrase_parse(begin, end, sdpGrammar, !byte_, data);
-    } catch (std::exception ex) {
+        success = parse(begin, end, sdpGrammar, data);
+    } catch (const std::exception& ex) {
         std::cout << "Parse exception: " << ex.what() << "\n";
     }
     bool fullMatch = (begin == end);
@@ -68,73 +80,14 @@ SessionDescriptor::~SessionDescriptor() {
 }
 
 SessionDescriptor::operator std::string() {
-    std::stringstream ss;
-    /* v= */
-    ss << "v=" << data.protocolVersion       << "\n";
-
-    /* o= */
-    ss << "o=" << data.origin.username       << " "
-               << data.origin.sessionID      << " "
-               << data.origin.sessionVersion << " "
-               << data.origin.netType        << " "
-               << data.origin.addressType    << " "
-               << data.origin.unicastAddress << "\n";
-
-    /* s= */
-    ss << "s=" << data.sessionName           << "\n";
-    
-    /* t= */
-    for(std::vector<Time>::iterator i = data.time.begin();
-        i != data.time.end(); i++) {
-        ss << "t=" << i->startTime           << " "
-                   << i->stopTime            << "\n";
-    }
-
-    /* a= */
-    for(std::vector<Attribute>::iterator i = data.sessionAttributes.begin();
-        i != data.sessionAttributes.end(); i++) {
-        Attribute &v = *i;
-        if(PropertyAttribute* at = boost::get<PropertyAttribute>(&v))
-            ss << "a=" << *at                         << "\n";
-        else if(ValuedAttribute* at = boost::get<ValuedAttribute>(&v))
-            ss << "a=" << boost::fusion::at_c<0>(*at) << ":"
-                       << boost::fusion::at_c<1>(*at) << "\n";
-    }
-
-    for(std::vector<MediaDescription>::iterator i = data.mediaDescriptions.begin();
-        i != data.mediaDescriptions.end(); i++) {
-
-        /* m= */
-        ss << "m=" << i->media.mediaName << " "
-                   << i->media.port      << " "
-                   << i->media.protocolName;
-        for(std::vector<std::string>::iterator j = i->media.formats.begin();
-            j != i->media.formats.end(); j++) {
-            ss << " " << *j;
-        }
-        ss << "\n";
-
-        /* c= */
-        for(std::vector<ConnectionData>::iterator j = i->connectionData.begin();
-            j != i->connectionData.end(); j++) {
-            ss << "c=" << j->netType           << " "
-                       << j->addressType       << " "
-                       << j->connectionAddress << "\n";
-        }
+    std::string result;
+    appendTo(result);
+    return result;
+}
 
-        /* a= */
-        for(std::vector<Attribute>::iterator j
-            = i->mediaAttributes.begin();
-            j != i->mediaAttributes.end(); j++) {
-            Attribute &v = *j;
-            if(PropertyAttribute* at = boost::get<PropertyAttribute>(&v))
-                ss << "a=" << *at << "\n";
-            else if(ValuedAttribute* at = boost::get<ValuedAttribute>(&v))
-                ss << "a=" << boost::fusion::at_c<0>(*at) << ":"
-                           << boost::fusion::at_c<1>(*at) << "\n";
-        }
-    }
-    return ss.str();
+void SessionDescriptor::appendTo(std::string& out) const {
+    StringBuffer buffer(out);
+    SessionDescriptorWriter<StringBuffer>(buffer).write(data);
 }
 
 SessionDescriptorData& SessionDescriptor::getData() {
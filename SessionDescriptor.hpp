@@ -30,10 +30,19 @@
 class SessionDescriptor {
     SessionDescriptorData data;
 public:
+    /* PARSE_FAST uses the single-pass SessionDescriptorParser, PARSE_STRICT
+     * parses with the complete RFC 4566 SessionDescriptorGrammar, which also
+     * validates addresses and other field contents.
+    **/
+    enum ParseMode { PARSE_FAST, PARSE_STRICT };
+
     SessionDescriptor();
-    SessionDescriptor(const std::string& sdpString) throw(std::exception);
+    SessionDescriptor(const std::string& sdpString,
+                      ParseMode mode = PARSE_FAST) throw(std::exception);
     ~SessionDescriptor();	
     
     operator std::string();
+    /* Appends the serialized message to out, see SessionDescriptorWriter. */
+    void appendTo(std::string& out) const;
     SessionDescriptorData& getData();
 };
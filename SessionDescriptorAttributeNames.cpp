@@ -0,0 +1,87 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    SessionDescriptorAttributeNames.cpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Implementation of the attribute name lookup.
+**/
+
+/* STL includes */
+#include <cstring>
+
+/* WebP2P includes */
+#include "SessionDescriptorAttributeNames.hpp"
+
+/* in AttributeName order */
+static const char* const attributeNames[ATTRIBUTE_NAME_COUNT] = {
+    "",
+    "cat", "keywds", "tool", "ptime", "maxptime", "rtpmap", "recvonly",
+    "sendrecv", "sendonly", "inactive", "orient", "type", "charset",
+    "sdplang", "lang", "framerate", "quality", "fmtp",
+    "candidate", "remote-candidates", "ice-lite", "ice-mismatch",
+    "ice-ufrag", "ice-pwd", "ice-options",
+    "rtcp", "rtcp-mux", "mid", "group", "ssrc", "setup", "fingerprint"
+};
+
+/* The constants were picked so that every well-known name lands in its own
+ * slot; the regression tests check that this still holds.
+**/
+static inline unsigned attributeNameHash(const char* name, size_t size) {
+    unsigned char first  = name[0];
+    unsigned char middle = name[size / 2];
+    unsigned char last   = name[size - 1];
+    return (static_cast<unsigned>(size) + first + 6 * last + 3 * middle) & 127;
+}
+
+class AttributeNameTable {
+    unsigned char slots[128];
+    std::string   strings[ATTRIBUTE_NAME_COUNT];
+public:
+    AttributeNameTable() {
+        memset(slots, ATTRIBUTE_UNKNOWN, sizeof(slots));
+        for(unsigned i = 1; i < ATTRIBUTE_NAME_COUNT; i++) {
+            strings[i] = attributeNames[i];
+            slots[attributeNameHash(attributeNames[i],
+                strlen(attributeNames[i]))] = static_cast<unsigned char>(i);
+        }
+    }
+
+    AttributeName lookup(const char* name, size_t size) const {
+        if(size == 0)
+            return ATTRIBUTE_UNKNOWN;
+        unsigned char slot = slots[attributeNameHash(name, size)];
+        const std::string& candidate = strings[slot];
+        if(candidate.size() != size
+            || memcmp(candidate.data(), name, size) != 0)
+            return ATTRIBUTE_UNKNOWN;
+        return static_cast<AttributeName>(slot);
+    }
+
+    const std::string& toString(AttributeName name) const {
+        return strings[name];
+    }
+};
+
+static const AttributeNameTable attributeNameTable;
+
+AttributeName AttributeNames::lookup(const char* name, size_t size) {
+    return attributeNameTable.lookup(name, size);
+}
+
+const std::string& AttributeNames::toString(AttributeName name) {
+    return attributeNameTable.toString(name);
+}
@@ -0,0 +1,80 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    SessionDescriptorAttributeNames.hpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Well-known SDP attribute names, recognised with a perfect
+ *              hash.
+ * See:         http://tools.ietf.org/html/rfc4566#section-6
+ *              http://tools.ietf.org/html/rfc5245#section-15
+**/
+
+#pragma once
+
+/* STL includes */
+#include <string>
+
+enum AttributeName {
+    ATTRIBUTE_UNKNOWN,
+    /* RFC 4566 */
+    ATTRIBUTE_CAT,
+    ATTRIBUTE_KEYWDS,
+    ATTRIBUTE_TOOL,
+    ATTRIBUTE_PTIME,
+    ATTRIBUTE_MAXPTIME,
+    ATTRIBUTE_RTPMAP,
+    ATTRIBUTE_RECVONLY,
+    ATTRIBUTE_SENDRECV,
+    ATTRIBUTE_SENDONLY,
+    ATTRIBUTE_INACTIVE,
+    ATTRIBUTE_ORIENT,
+    ATTRIBUTE_TYPE,
+    ATTRIBUTE_CHARSET,
+    ATTRIBUTE_SDPLANG,
+    ATTRIBUTE_LANG,
+    ATTRIBUTE_FRAMERATE,
+    ATTRIBUTE_QUALITY,
+    ATTRIBUTE_FMTP,
+    /* RFC 5245 */
+    ATTRIBUTE_CANDIDATE,
+    ATTRIBUTE_REMOTE_CANDIDATES,
+    ATTRIBUTE_ICE_LITE,
+    ATTRIBUTE_ICE_MISMATCH,
+    ATTRIBUTE_ICE_UFRAG,
+    ATTRIBUTE_ICE_PWD,
+    ATTRIBUTE_ICE_OPTIONS,
+    /* RTP and other common extensions */
+    ATTRIBUTE_RTCP,
+    ATTRIBUTE_RTCP_MUX,
+    ATTRIBUTE_MID,
+    ATTRIBUTE_GROUP,
+    ATTRIBUTE_SSRC,
+    ATTRIBUTE_SETUP,
+    ATTRIBUTE_FINGERPRINT,
+    ATTRIBUTE_NAME_COUNT
+};
+
+class AttributeNames {
+public:
+    /* Maps a name to its enum value, ATTRIBUTE_UNKNOWN if it is not one of
+     * the well-known names. Costs one hash and one compare.
+    **/
+    static AttributeName lookup(const char* name, size_t size);
+
+    /* The spelling of a well-known name, shared by every caller. */
+    static const std::string& toString(AttributeName name);
+};
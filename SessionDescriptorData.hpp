@@ -29,6 +29,7 @@
 
 /* Boost includes */
 #include <boost/fusion/include/adapt_struct.hpp>
+#include <boost/fusion/include/equal_to.hpp>
 #include <boost/fusion/include/vector.hpp>
 #include <boost/fusion/sequence/intrinsic/at_c.hpp>
 #include <boost/variant.hpp>
@@ -257,3 +258,47 @@ BOOST_FUSION_ADAPT_STRUCT(
   (std::vector<MediaDescription>, mediaDescriptions)
 )
 
+/* Field-wise comparison, used to check parsers against each other. */
+inline bool operator==(const Origin& a, const Origin& b) {
+    return a.username       == b.username
+        && a.sessionID      == b.sessionID
+        && a.sessionVersion == b.sessionVersion
+        && a.netType        == b.netType
+        && a.addressType    == b.addressType
+        && a.unicastAddress == b.unicastAddress;
+}
+
+inline bool operator==(const ConnectionData& a, const ConnectionData& b) {
+    return a.netType           == b.netType
+        && a.addressType       == b.addressType
+        && a.connectionAddress == b.connectionAddress;
+}
+
+inline bool operator==(const Time& a, const Time& b) {
+    return a.startTime == b.startTime
+        && a.stopTime  == b.stopTime;
+}
+
+inline bool operator==(const Media& a, const Media& b) {
+    return a.mediaName    == b.mediaName
+        && a.port         == b.port
+        && a.protocolName == b.protocolName
+        && a.formats      == b.formats;
+}
+
+inline bool operator==(const MediaDescription& a, const MediaDescription& b) {
+    return a.media           == b.media
+        && a.connectionData  == b.connectionData
+        && a.mediaAttributes == b.mediaAttributes;
+}
+
+inline bool operator==(
+    const SessionDescriptorData& a,
+    const SessionDescriptorData& b) {
+    return a.protocolVersion   == b.protocolVersion
+        && a.origin            == b.origin
+        && a.sessionName       == b.sessionName
+        && a.time              == b.time
+        && a.sessionAttributes == b.sessionAttributes
+        && a.mediaDescriptions == b.mediaDescriptions;
+}
@@ -22,7 +22,7 @@
 **/
 
 /* Boost includes */
-#include <boost/spirit/home/phoenix.hpp>
+#include <boost/spirit/include/phoenix.hpp>
 
 /* WebP2P includes */
 #include "SessionDescriptorGenericGrammar.hpp"
@@ -76,7 +76,9 @@ SessionDescriptorGenericGrammar::SessionDescriptorGenericGrammar() {
                         // less than "224"
 
     /* The following is consistent with RFC 2373, Appendix B. */
-    IP6_address         %= hexpart >> -(string(":") >> IP4_address);
+    IP6_address         %= raw[hexpart >> -(string(":") >> IP4_address)];
+                        // raw[] keeps the colons that hexseq skips and
+                        // drops characters left behind by backtracking
     hexpart             %= (hexseq  >> string("::") >> -hexseq)
                          | (           string("::") >> -hexseq)
                          | (                            hexseq);
@@ -91,7 +93,7 @@ SessionDescriptorGenericGrammar::SessionDescriptorGenericGrammar() {
                         // default is to interpret this as UTF8 text.
                         // ISO 8859-1 requires "a=charset:ISO-8859-1"
                         // session-level attribute to be used
-    byte_string         %= +(char_('\x00', '\x09')
+    byte_string         %= +(char_('\x01', '\x09')
                          |   char_('\x0B', '\x0C')
                          |   char_('\x0E', '\xFF'));
     non_ws_string       %= +(char_('\x21', '\x7E')
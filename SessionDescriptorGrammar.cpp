@@ -34,6 +34,7 @@
 #include <boost/spirit/include/phoenix_operator.hpp>
 #include <boost/spirit/include/phoenix_scope.hpp>
 #include <boost/spirit/include/phoenix_statement.hpp>
+#include <boost/thread/tss.hpp>
 
 /* WebP2P includes */
 #include "SessionDescriptorData.hpp"
@@ -175,8 +176,10 @@ SessionDescriptorGrammar::SessionDescriptorGrammar() :
                           | (+sdp.email_safe >> char_('<') 
                                                          >> phone >> char_('>'))
                           | phone;
-    phone                %= -char_('+') >> abnf.DIGIT 
-                                        >> +(abnf.SP | char_('-') | abnf.DIGIT);
+    /* string() rather than char_() so that every element of the sequence
+     * synthesizes a std::string, which newer versions of Spirit require */
+    phone                %= -string("+") >> abnf.DIGIT 
+                                        >> +(abnf.SP | string("-") | abnf.DIGIT);
 
     /* sub-rules of 'c=' */
     connection_address   %= sdp.unicast_address/*
@@ -287,4 +290,15 @@ SessionDescriptorGrammar::SessionDescriptorGrammar() :
     fmt.name("media");
     proto.name("proto");
     port.name("port");
+}
+
+/* Lives at namespace scope so that it is constructed before any thread can
+ * race on it; the grammar itself is created lazily per thread.
+**/
+static boost::thread_specific_ptr<SessionDescriptorGrammar> cachedGrammar;
+
+const SessionDescriptorGrammar& SessionDescriptorGrammar::instance() {
+    if(!cachedGrammar.get())
+        cachedGrammar.reset(new SessionDescriptorGrammar());
+    return *cachedGrammar;
 }
\ No newline at end of file
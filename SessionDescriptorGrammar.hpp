@@ -33,7 +33,7 @@
 #include "SessionDescriptorGenericGrammar.hpp"
 #include "SessionDescriptorData.hpp"
  
-class ParseException : std::exception {
+class ParseException : public std::exception {
 private:
     std::string errorDescription;
 public:
@@ -114,4 +114,10 @@ struct SessionDescriptorGrammar :
         session_description;
     
     SessionDescriptorGrammar();
+
+    /* Building the grammar instantiates well over a hundred rules, so callers
+     * should parse with this cached instance. It is created once per thread
+     * on first use and never modified afterwards.
+    **/
+    static const SessionDescriptorGrammar& instance();
 };
\ No newline at end of file
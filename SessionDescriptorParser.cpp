@@ -0,0 +1,542 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    SessionDescriptorParser.cpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Implementation of the hand-written, single-pass SDP parser.
+ * See:         http://tools.ietf.org/html/rfc4566
+**/
+
+/* STL includes */
+#include <cstring>
+#include <sstream>
+
+/* WebP2P includes */
+#include "SessionDescriptorParser.hpp"
+
+typedef SessionDescriptorParser::it it;
+
+/* character classes, see SessionDescriptorGenericGrammar */
+enum CharacterClass {
+    TOKEN_CHAR  = 0x01,
+    NON_WS_CHAR = 0x02,
+    DIGIT_CHAR  = 0x04,
+    ICE_CHAR    = 0x08
+};
+
+class CharacterClassTable {
+    unsigned char table[256];
+public:
+    CharacterClassTable() {
+        for(unsigned c = 0; c < 256; c++) {
+            table[c] = 0;
+            if(c == 0x21
+                || (c >= 0x23 && c <= 0x27)
+                || (c >= 0x2A && c <= 0x2B)
+                || (c >= 0x2D && c <= 0x2E)
+                || (c >= 0x30 && c <= 0x39)
+                || (c >= 0x41 && c <= 0x5A)
+                || (c >= 0x5E && c <= 0x7E))
+                table[c] |= TOKEN_CHAR;
+            if((c >= 0x21 && c <= 0x7E) || c >= 0x80)
+                table[c] |= NON_WS_CHAR;
+            if(c >= '0' && c <= '9')
+                table[c] |= DIGIT_CHAR;
+            if((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z')
+                || (c >= 'a' && c <= 'z') || c == '+' || c == '/')
+                table[c] |= ICE_CHAR;
+        }
+    }
+
+    bool is(char c, CharacterClass characterClass) const {
+        return (table[static_cast<unsigned char>(c)] & characterClass) != 0;
+    }
+};
+
+static const CharacterClassTable characterClasses;
+
+static inline bool isTokenChar(char c) {
+    return characterClasses.is(c, TOKEN_CHAR);
+}
+
+static inline bool isNonWsChar(char c) {
+    return characterClasses.is(c, NON_WS_CHAR);
+}
+
+static inline bool isDigit(char c) {
+    return characterClasses.is(c, DIGIT_CHAR);
+}
+
+static inline bool isIceChar(char c) {
+    return characterClasses.is(c, ICE_CHAR);
+}
+
+/* scanners, these advance p past what they matched and fail without
+ * consuming anything
+**/
+static inline bool scanToken(it& p, it end, StringView& out) {
+    it start = p;
+    while(p != end && isTokenChar(*p))
+        ++p;
+    out = StringView(start, p);
+    return p != start;
+}
+
+static inline bool scanIceChars(it& p, it end, StringView& out) {
+    it start = p;
+    while(p != end && isIceChar(*p))
+        ++p;
+    out = StringView(start, p);
+    return p != start;
+}
+
+static inline bool scanNonWsString(it& p, it end, StringView& out) {
+    it start = p;
+    while(p != end && isNonWsChar(*p))
+        ++p;
+    out = StringView(start, p);
+    return p != start;
+}
+
+template<typename T>
+static inline bool scanUnsigned(it& p, it end, T& out) {
+    const T max = static_cast<T>(~static_cast<T>(0));
+    it start = p;
+    T value = 0;
+    while(p != end && isDigit(*p)) {
+        T digit = static_cast<T>(*p - '0');
+        if(value > (max - digit) / 10) {
+            p = start;
+            return false;
+        }
+        value = value * 10 + digit;
+        ++p;
+    }
+    out = value;
+    return p != start;
+}
+
+/* byte-string is anything but NUL, CR and LF, the line terminators are
+ * split off already
+**/
+static inline bool isByteString(it begin, it end) {
+    return begin != end && !memchr(&*begin, '\0', end - begin);
+}
+
+static inline bool scanChar(it& p, it end, char c) {
+    if(p == end || *p != c)
+        return false;
+    ++p;
+    return true;
+}
+
+static inline bool scanKeyword(it& p, it end, const char* keyword) {
+    it q = p;
+    for(; *keyword; ++keyword, ++q) {
+        if(q == end || *q != *keyword)
+            return false;
+    }
+    p = q;
+    return true;
+}
+
+bool SessionDescriptorParser::nextLine(
+    it begin, it end, it& lineEnd, it& next) {
+    if(begin == end)
+        return false;
+
+    /* memchr is vectorized on most platforms, the byte loop is not */
+    const char* first = &*begin;
+    size_t size = end - begin;
+    const char* lf = static_cast<const char*>(memchr(first, '\n', size));
+    size_t lineSize = lf ? lf - first : size;
+    const char* cr = static_cast<const char*>(memchr(first, '\r', lineSize));
+
+    if(cr) {
+        lineEnd = begin + (cr - first);
+        next = lineEnd + ((cr + 1 == lf) ? 2 : 1);
+    } else if(lf) {
+        lineEnd = begin + lineSize;
+        next = lineEnd + 1;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool SessionDescriptorParser::parseVersion(
+    it begin, it end, unsigned long long& version) {
+    return scanUnsigned(begin, end, version) && begin == end;
+}
+
+bool SessionDescriptorParser::parseOrigin(
+    it begin, it end, OriginView& origin) {
+    return scanNonWsString(begin, end, origin.username)
+        && scanChar(begin, end, ' ')
+        && scanUnsigned(begin, end, origin.sessionID)
+        && scanChar(begin, end, ' ')
+        && scanUnsigned(begin, end, origin.sessionVersion)
+        && scanChar(begin, end, ' ')
+        && scanToken(begin, end, origin.netType)
+        && scanChar(begin, end, ' ')
+        && scanToken(begin, end, origin.addressType)
+        && scanChar(begin, end, ' ')
+        && scanNonWsString(begin, end, origin.unicastAddress)
+        && begin == end;
+}
+
+bool SessionDescriptorParser::parseSessionName(
+    it begin, it end, StringView& sessionName) {
+    sessionName = StringView(begin, end);
+    return isByteString(begin, end);
+}
+
+bool SessionDescriptorParser::parseTime(it begin, it end, Time& time) {
+    return scanUnsigned(begin, end, time.startTime)
+        && scanChar(begin, end, ' ')
+        && scanUnsigned(begin, end, time.stopTime)
+        && begin == end;
+}
+
+bool SessionDescriptorParser::parseConnectionData(
+    it begin, it end, ConnectionDataView& c) {
+    return scanToken(begin, end, c.netType)
+        && scanChar(begin, end, ' ')
+        && scanToken(begin, end, c.addressType)
+        && scanChar(begin, end, ' ')
+        && scanNonWsString(begin, end, c.connectionAddress)
+        && begin == end;
+}
+
+bool SessionDescriptorParser::parseAttribute(
+    it begin, it end, AttributeView& attribute) {
+    if(!scanToken(begin, end, attribute.name))
+        return false;
+    attribute.id = AttributeNames::lookup(
+        &*attribute.name.begin(), attribute.name.size());
+    if(begin == end) {
+        attribute.value = StringView(end, end);
+        return true;
+    }
+    if(!scanChar(begin, end, ':') || !isByteString(begin, end))
+        return false;
+    attribute.value = StringView(begin, end);
+    return true;
+}
+
+bool SessionDescriptorParser::parseMedia(it begin, it end, MediaView& media) {
+    StringView part;
+    if(!scanToken(begin, end, media.mediaName)
+        || !scanChar(begin, end, ' ')
+        || !scanUnsigned(begin, end, media.port)
+        || !scanChar(begin, end, ' '))
+        return false;
+
+    /* proto is a '/' separated list of tokens */
+    it protoBegin = begin;
+    if(!scanToken(begin, end, part))
+        return false;
+    while(begin != end && *begin == '/') {
+        it slash = begin++;
+        if(!scanToken(begin, end, part)) {
+            begin = slash;
+            break;
+        }
+    }
+    media.protocolName = StringView(protoBegin, begin);
+
+    media.formats.clear();
+    while(scanChar(begin, end, ' ')) {
+        if(!scanToken(begin, end, part))
+            return false;
+        media.formats.push_back(part);
+    }
+    return !media.formats.empty() && begin == end;
+}
+
+bool SessionDescriptorParser::parseCandidate(
+    it begin, it end, CandidateView& c) {
+    c.relatedAddress = StringView(end, end);
+    c.relatedPort = 0;
+    c.extensions.clear();
+
+    if(!scanIceChars(begin, end, c.foundation)
+        || c.foundation.size() > 32
+        || !scanChar(begin, end, ' ')
+        || !scanUnsigned(begin, end, c.componentID)
+        || !scanChar(begin, end, ' ')
+        || !scanToken(begin, end, c.transport)
+        || !scanChar(begin, end, ' ')
+        || !scanUnsigned(begin, end, c.priority)
+        || !scanChar(begin, end, ' ')
+        || !scanNonWsString(begin, end, c.connectionAddress)
+        || !scanChar(begin, end, ' ')
+        || !scanUnsigned(begin, end, c.port)
+        || !scanKeyword(begin, end, " typ ")
+        || !scanToken(begin, end, c.type))
+        return false;
+
+    if(scanKeyword(begin, end, " raddr ")
+        && !scanNonWsString(begin, end, c.relatedAddress))
+        return false;
+    if(scanKeyword(begin, end, " rport ")
+        && !scanUnsigned(begin, end, c.relatedPort))
+        return false;
+
+    /* extension-att-name SP extension-att-value pairs */
+    while(begin != end) {
+        AttributeView extension;
+        if(!scanChar(begin, end, ' ')
+            || !scanNonWsString(begin, end, extension.name)
+            || !scanChar(begin, end, ' ')
+            || !scanNonWsString(begin, end, extension.value))
+            return false;
+        c.extensions.push_back(extension);
+    }
+    return true;
+}
+
+bool SessionDescriptorParser::nextState(State& state, char type) {
+    switch(type) {
+    case 'v':
+        if(state != EXPECT_VERSION)
+            return false;
+        state = EXPECT_ORIGIN;
+        return true;
+    case 'o':
+        if(state != EXPECT_ORIGIN)
+            return false;
+        state = EXPECT_SESSION_NAME;
+        return true;
+    case 's':
+        if(state != EXPECT_SESSION_NAME)
+            return false;
+        state = EXPECT_TIME;
+        return true;
+    case 't':
+        if(state != EXPECT_TIME && state != SESSION_TIME)
+            return false;
+        state = SESSION_TIME;
+        return true;
+    case 'a':
+        if(state == SESSION_TIME || state == SESSION_ATTRIBUTES)
+            state = SESSION_ATTRIBUTES;
+        else if(state == MEDIA_CONNECTION_DATA || state == MEDIA_ATTRIBUTES)
+            state = MEDIA_ATTRIBUTES;
+        else
+            return false;
+        return true;
+    case 'm':
+        if(!isComplete(state))
+            return false;
+        state = MEDIA_CONNECTION_DATA;
+        return true;
+    case 'c':
+        return state == MEDIA_CONNECTION_DATA;
+    default:
+        return false;
+    }
+}
+
+bool SessionDescriptorParser::isComplete(State state) {
+    return state != EXPECT_VERSION && state != EXPECT_ORIGIN
+        && state != EXPECT_SESSION_NAME && state != EXPECT_TIME;
+}
+
+bool SessionDescriptorParser::nextLine(it begin, it end, size_t offset,
+    const Limits& limits, it& lineEnd, it& next, Error& error) {
+    /* room for the longest line and a two character terminator */
+    it window = end;
+    if(static_cast<size_t>(end - begin) > limits.maxLineLength + 2)
+        window = begin + limits.maxLineLength + 2;
+
+    if(!nextLine(begin, window, lineEnd, next)) {
+        if(window != end)
+            return error.set(Error::LIMIT_EXCEEDED, offset, "maxLineLength");
+        return error.set(
+            Error::MISSING_LINE_TERMINATOR, offset + (end - begin), "eol");
+    }
+    if(static_cast<size_t>(lineEnd - begin) > limits.maxLineLength)
+        return error.set(Error::LIMIT_EXCEEDED, offset, "maxLineLength");
+    return true;
+}
+
+bool SessionDescriptorParser::beginLine(it begin, it lineEnd, size_t offset,
+    const Limits& limits, Counts& counts, State& state, char& type,
+    Error& error) {
+    if(++counts.lines > limits.maxLines)
+        return error.set(Error::LIMIT_EXCEEDED, offset, "maxLines");
+    if(lineEnd - begin < 2 || *(begin + 1) != '=')
+        return error.set(Error::MALFORMED_LINE, offset, ruleName(state));
+    type = *begin;
+    State current = state;
+    if(!nextState(state, type))
+        return error.set(Error::UNEXPECTED_LINE, offset, ruleName(current));
+    if(type == 'a' && ++counts.attributes > limits.maxAttributes)
+        return error.set(Error::LIMIT_EXCEEDED, offset, "maxAttributes");
+    if(type == 'm'
+        && ++counts.mediaDescriptions > limits.maxMediaDescriptions)
+        return error.set(Error::LIMIT_EXCEEDED, offset, "maxMediaDescriptions");
+    return true;
+}
+
+bool SessionDescriptorParser::countAttribute(const AttributeView& attribute,
+    size_t offset, const Limits& limits, Counts& counts, Error& error) {
+    if(attribute.id == ATTRIBUTE_CANDIDATE
+        && ++counts.candidates > limits.maxCandidates)
+        return error.set(Error::LIMIT_EXCEEDED, offset, "maxCandidates");
+    return true;
+}
+
+const char* SessionDescriptorParser::ruleName(char type) {
+    switch(type) {
+    case 'v': return "proto-version";
+    case 'o': return "origin-field";
+    case 's': return "session-name-field";
+    case 't': return "time-fields";
+    case 'a': return "attribute";
+    case 'm': return "media-field";
+    case 'c': return "connection-field";
+    default:  return "";
+    }
+}
+
+const char* SessionDescriptorParser::ruleName(State state) {
+    switch(state) {
+    case EXPECT_VERSION:        return "proto-version";
+    case EXPECT_ORIGIN:         return "origin-field";
+    case EXPECT_SESSION_NAME:   return "session-name-field";
+    case EXPECT_TIME:           return "time-fields";
+    case SESSION_TIME:          return "time-fields";
+    case SESSION_ATTRIBUTES:    return "attribute-fields";
+    case MEDIA_CONNECTION_DATA: return "connection-field";
+    case MEDIA_ATTRIBUTES:      return "attribute-fields";
+    default:                    return "";
+    }
+}
+
+bool SessionDescriptorParser::Error::set(
+    Code code, size_t offset, const char* expected) {
+    this->code     = code;
+    this->offset   = offset;
+    this->expected = expected;
+    return false;
+}
+
+std::string SessionDescriptorParser::Error::toString() const {
+    static const char* const descriptions[] = {
+        "no error",
+        "missing line terminator",
+        "malformed line",
+        "unexpected line",
+        "invalid value",
+        "incomplete message",
+        "limit exceeded"
+    };
+    std::stringstream ss;
+    ss << descriptions[code] << " at offset " << offset
+       << ", expecting " << expected;
+    return ss.str();
+}
+
+bool SessionDescriptorParser::parse(
+    const std::string& sdpString, SessionDescriptorView& view) {
+    Error error;
+    return parse(sdpString, view, error);
+}
+
+bool SessionDescriptorParser::parse(
+    const std::string& sdpString, SessionDescriptorView& view, Error& error,
+    const Limits& limits) {
+    State state = EXPECT_VERSION;
+    Counts counts;
+
+    view.time.clear();
+    view.sessionAttributes.clear();
+    view.sessionAttributeIndex.clear();
+    view.mediaDescriptions.clear();
+
+    it begin = sdpString.begin();
+    it end   = sdpString.end();
+    it p     = begin;
+    while(p != end) {
+        it lineEnd, next;
+        char type;
+        if(!nextLine(p, end, p - begin, limits, lineEnd, next, error)
+            || !beginLine(p, lineEnd, p - begin, limits, counts, state, type,
+                error))
+            return false;
+        it value = p + 2;
+        p = next;
+
+        bool success = false;
+        switch(type) {
+        case 'v':
+            success = parseVersion(value, lineEnd, view.protocolVersion);
+            break;
+        case 'o':
+            success = parseOrigin(value, lineEnd, view.origin);
+            break;
+        case 's':
+            success = parseSessionName(value, lineEnd, view.sessionName);
+            break;
+        case 't':
+            view.time.push_back(Time());
+            success = parseTime(value, lineEnd, view.time.back());
+            break;
+        case 'a': {
+            bool session = state == SESSION_ATTRIBUTES;
+            std::vector<AttributeView>& attributes = session
+                ? view.sessionAttributes
+                : view.mediaDescriptions.back().mediaAttributes;
+            attributes.push_back(AttributeView());
+            success = parseAttribute(value, lineEnd, attributes.back());
+            if(!success)
+                break;
+            if(!session && !countAttribute(
+                attributes.back(), value - begin - 2, limits, counts, error))
+                return false;
+            AttributeIndex& index = session
+                ? view.sessionAttributeIndex
+                : view.mediaDescriptions.back().mediaAttributeIndex;
+            index.add(attributes.back().id, attributes.size() - 1);
+            break;
+        }
+        case 'm':
+            view.mediaDescriptions.push_back(MediaDescriptionView());
+            success = parseMedia(
+                value, lineEnd, view.mediaDescriptions.back().media);
+            break;
+        case 'c': {
+            std::vector<ConnectionDataView>& connectionData
+                = view.mediaDescriptions.back().connectionData;
+            connectionData.push_back(ConnectionDataView());
+            success = parseConnectionData(
+                value, lineEnd, connectionData.back());
+            break;
+        }
+        }
+        if(!success)
+            return error.set(
+                Error::INVALID_VALUE, value - begin, ruleName(type));
+    }
+
+    if(!isComplete(state))
+        return error.set(Error::INCOMPLETE, end - begin, ruleName(state));
+    error = Error();
+    return true;
+}
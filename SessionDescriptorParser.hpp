@@ -0,0 +1,161 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    SessionDescriptorParser.hpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Definition of the hand-written, single-pass SDP parser. It
+ *              accepts the same language as SessionDescriptorViewGrammar,
+ *              which is kept as the reference implementation.
+ * See:         http://tools.ietf.org/html/rfc4566
+**/
+
+#pragma once
+
+/* STL includes */
+#include <string>
+
+/* WebP2P includes */
+#include "SessionDescriptorView.hpp"
+
+class SessionDescriptorParser {
+public:
+    typedef std::string::const_iterator it;
+
+    /* Position in the v= o= s= t=* a=* (m= c=* a=*)* line sequence. */
+    enum State {
+        EXPECT_VERSION,
+        EXPECT_ORIGIN,
+        EXPECT_SESSION_NAME,
+        EXPECT_TIME,
+        SESSION_TIME,
+        SESSION_ATTRIBUTES,
+        MEDIA_CONNECTION_DATA,
+        MEDIA_ATTRIBUTES
+    };
+
+    /* Resource limits, checked while parsing so that oversized input is
+     * rejected after O(limit) work. Line lengths exclude the terminator.
+    **/
+    struct Limits {
+        size_t maxLineLength;
+        size_t maxLines;
+        size_t maxAttributes;           /* session and media level */
+        size_t maxMediaDescriptions;
+        size_t maxCandidates;           /* a=candidate in media sections */
+
+        Limits() :
+            maxLineLength(4096),
+            maxLines(1024),
+            maxAttributes(512),
+            maxMediaDescriptions(16),
+            maxCandidates(64) {}
+    };
+
+    /* Running totals that the limits are checked against. */
+    struct Counts {
+        size_t lines;
+        size_t attributes;
+        size_t mediaDescriptions;
+        size_t candidates;
+
+        Counts() : lines(0), attributes(0), mediaDescriptions(0),
+            candidates(0) {}
+    };
+
+    /* Describes why a message was rejected. expected is the name of the
+     * rule in SessionDescriptorGrammar that could not be matched, or of the
+     * limit that was exceeded, and offset the position in the message where
+     * this happened.
+    **/
+    struct Error {
+        enum Code {
+            NONE,
+            MISSING_LINE_TERMINATOR,
+            MALFORMED_LINE,     /* not of the form "x=..." */
+            UNEXPECTED_LINE,    /* line type not allowed here */
+            INVALID_VALUE,      /* line value does not match its rule */
+            INCOMPLETE,         /* mandatory lines missing at the end */
+            LIMIT_EXCEEDED
+        };
+
+        Code        code;
+        size_t      offset;
+        const char* expected;
+
+        Error() : code(NONE), offset(0), expected("") {}
+
+        /* Sets the error and returns false, for use in return statements. */
+        bool set(Code code, size_t offset, const char* expected);
+        std::string toString() const;
+    };
+
+    /* Parses a complete SDP message in one pass over its lines. */
+    static bool parse(const std::string& sdpString, SessionDescriptorView& view);
+    static bool parse(const std::string& sdpString, SessionDescriptorView& view,
+        Error& error, const Limits& limits = Limits());
+
+    /* Line level parsers. [begin, end) is the value of a single line, without
+     * the leading "x=" and without the line terminator.
+    **/
+    static bool parseVersion(it begin, it end, unsigned long long& version);
+    static bool parseOrigin(it begin, it end, OriginView& origin);
+    static bool parseSessionName(it begin, it end, StringView& sessionName);
+    static bool parseTime(it begin, it end, Time& time);
+    static bool parseConnectionData(it begin, it end, ConnectionDataView& c);
+    static bool parseAttribute(it begin, it end, AttributeView& attribute);
+    static bool parseMedia(it begin, it end, MediaView& media);
+
+    /* Parses the value of an "a=candidate" attribute. */
+    static bool parseCandidate(it begin, it end, CandidateView& candidate);
+
+    /* Finds the line starting at begin. On success lineEnd points at the line
+     * terminator and next at the first character of the following line.
+     * Accepts "\r\n", "\r" and "\n" like spirit::eol does.
+    **/
+    static bool nextLine(it begin, it end, it& lineEnd, it& next);
+
+    /* Like nextLine, but looks no further than limits.maxLineLength. Fails
+     * with LIMIT_EXCEEDED for a longer line and with MISSING_LINE_TERMINATOR
+     * when end is reached first.
+    **/
+    static bool nextLine(it begin, it end, size_t offset, const Limits& limits,
+        it& lineEnd, it& next, Error& error);
+
+    /* Advances state past a line of the given type ('v', 'o', ...). Returns
+     * false if such a line is not allowed in the current state.
+    **/
+    static bool nextState(State& state, char type);
+
+    /* True once the mandatory v=, o=, s= and t= lines have been seen. */
+    static bool isComplete(State state);
+
+    /* Checks the "x=" prefix of the line [begin, lineEnd), advances state
+     * and counts the line against the limits. offset is the position of
+     * begin in the message and is used for error reporting.
+    **/
+    static bool beginLine(it begin, it lineEnd, size_t offset,
+        const Limits& limits, Counts& counts, State& state, char& type,
+        Error& error);
+
+    /* Counts a media level attribute against maxCandidates. */
+    static bool countAttribute(const AttributeView& attribute, size_t offset,
+        const Limits& limits, Counts& counts, Error& error);
+
+    /* Grammar rule names for error reporting. */
+    static const char* ruleName(char type);
+    static const char* ruleName(State state);
+};
@@ -0,0 +1,197 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    SessionDescriptorStreamParser.cpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Implementation of the incremental SDP parser.
+ * See:         http://tools.ietf.org/html/rfc4566
+**/
+
+/* STL includes */
+#include <cstring>
+
+/* WebP2P includes */
+#include "SessionDescriptorStreamParser.hpp"
+
+SessionDescriptorStreamParser::SessionDescriptorStreamParser(
+    Handler& handler,
+    const SessionDescriptorParser::Limits& limits) :
+    handler(handler),
+    limits(limits),
+    state(SessionDescriptorParser::EXPECT_VERSION),
+    failed(false),
+    consumed(0) {
+}
+
+bool SessionDescriptorStreamParser::feed(const char* chunk, size_t size) {
+    if(failed)
+        return false;
+    /* Without a terminator in the chunk no new line can be complete, so only
+     * the length of the partial line has to be checked. This keeps a long
+     * line fed in many chunks from being rescanned for every chunk.
+    **/
+    bool pendingCR = !buffer.empty() && buffer[buffer.size() - 1] == '\r';
+    buffer.append(chunk, size);
+    if(!pendingCR && !memchr(chunk, '\n', size) && !memchr(chunk, '\r', size)) {
+        if(buffer.size() > limits.maxLineLength + 2)
+            failed = !lastError.set(
+                Error::LIMIT_EXCEEDED, consumed, "maxLineLength");
+        return !failed;
+    }
+    failed = !parseLines(false);
+    return !failed;
+}
+
+bool SessionDescriptorStreamParser::feed(const std::string& chunk) {
+    return feed(chunk.data(), chunk.size());
+}
+
+bool SessionDescriptorStreamParser::finish() {
+    if(failed)
+        return false;
+    /* a line without terminator is not valid, so anything left after the
+     * last line is an error
+    **/
+    if(!parseLines(true))
+        failed = true;
+    else if(!buffer.empty())
+        failed = !lastError.set(Error::MISSING_LINE_TERMINATOR,
+            consumed + buffer.size(), "eol");
+    else if(!SessionDescriptorParser::isComplete(state))
+        failed = !lastError.set(Error::INCOMPLETE, consumed,
+            SessionDescriptorParser::ruleName(state));
+    return !failed;
+}
+
+void SessionDescriptorStreamParser::reset() {
+    state  = SessionDescriptorParser::EXPECT_VERSION;
+    counts = SessionDescriptorParser::Counts();
+    failed = false;
+    lastError = Error();
+    buffer.clear();
+    consumed = 0;
+}
+
+const SessionDescriptorParser::Error&
+SessionDescriptorStreamParser::error() const {
+    return lastError;
+}
+
+bool SessionDescriptorStreamParser::parseLines(bool endOfInput) {
+    const std::string& b = buffer;
+    it p   = b.begin();
+    it end = b.end();
+    bool success = true;
+    while(p != end) {
+        it lineEnd, next;
+        size_t offset = consumed + (p - b.begin());
+        Error lineError;
+        if(!SessionDescriptorParser::nextLine(
+            p, end, offset, limits, lineEnd, next, lineError)) {
+            /* an unterminated line is fine until the input ends */
+            if(lineError.code == Error::LIMIT_EXCEEDED) {
+                lastError = lineError;
+                success = false;
+            }
+            break;
+        }
+        /* a '\r' at the end of the buffer may be the first half of "\r\n" */
+        if(!endOfInput && *lineEnd == '\r' && next == end)
+            break;
+        if(!parseLine(p, lineEnd, offset)) {
+            success = false;
+            break;
+        }
+        p = next;
+    }
+    consumed += p - b.begin();
+    buffer.erase(0, p - b.begin());
+    return success;
+}
+
+bool SessionDescriptorStreamParser::parseLine(
+    it begin, it lineEnd, size_t offset) {
+    typedef SessionDescriptorParser P;
+
+    char type;
+    if(!P::beginLine(begin, lineEnd, offset, limits, counts, state, type,
+        lastError))
+        return false;
+    it value = begin + 2;
+    if(!parseValue(type, value, lineEnd, offset)) {
+        if(lastError.code == Error::NONE)
+            lastError.set(Error::INVALID_VALUE, offset + 2, P::ruleName(type));
+        return false;
+    }
+    return true;
+}
+
+bool SessionDescriptorStreamParser::parseValue(
+    char type, it value, it lineEnd, size_t offset) {
+    typedef SessionDescriptorParser P;
+
+    switch(type) {
+    case 'v': {
+        unsigned long long version;
+        return P::parseVersion(value, lineEnd, version);
+    }
+    case 'o': {
+        OriginView origin;
+        if(!P::parseOrigin(value, lineEnd, origin))
+            return false;
+        handler.origin(origin);
+        return true;
+    }
+    case 's': {
+        StringView sessionName;
+        return P::parseSessionName(value, lineEnd, sessionName);
+    }
+    case 't': {
+        Time time;
+        return P::parseTime(value, lineEnd, time);
+    }
+    case 'a': {
+        AttributeView attribute;
+        if(!P::parseAttribute(value, lineEnd, attribute))
+            return false;
+        if(state == P::SESSION_ATTRIBUTES)
+            handler.sessionAttribute(attribute);
+        else if(!P::countAttribute(attribute, offset, limits, counts, lastError))
+            return false;
+        else if(attribute.id == ATTRIBUTE_CANDIDATE)
+            handler.candidate(attribute.value);
+        else
+            handler.mediaAttribute(attribute);
+        return true;
+    }
+    case 'm': {
+        MediaView media;
+        if(!P::parseMedia(value, lineEnd, media))
+            return false;
+        handler.mediaDescription(media);
+        return true;
+    }
+    case 'c': {
+        ConnectionDataView connectionData;
+        if(!P::parseConnectionData(value, lineEnd, connectionData))
+            return false;
+        handler.connectionData(connectionData);
+        return true;
+    }
+    }
+    return false;
+}
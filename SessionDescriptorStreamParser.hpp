@@ -0,0 +1,99 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    SessionDescriptorStreamParser.hpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Definition of the incremental SDP parser. SDP text can be fed
+ *              in chunks of any size; every line is reported to a Handler as
+ *              soon as it is complete.
+ * See:         http://tools.ietf.org/html/rfc4566
+**/
+
+#pragma once
+
+/* STL includes */
+#include <string>
+
+/* WebP2P includes */
+#include "SessionDescriptorParser.hpp"
+
+class SessionDescriptorStreamParser {
+public:
+    /* Receives one event per line. The views passed to a handler point into
+     * the parser's buffer and are only valid for the duration of the call.
+     * Handlers must not feed the parser that is calling them.
+    **/
+    class Handler {
+    public:
+        virtual ~Handler() {}
+
+        virtual void origin(const OriginView& origin) {}
+        virtual void sessionAttribute(const AttributeView& attribute) {}
+        /* m=, starts a new media section */
+        virtual void mediaDescription(const MediaView& media) {}
+        virtual void connectionData(const ConnectionDataView& c) {}
+        /* a= inside a media section, except for a=candidate */
+        virtual void mediaAttribute(const AttributeView& attribute) {}
+        /* a=candidate inside a media section, value only */
+        virtual void candidate(const StringView& candidate) {}
+    };
+
+private:
+    typedef SessionDescriptorParser::it it;
+    typedef SessionDescriptorParser::Error Error;
+
+    Handler&                        handler;
+    SessionDescriptorParser::Limits limits;
+    SessionDescriptorParser::Counts counts;
+    SessionDescriptorParser::State  state;
+    bool                            failed;
+    Error                           lastError;
+    /* unprocessed data, always starts at the beginning of a line */
+    std::string                     buffer;
+    /* number of bytes fed before the start of buffer */
+    size_t                          consumed;
+
+public:
+    SessionDescriptorStreamParser(Handler& handler,
+        const SessionDescriptorParser::Limits& limits
+            = SessionDescriptorParser::Limits());
+
+    /* Parses every complete line in the chunk, keeping a trailing partial
+     * line of at most limits.maxLineLength bytes for the next call. Returns false as soon as the input can no
+     * longer be valid SDP, and keeps returning false until reset().
+    **/
+    bool feed(const char* chunk, size_t size);
+    bool feed(const std::string& chunk);
+
+    /* Signals the end of the input. Returns true if everything that was fed
+     * forms a valid SDP message.
+    **/
+    bool finish();
+
+    /* Prepares the parser for a new message. */
+    void reset();
+
+    /* Why feed() or finish() failed. Offsets count from the start of the
+     * first chunk.
+    **/
+    const Error& error() const;
+
+private:
+    bool parseLines(bool endOfInput);
+    bool parseLine(it begin, it lineEnd, size_t offset);
+    bool parseValue(char type, it value, it lineEnd, size_t offset);
+};
@@ -0,0 +1,92 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    SessionDescriptorView.cpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Parsing and materialization of the zero-copy SDP data
+ *              structure.
+**/
+
+/* WebP2P includes */
+#include "SessionDescriptorView.hpp"
+#include "SessionDescriptorParser.hpp"
+
+static std::string materializeString(const StringView& v) {
+    return std::string(v.begin(), v.end());
+}
+
+static Attribute materializeAttribute(const AttributeView& v) {
+    if(v.value.empty())
+        return Attribute(PropertyAttribute(materializeString(v.name)));
+    return Attribute(ValuedAttribute(
+        materializeString(v.name), materializeString(v.value)));
+}
+
+bool SessionDescriptorView::parse(const std::string& sdpString) {
+    return SessionDescriptorParser::parse(sdpString, *this);
+}
+
+void SessionDescriptorView::materialize(SessionDescriptorData& data) const {
+    data.protocolVersion       = protocolVersion;
+
+    data.origin.username       = materializeString(origin.username);
+    data.origin.sessionID      = origin.sessionID;
+    data.origin.sessionVersion = origin.sessionVersion;
+    data.origin.netType        = materializeString(origin.netType);
+    data.origin.addressType    = materializeString(origin.addressType);
+    data.origin.unicastAddress = materializeString(origin.unicastAddress);
+
+    data.sessionName           = materializeString(sessionName);
+    data.time                  = time;
+
+    data.sessionAttributes.clear();
+    data.sessionAttributes.reserve(sessionAttributes.size());
+    for(std::vector<AttributeView>::const_iterator i
+        = sessionAttributes.begin(); i != sessionAttributes.end(); i++) {
+        data.sessionAttributes.push_back(materializeAttribute(*i));
+    }
+
+    data.mediaDescriptions.clear();
+    data.mediaDescriptions.resize(mediaDescriptions.size());
+    for(size_t i = 0; i < mediaDescriptions.size(); i++) {
+        const MediaDescriptionView& v = mediaDescriptions[i];
+        MediaDescription& d = data.mediaDescriptions[i];
+
+        d.media.mediaName    = materializeString(v.media.mediaName);
+        d.media.port         = v.media.port;
+        d.media.protocolName = materializeString(v.media.protocolName);
+        for(std::vector<StringView>::const_iterator j
+            = v.media.formats.begin(); j != v.media.formats.end(); j++) {
+            d.media.formats.push_back(materializeString(*j));
+        }
+
+        for(std::vector<ConnectionDataView>::const_iterator j
+            = v.connectionData.begin(); j != v.connectionData.end(); j++) {
+            ConnectionData c;
+            c.netType           = materializeString(j->netType);
+            c.addressType       = materializeString(j->addressType);
+            c.connectionAddress = materializeString(j->connectionAddress);
+            d.connectionData.push_back(c);
+        }
+
+        d.mediaAttributes.reserve(v.mediaAttributes.size());
+        for(std::vector<AttributeView>::const_iterator j
+            = v.mediaAttributes.begin(); j != v.mediaAttributes.end(); j++) {
+            d.mediaAttributes.push_back(materializeAttribute(*j));
+        }
+    }
+}
@@ -0,0 +1,209 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    SessionDescriptorView.hpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Description of the zero-copy data structure for SDP. Every
+ *              string field is a range into the parsed SDP text, which must
+ *              outlive the view. Use materialize() to obtain an owning
+ *              SessionDescriptorData.
+**/
+
+#pragma once
+
+/* STL includes */
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* Boost includes */
+#include <boost/fusion/include/adapt_struct.hpp>
+#include <boost/range/iterator_range.hpp>
+
+/* WebP2P includes */
+#include "SessionDescriptorAttributeNames.hpp"
+#include "SessionDescriptorData.hpp"
+
+typedef boost::iterator_range<std::string::const_iterator> StringView;
+
+struct OriginView {
+    StringView         username;
+    unsigned long long sessionID;
+    unsigned long long sessionVersion;
+    StringView         netType;
+    StringView         addressType;
+    StringView         unicastAddress;
+};
+
+BOOST_FUSION_ADAPT_STRUCT(
+    OriginView,
+    (StringView,         username)
+    (unsigned long long, sessionID)
+    (unsigned long long, sessionVersion)
+    (StringView,         netType)
+    (StringView,         addressType)
+    (StringView,         unicastAddress)
+)
+
+struct ConnectionDataView {
+    StringView         netType;
+    StringView         addressType;
+    StringView         connectionAddress;
+};
+
+BOOST_FUSION_ADAPT_STRUCT(
+    ConnectionDataView,
+    (StringView,       netType)
+    (StringView,       addressType)
+    (StringView,       connectionAddress)
+)
+
+/* A property attribute ("a=recvonly") has an empty value. id is set by
+ * both SessionDescriptorParser and SessionDescriptorViewGrammar.
+**/
+struct AttributeView {
+    StringView         name;
+    StringView         value;
+    AttributeName      id;
+
+    AttributeView() : id(ATTRIBUTE_UNKNOWN) {}
+};
+
+BOOST_FUSION_ADAPT_STRUCT(
+    AttributeView,
+    (StringView,       name)
+    (StringView,       value)
+)
+
+/* Value of an ICE "a=candidate" attribute, see RFC 5245 section 15.1.
+ * relatedAddress is empty and relatedPort 0 when they are absent.
+**/
+struct CandidateView {
+    StringView                  foundation;
+    unsigned short              componentID;
+    StringView                  transport;
+    unsigned                    priority;
+    StringView                  connectionAddress;
+    unsigned short              port;
+    StringView                  type;
+    StringView                  relatedAddress;
+    unsigned short              relatedPort;
+    std::vector<AttributeView>  extensions;
+};
+
+/* Position of the first attribute with each well-known name in a section,
+ * for constant time lookup.
+**/
+class AttributeIndex {
+    /* position + 1, 0 if absent */
+    unsigned first[ATTRIBUTE_NAME_COUNT];
+public:
+    AttributeIndex() {
+        clear();
+    }
+    void clear() {
+        memset(first, 0, sizeof(first));
+    }
+    void add(AttributeName name, size_t position) {
+        if(name != ATTRIBUTE_UNKNOWN && first[name] == 0)
+            first[name] = static_cast<unsigned>(position + 1);
+    }
+    const AttributeView* find(
+        const std::vector<AttributeView>& attributes,
+        AttributeName name) const {
+        return first[name] ? &attributes[first[name] - 1] : NULL;
+    }
+};
+
+struct MediaView {
+    StringView                  mediaName;
+    unsigned short              port;
+    StringView                  protocolName;
+    std::vector<StringView>     formats;
+};
+
+BOOST_FUSION_ADAPT_STRUCT(
+    MediaView,
+    (StringView, mediaName)
+    (unsigned short, port)
+    (StringView, protocolName)
+    (std::vector<StringView>, formats)
+)
+
+struct MediaDescriptionView {
+    /* m= */
+    MediaView                          media;
+    /* c= */
+    std::vector<ConnectionDataView>    connectionData;
+    /* a= */
+    std::vector<AttributeView>         mediaAttributes;
+    AttributeIndex                     mediaAttributeIndex;
+
+    /* First attribute with a well-known name, NULL if there is none. */
+    const AttributeView* findAttribute(AttributeName name) const {
+        return mediaAttributeIndex.find(mediaAttributes, name);
+    }
+};
+
+BOOST_FUSION_ADAPT_STRUCT(
+    MediaDescriptionView,
+    (MediaView, media)
+    (std::vector<ConnectionDataView>, connectionData)
+    (std::vector<AttributeView>, mediaAttributes)
+)
+
+struct SessionDescriptorView {
+    /* v= */
+    unsigned long long                 protocolVersion;
+    /* o= */
+    OriginView                         origin;
+    /* s= */
+    StringView                         sessionName;
+    /* t= */
+    std::vector<Time>                  time;
+    /* a= */
+    std::vector<AttributeView>         sessionAttributes;
+    AttributeIndex                     sessionAttributeIndex;
+    /* m= */
+    std::vector<MediaDescriptionView>  mediaDescriptions;
+
+    /* Parses sdpString into this view with SessionDescriptorParser. Returns
+     * true if the whole string was matched. sdpString must not be modified or
+     * destroyed while the view is in use.
+    **/
+    bool parse(const std::string& sdpString);
+
+    /* First session attribute with a well-known name, NULL if there is
+     * none.
+    **/
+    const AttributeView* findSessionAttribute(AttributeName name) const {
+        return sessionAttributeIndex.find(sessionAttributes, name);
+    }
+
+    /* Copies every field into an owning data structure. */
+    void materialize(SessionDescriptorData& data) const;
+};
+
+BOOST_FUSION_ADAPT_STRUCT(
+    SessionDescriptorView,
+    (unsigned long long, protocolVersion)
+    (OriginView, origin)
+    (StringView, sessionName)
+    (std::vector<Time>, time)
+    (std::vector<AttributeView>, sessionAttributes)
+    (std::vector<MediaDescriptionView>, mediaDescriptions)
+)
@@ -0,0 +1,162 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    SessionDescriptorViewGrammar.cpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Implementation for the RFC 4566 SDP grammar rules that produce
+ *              a SessionDescriptorView.
+ * See:         http://tools.ietf.org/html/rfc4566
+**/
+
+/* Boost includes */
+#include <boost/spirit/include/phoenix_container.hpp>
+#include <boost/spirit/include/phoenix_function.hpp>
+#include <boost/spirit/include/phoenix_fusion.hpp>
+#include <boost/spirit/include/phoenix_operator.hpp>
+#include <boost/thread/tss.hpp>
+
+/* WebP2P includes */
+#include "SessionDescriptorViewGrammar.hpp"
+
+/* The ids and indexes SessionDescriptorParser fills in as it goes. */
+struct NameAttribute {
+    typedef void result_type;
+
+    void operator()(AttributeView& attribute, const StringView& name) const {
+        attribute.name = name;
+        attribute.id = AttributeNames::lookup(&*name.begin(), name.size());
+    }
+};
+
+struct IndexAttributes {
+    typedef void result_type;
+
+    static void index(const std::vector<AttributeView>& attributes,
+        AttributeIndex& index) {
+        index.clear();
+        for(size_t i = 0; i < attributes.size(); i++)
+            index.add(attributes[i].id, i);
+    }
+    void operator()(MediaDescriptionView& media) const {
+        index(media.mediaAttributes, media.mediaAttributeIndex);
+    }
+    void operator()(SessionDescriptorView& view) const {
+        index(view.sessionAttributes, view.sessionAttributeIndex);
+    }
+};
+
+SessionDescriptorViewGrammar::SessionDescriptorViewGrammar() :
+    SessionDescriptorViewGrammar::base_type(session_description) {
+    using           boost::spirit::qi::iso8859_1::char_;
+    using           boost::spirit::qi::raw;
+    using           boost::spirit::qi::lit;
+    using           boost::spirit::qi::ulong_long;
+    using           boost::spirit::qi::ushort_;
+    using           boost::spirit::qi::eps;
+    using           boost::spirit::qi::_val;
+    using           boost::spirit::qi::_1;
+    using           boost::spirit::eol;
+    using           boost::phoenix::at_c;
+    using           boost::phoenix::push_back;
+    boost::phoenix::function<NameAttribute>   nameAttribute;
+    boost::phoenix::function<IndexAttributes> indexAttributes;
+
+    /* The start symbol */
+    session_description  %= proto_version
+                         >> origin_field
+                         >> session_name_field
+                         >> time_fields
+                         >> attribute_fields
+                         >> media_descriptions
+                         >> eps[indexAttributes(_val)];
+
+    /* SDP fields, see SessionDescriptorGrammar for the full definitions */
+    proto_version        %=   lit("v=")
+                         >> ulong_long          >> eol;
+    origin_field         %=   lit("o=")
+                         >> raw[non_ws_string]  >> lit(' ')
+                         >> ulong_long          >> lit(' ')
+                         >> ulong_long          >> lit(' ')
+                         >> raw[token]          >> lit(' ')
+                         >> raw[token]          >> lit(' ')
+                         >> raw[non_ws_string]  >> eol;
+    session_name_field    =   lit("s=")
+                         >> raw[byte_string][_val = _1] >> eol;
+    connection_field     %=   lit("c=")
+                         >> raw[token]          >> lit(' ')
+                         >> raw[token]          >> lit(' ')
+                         >> raw[non_ws_string]  >> eol;
+    time_fields          %= +(lit("t=")
+                         >> ulong_long          >> lit(' ')
+                         >> ulong_long          >> eol);
+    attribute_fields     %= *(lit("a=")
+                         >> attribute           >> eol);
+    attribute             = raw[token][nameAttribute(_val, _1)]
+                         >> -(lit(':') >> raw[byte_string][at_c<1>(_val) = _1]);
+    media_descriptions   %= *media_description;
+    media_description    %= media_field
+                         >> *connection_field
+                         >> attribute_fields
+                         >> eps[indexAttributes(_val)];
+    media_field          %=   lit("m=")
+                         >> raw[token]          >> lit(' ')
+                         >> ushort_             >> lit(' ')
+                         >> raw[proto]
+                         >> formats             >> eol;
+    formats               = +(lit(' ') >> raw[token][push_back(_val, _1)]);
+
+    /* lexical rules, character ranges as in SessionDescriptorGenericGrammar */
+    token                 = +(char_('\x21')
+                         |   char_('\x23', '\x27')
+                         |   char_('\x2A', '\x2B')
+                         |   char_('\x2D', '\x2E')
+                         |   char_('\x30', '\x39')
+                         |   char_('\x41', '\x5A')
+                         |   char_('\x5E', '\x7E'));
+    byte_string           = +(char_('\x01', '\x09')
+                         |   char_('\x0B', '\x0C')
+                         |   char_('\x0E', '\xFF'));
+    non_ws_string         = +(char_('\x21', '\x7E')
+                         |   char_('\x80', '\xFF'));
+    proto                 = token >> *(char_('/') >> token);
+
+    /* naming */
+    session_description.name("session-description");
+    proto_version.name("proto-version");
+    origin_field.name("origin-field");
+    session_name_field.name("session-name-field");
+    connection_field.name("connection-field");
+    time_fields.name("time-fields");
+    attribute_fields.name("attribute-fields");
+    attribute.name("attribute");
+    media_descriptions.name("media-descriptions");
+    media_description.name("media-description");
+    media_field.name("media-field");
+    formats.name("formats");
+    token.name("token");
+    byte_string.name("byte-string");
+    non_ws_string.name("non-ws-string");
+    proto.name("proto");
+}
+
+static boost::thread_specific_ptr<SessionDescriptorViewGrammar> cachedGrammar;
+
+const SessionDescriptorViewGrammar& SessionDescriptorViewGrammar::instance() {
+    if(!cachedGrammar.get())
+        cachedGrammar.reset(new SessionDescriptorViewGrammar());
+    return *cachedGrammar;
+}
@@ -0,0 +1,75 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    SessionDescriptorViewGrammar.hpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: Definition for the RFC 4566 SDP grammar rules that produce a
+ *              SessionDescriptorView instead of copying every field.
+ * See:         http://tools.ietf.org/html/rfc4566
+**/
+
+#pragma once
+
+/* Boost includes */
+#include <boost/spirit/include/qi.hpp>
+
+/* WebP2P includes */
+#include "SessionDescriptorView.hpp"
+
+struct SessionDescriptorViewGrammar :
+    boost::spirit::qi::grammar<std::string::const_iterator,
+                               SessionDescriptorView()> {
+    typedef std::string::const_iterator it;
+
+    /* lexical rules, these never synthesize an attribute so that matching
+     * them does not allocate
+    **/
+    boost::spirit::qi::rule<it> token, byte_string, non_ws_string, proto;
+
+    /* rules for this grammar */
+    boost::spirit::qi::rule<it, unsigned long long()>
+        proto_version;
+    boost::spirit::qi::rule<it, OriginView()>
+        origin_field;
+    boost::spirit::qi::rule<it, StringView()>
+        session_name_field;
+    boost::spirit::qi::rule<it, std::vector<Time>()>
+        time_fields;
+    boost::spirit::qi::rule<it, std::vector<AttributeView>()>
+        attribute_fields;
+    boost::spirit::qi::rule<it, AttributeView()>
+        attribute;
+    boost::spirit::qi::rule<it, std::vector<MediaDescriptionView>()>
+        media_descriptions;
+    boost::spirit::qi::rule<it, MediaDescriptionView()>
+        media_description;
+    boost::spirit::qi::rule<it, MediaView()>
+        media_field;
+    boost::spirit::qi::rule<it, std::vector<StringView>()>
+        formats;
+    boost::spirit::qi::rule<it, ConnectionDataView()>
+        connection_field;
+
+    /* start symbol for this grammar */
+    boost::spirit::qi::rule<it, SessionDescriptorView()>
+        session_description;
+
+    SessionDescriptorViewGrammar();
+
+    /* Cached per-thread instance, see SessionDescriptorGrammar::instance(). */
+    static const SessionDescriptorViewGrammar& instance();
+};
@@ -0,0 +1,210 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    SessionDescriptorWriter.hpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: SDP serializer that appends to a caller-provided buffer. The
+ *              buffer is either a growable std::string (StringBuffer) or a
+ *              fixed-capacity array that can live on the stack (FixedBuffer).
+ *              Lines are terminated with "\n", like the rest of WebP2P.
+ * See:         http://tools.ietf.org/html/rfc4566
+**/
+
+#pragma once
+
+/* STL includes */
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* Boost includes */
+#include <boost/variant/get.hpp>
+
+/* WebP2P includes */
+#include "SessionDescriptorData.hpp"
+#include "SessionDescriptorView.hpp"
+
+/* Appends to an existing string. Reserve capacity up front and reuse the
+ * string to avoid allocations altogether.
+**/
+class StringBuffer {
+    std::string& buffer;
+public:
+    StringBuffer(std::string& buffer) : buffer(buffer) {}
+
+    void append(const char* data, size_t size) {
+        buffer.append(data, size);
+    }
+    bool overflowed() const {
+        return false;
+    }
+};
+
+/* Appends to a fixed array. Data that does not fit is dropped and the buffer
+ * is marked as overflowed, so the caller can fall back to a StringBuffer.
+**/
+template<size_t N> class FixedBuffer {
+    char   buffer[N];
+    size_t length;
+    bool   overflow;
+public:
+    FixedBuffer() : length(0), overflow(false) {}
+
+    void append(const char* data, size_t size) {
+        if(overflow || size > N - length) {
+            overflow = true;
+            return;
+        }
+        memcpy(buffer + length, data, size);
+        length += size;
+    }
+    bool overflowed() const {
+        return overflow;
+    }
+    const char* data() const {
+        return buffer;
+    }
+    size_t size() const {
+        return length;
+    }
+    void clear() {
+        length   = 0;
+        overflow = false;
+    }
+};
+
+template<typename Buffer> class SessionDescriptorWriter {
+    Buffer& out;
+public:
+    SessionDescriptorWriter(Buffer& out) : out(out) {}
+
+    SessionDescriptorWriter& text(const char* s, size_t size) {
+        out.append(s, size);
+        return *this;
+    }
+    SessionDescriptorWriter& text(const char* s) {
+        return text(s, strlen(s));
+    }
+    SessionDescriptorWriter& text(const std::string& s) {
+        return text(s.data(), s.size());
+    }
+    SessionDescriptorWriter& text(const StringView& s) {
+        return s.empty() ? *this : text(&*s.begin(), s.size());
+    }
+    SessionDescriptorWriter& character(char c) {
+        return text(&c, 1);
+    }
+
+    SessionDescriptorWriter& number(unsigned long long n) {
+        char digits[20];
+        char* p = digits + sizeof(digits);
+        do {
+            *--p = static_cast<char>('0' + n % 10);
+            n /= 10;
+        } while(n);
+        return text(p, digits + sizeof(digits) - p);
+    }
+
+    /* Dotted quad for an IPv4 address in network byte order. */
+    SessionDescriptorWriter& ipv4Address(const unsigned char address[4]) {
+        return number(address[0]).character('.')
+            .number(address[1]).character('.')
+            .number(address[2]).character('.')
+            .number(address[3]);
+    }
+
+    /* "x=" */
+    SessionDescriptorWriter& beginLine(char type) {
+        char prefix[2] = { type, '=' };
+        return text(prefix, 2);
+    }
+    SessionDescriptorWriter& endLine() {
+        return character('\n');
+    }
+
+    SessionDescriptorWriter& attribute(const Attribute& a) {
+        beginLine('a');
+        if(const PropertyAttribute* at = boost::get<PropertyAttribute>(&a))
+            text(*at);
+        else if(const ValuedAttribute* at = boost::get<ValuedAttribute>(&a))
+            text(boost::fusion::at_c<0>(*at)).character(':')
+                .text(boost::fusion::at_c<1>(*at));
+        return endLine();
+    }
+    SessionDescriptorWriter& attribute(const AttributeView& a) {
+        beginLine('a').text(a.name);
+        if(!a.value.empty())
+            character(':').text(a.value);
+        return endLine();
+    }
+
+    /* MediaDescription and MediaDescriptionView. */
+    template<typename M> SessionDescriptorWriter& mediaDescription(const M& m) {
+        /* m= */
+        beginLine('m').text(m.media.mediaName)
+            .character(' ').number(m.media.port)
+            .character(' ').text(m.media.protocolName);
+        for(size_t i = 0; i < m.media.formats.size(); i++)
+            character(' ').text(m.media.formats[i]);
+        endLine();
+
+        /* c= */
+        for(size_t i = 0; i < m.connectionData.size(); i++) {
+            beginLine('c').text(m.connectionData[i].netType)
+                .character(' ').text(m.connectionData[i].addressType)
+                .character(' ').text(m.connectionData[i].connectionAddress)
+                .endLine();
+        }
+
+        /* a= */
+        for(size_t i = 0; i < m.mediaAttributes.size(); i++)
+            attribute(m.mediaAttributes[i]);
+        return *this;
+    }
+
+    /* SessionDescriptorData and SessionDescriptorView. */
+    template<typename Descriptor>
+    SessionDescriptorWriter& write(const Descriptor& d) {
+        /* v= */
+        beginLine('v').number(d.protocolVersion).endLine();
+
+        /* o= */
+        beginLine('o').text(d.origin.username)
+            .character(' ').number(d.origin.sessionID)
+            .character(' ').number(d.origin.sessionVersion)
+            .character(' ').text(d.origin.netType)
+            .character(' ').text(d.origin.addressType)
+            .character(' ').text(d.origin.unicastAddress).endLine();
+
+        /* s= */
+        beginLine('s').text(d.sessionName).endLine();
+
+        /* t= */
+        for(size_t i = 0; i < d.time.size(); i++) {
+            beginLine('t').number(d.time[i].startTime)
+                .character(' ').number(d.time[i].stopTime).endLine();
+        }
+
+        /* a= */
+        for(size_t i = 0; i < d.sessionAttributes.size(); i++)
+            attribute(d.sessionAttributes[i]);
+
+        for(size_t i = 0; i < d.mediaDescriptions.size(); i++)
+            mediaDescription(d.mediaDescriptions[i]);
+        return *this;
+    }
+};
@@ -0,0 +1,79 @@
+#/**********************************************************\
+#
+# The webp2p_core library: the SDP grammars and parsers and the ICE client,
+# without any of the browser plugin code, so they can be linked into native
+# tools, tests and benchmarks as well as into the plugin.
+#
+# Include this file after setting up the Boost (and pjproject) include
+# directories. Set WEBP2P_CORE_WITHOUT_ICE to leave out ICEClient, and with
+# it the dependency on pjproject.
+#
+#\**********************************************************/
+
+get_filename_component (WEBP2P_CORE_DIR ${CMAKE_CURRENT_LIST_FILE} PATH)
+
+# relative to WEBP2P_CORE_DIR
+set (WEBP2P_CORE_FILES
+    ABNFCoreGrammar.cpp
+    ABNFCoreGrammar.hpp
+    AddrSpecGrammar.cpp
+    AddrSpecGrammar.hpp
+    BitmapTransfer.cpp
+    BitmapTransfer.hpp
+    CongestionController.cpp
+    CongestionController.hpp
+    FileTransfer.cpp
+    FileTransfer.hpp
+    PacketBuffer.cpp
+    PacketBuffer.hpp
+    ReliableChannel.cpp
+    ReliableChannel.hpp
+    SendScheduler.cpp
+    SendScheduler.hpp
+    URIReferenceGrammar.cpp
+    URIReferenceGrammar.hpp
+    SessionDescriptor.cpp
+    SessionDescriptor.hpp
+    SessionDescriptorAttributeNames.cpp
+    SessionDescriptorAttributeNames.hpp
+    SessionDescriptorData.hpp
+    SessionDescriptorGenericGrammar.cpp
+    SessionDescriptorGenericGrammar.hpp
+    SessionDescriptorGrammar.cpp
+    SessionDescriptorGrammar.hpp
+    SessionDescriptorParser.cpp
+    SessionDescriptorParser.hpp
+    SessionDescriptorStreamParser.cpp
+    SessionDescriptorStreamParser.hpp
+    SessionDescriptorView.cpp
+    SessionDescriptorView.hpp
+    SessionDescriptorViewGrammar.cpp
+    SessionDescriptorViewGrammar.hpp
+    SessionDescriptorWriter.hpp
+    )
+
+if (NOT WEBP2P_CORE_WITHOUT_ICE)
+    set (WEBP2P_CORE_FILES
+        ${WEBP2P_CORE_FILES}
+        ICEClient.cpp
+        ICEClient.hpp
+        ICERuntime.cpp
+        ICERuntime.hpp
+        )
+endif ()
+
+set (WEBP2P_CORE_SOURCES)
+foreach (FILE ${WEBP2P_CORE_FILES})
+    set (WEBP2P_CORE_SOURCES ${WEBP2P_CORE_SOURCES} ${WEBP2P_CORE_DIR}/${FILE})
+endforeach ()
+
+SOURCE_GROUP(Core FILES ${WEBP2P_CORE_SOURCES})
+
+include_directories (${WEBP2P_CORE_DIR})
+
+add_library (webp2p_core STATIC ${WEBP2P_CORE_SOURCES})
+
+# the plugin is a shared library, so the code linked into it must be PIC
+if (CMAKE_COMPILER_IS_GNUCXX OR CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+    set_target_properties (webp2p_core PROPERTIES COMPILE_FLAGS -fPIC)
+endif ()
@@ -0,0 +1,62 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    FileDialogWin.cpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: The file dialogs on Windows, the common dialog for files and
+ *              the shell folder browser for directories.
+**/
+
+/* Windows includes */
+#include <windows.h>
+#include <commdlg.h>
+#include <shlobj.h>
+
+/* WebP2P includes */
+#include "../FileDialog.hpp"
+
+bool FileDialog::chooseFile(std::string& path) {
+    char buffer[MAX_PATH] = "";
+    OPENFILENAMEA dialog;
+    ZeroMemory(&dialog, sizeof(dialog));
+    dialog.lStructSize = sizeof(dialog);
+    dialog.lpstrFile = buffer;
+    dialog.nMaxFile = sizeof(buffer);
+    dialog.lpstrTitle = "Send a file";
+    dialog.Flags = OFN_FILEMUSTEXIST | OFN_PATHMUSTEXIST | OFN_NOCHANGEDIR;
+    if(!GetOpenFileNameA(&dialog))
+        return false;
+    path = buffer;
+    return true;
+}
+
+bool FileDialog::chooseDirectory(std::string& path) {
+    char buffer[MAX_PATH] = "";
+    BROWSEINFOA browse;
+    ZeroMemory(&browse, sizeof(browse));
+    browse.pszDisplayName = buffer;
+    browse.lpszTitle = "Save received files in";
+    browse.ulFlags = BIF_RETURNONLYFSDIRS | BIF_NEWDIALOGSTYLE;
+    LPITEMIDLIST list = SHBrowseForFolderA(&browse);
+    if(list == NULL)
+        return false;
+    bool chosen = SHGetPathFromIDListA(list, buffer) != FALSE;
+    CoTaskMemFree(list);
+    if(chosen)
+        path = buffer;
+    return chosen;
+}
@@ -54,6 +54,7 @@ endif()
 
 target_link_libraries(${PROJNAME}
     ${PLUGIN_INTERNAL_DEPS}
+    webp2p_core
 	${WS2_32}
     ${PJ_LIB}
     ${PJ_LIB_UTIL}
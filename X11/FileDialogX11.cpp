@@ -0,0 +1,56 @@
+/**
+ * This file is part of WebP2P.
+ *
+ * WebP2P is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * WebP2P is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with WebP2P.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Filename:    FileDialogX11.cpp
+ * Author(s):   Dries Staelens
+ * Copyright:   Copyright (c) 2010 Dries Staelens
+ * Description: The file dialogs on X11, the GTK file chooser the browser
+ *              uses as well.
+**/
+
+/* GTK includes */
+#include <gtk/gtk.h>
+
+/* WebP2P includes */
+#include "../FileDialog.hpp"
+
+static bool runChooser(GtkFileChooserAction action, const char* title,
+    std::string& path) {
+    GtkWidget* dialog = gtk_file_chooser_dialog_new(title, NULL, action,
+        GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+        GTK_STOCK_OPEN, GTK_RESPONSE_ACCEPT,
+        NULL);
+    bool chosen = gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT;
+    if(chosen) {
+        gchar* name = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+        chosen = name != NULL;
+        if(chosen) {
+            path = name;
+            g_free(name);
+        }
+    }
+    gtk_widget_destroy(dialog);
+    return chosen;
+}
+
+bool FileDialog::chooseFile(std::string& path) {
+    return runChooser(GTK_FILE_CHOOSER_ACTION_OPEN, "Send a file", path);
+}
+
+bool FileDialog::chooseDirectory(std::string& path) {
+    return runChooser(GTK_FILE_CHOOSER_ACTION_SELECT_FOLDER,
+        "Save received files in", path);
+}
@@ -15,6 +15,11 @@ file (GLOB PLATFORM RELATIVE ${CMAKE_CURRENT_SOURCE_DIR}
 
 SOURCE_GROUP(${PLATFORM_NAME} FILES ${PLATFORM})
 
+# the file dialogs use GTK, like the browser
+find_package(PkgConfig REQUIRED)
+pkg_check_modules(GTK REQUIRED gtk+-2.0)
+include_directories(${GTK_INCLUDE_DIRS})
+
 # use this to add preprocessor definitions
 add_definitions(
 )
@@ -29,4 +34,6 @@ add_x11_plugin(${PROJNAME} SOURCES)
 # add library dependencies here; leave ${PLUGIN_INTERNAL_DEPS} there unless you know what you're doing!
 target_link_libraries(${PROJNAME}
     ${PLUGIN_INTERNAL_DEPS}
+    webp2p_core
+    ${GTK_LIBRARIES}
     )